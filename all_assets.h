@@ -1,7 +0,0 @@
-#pragma once
-
-#include "assets/api/mesh_data.h"
-
-#include "assets/xxd_mesh/ball_mesh.h"
-#include "assets/xxd_mesh/lane_mesh.h"
-#include "assets/xxd_mesh/pin_mesh.h"
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <iostream>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "framework/boot.h"
+
+#include "assets/api/mesh_data.h"
+#include "bot.h"
+#include "frustum.h"
+#include "mesh.h"
+#include "physics/lane.h"
+#include "physics/physics.h"
+#include "score.h"
+
+// One lane of the alley, a bot bowls on it all day
+struct AlleyLane
+{
+    Physics phy;
+    BowlingBot bot;
+    BowlingScoreboard board;
+    int wereDead = 0;
+    bool throwing = false;
+    float waitTime = 0.0f; // Till the next throw
+    float throwingTime = 0.0f;
+    float settlingTime = 0.0f;
+};
+
+/*
+ * Whole bowling centre from one camera, for attract loops and the manager
+ * dashboard. Every lane has its own physics world, poses of all lanes go
+ * into one instance list per mesh (lanes, pins, balls), so the whole alley
+ * is one instanced draw per mesh and LOD, however many lanes there are.
+ *
+ * Worlds are made on first use, 24 of them are a few MB nobody playing
+ * a single lane needs.
+ */
+struct Alley
+{
+    static constexpr int LANES = 24;
+    static constexpr float IDLE_SECONDS = 1.5f; // Between throws, like the single lane bot
+    static constexpr float LANE_GAP = 0.3f;     // Ball return space between two lanes
+
+    bool enabled = false;
+    bool initialised = false;
+    float laneSpacing = 2.0f; // Centre to centre, from the lane mesh
+    AlleyLane lanes[LANES];
+    glm::vec3 initialPins[10];
+
+    // For the debug UI
+    float lastStepMs = 0.0f;
+    int throwsInFlight = 0;
+
+    void initAlley(const MeshData &laneMd, const StrikeTable *table)
+    {
+        std::vector<float> lanePositions = meshPositions(laneMd);
+        std::vector<uint32_t> laneIndices = meshIndices(laneMd);
+        this->laneSpacing = laneMd.bounds.aabbMax[0] - laneMd.bounds.aabbMin[0] + LANE_GAP;
+        lane_rack_pins(this->initialPins);
+
+        for (int i = 0; i < LANES; i++)
+        {
+            AlleyLane &lane = this->lanes[i];
+            lane.phy.tempArenaBytes = 256 * 1024; // Plenty for one ball and ten pins
+            lane.phy.physics_init(
+                lanePositions.data(),
+                lanePositions.size(),
+                laneIndices.data(),
+                laneIndices.size(),
+                this->initialPins,
+                LANE_BALL_START);
+            // Own seed and skill per lane, and not all throwing in the same frame
+            lane.bot.initBowlingBot(table, 0.5f + 0.02f * i, 1000u + i * 7919u);
+            lane.waitTime = IDLE_SECONDS * lane.bot.nextRandom() * 3.0f;
+            resetScoreboard(lane.board);
+        }
+        this->initialised = true;
+        std::cerr << "Alley: " << LANES << " lanes, " << this->laneSpacing << " m apart" << std::endl;
+    }
+
+    glm::mat4 laneTransform(int lane) const
+    {
+        float x = (lane - 0.5f * (LANES - 1)) * this->laneSpacing;
+        return glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, 0.0f));
+    }
+
+    void updateAlley(float deltaTime)
+    {
+        uint64_t start = SDL_GetPerformanceCounter();
+        this->throwsInFlight = 0;
+        for (AlleyLane &lane : this->lanes)
+        {
+            if (!lane.throwing)
+            {
+                lane.waitTime -= deltaTime;
+                if (lane.waitTime <= 0.0f)
+                {
+                    this->throwLane(lane);
+                }
+            }
+            else
+            {
+                this->judgeLane(lane, deltaTime);
+            }
+            // Nothing moves on an idle lane, Jolt skips sleeping bodies
+            lane.phy.physics_step(deltaTime);
+            this->throwsInFlight += lane.throwing;
+        }
+        this->lastStepMs = 1000.0f * (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    }
+
+    // Table when there is one, otherwise something plausible down the middle
+    void throwLane(AlleyLane &lane)
+    {
+        BotThrow bt;
+        if (!lane.bot.pickThrow(&bt))
+        {
+            bt.x = 0.3f * (lane.bot.nextRandom() - 0.5f);
+            bt.speed = 7.0f + 3.0f * lane.bot.nextRandom();
+            bt.spin = 0.02f * (lane.bot.nextRandom() - 0.5f);
+        }
+        lane_launch(lane.phy, bt.x, bt.speed, bt.spin);
+        lane.throwing = true;
+        lane.throwingTime = 0.0f;
+        lane.settlingTime = 0.0f;
+    }
+
+    // Same rules as the THROW phase of the game
+    void judgeLane(AlleyLane &lane, float deltaTime)
+    {
+        if (lane.phy.is_settling_started())
+        {
+            lane.settlingTime += deltaTime;
+        }
+        else
+        {
+            lane.throwingTime += deltaTime;
+        }
+
+        bool waitToSettle = lane.settlingTime < 3.0f && lane.throwingTime < 10.0f;
+        int state = lane.phy.checkThrowComplete(waitToSettle ? 0.1f : 100.0f, -0.1f);
+        if (state == -1)
+        {
+            return;
+        }
+
+        bool frameCompleted = addRoll(&lane.board, state - lane.wereDead);
+        lane.wereDead = frameCompleted ? 0 : state;
+        lane.phy.physics_reset(this->initialPins, LANE_BALL_START, frameCompleted);
+        if (isGameFinished(&lane.board))
+        {
+            resetScoreboard(lane.board);
+        }
+        lane.throwing = false;
+        lane.waitTime = IDLE_SECONDS;
+    }
+
+    // Poses of every lane into the three meshes, then cull, LOD and stream them,
+    // after this each mesh is one instanced draw per LOD
+    void fillAlleyInstances(
+        AssetMesh &laneMesh,
+        AssetMesh &pinMesh,
+        AssetMesh &ballMesh,
+        const Frustum &frustum,
+        const glm::mat4 &cameraMatrix,
+        const glm::mat4 &projectionMatrix,
+        float viewportHeight,
+        StreamBuffer &stream)
+    {
+        laneMesh.setInstanceCount(LANES);
+        pinMesh.setInstanceCount(LANES * 10);
+        ballMesh.setInstanceCount(LANES);
+
+        glm::mat4 idleBall = glm::translate(glm::mat4(1.0f), LANE_RELEASE_POINT);
+        for (int l = 0; l < LANES; l++)
+        {
+            AlleyLane &lane = this->lanes[l];
+            glm::mat4 offset = this->laneTransform(l);
+            laneMesh.setInstanceTransform(l, offset);
+            for (int i = 0; i < 10; i++)
+            {
+                float halfHeight = 0.19f;
+                glm::mat4 pinModel = glm::translate(lane.phy.physics_get_pin_matrix(i), glm::vec3(0.0f, -halfHeight, 0.0f));
+                pinMesh.setInstanceTransform(l * 10 + i, offset * pinModel);
+            }
+            // Parked ball is up in the air, it waits at the foul line instead
+            ballMesh.setInstanceTransform(l, offset * (lane.throwing ? lane.phy.physics_get_ball_matrix() : idleBall));
+        }
+
+        AssetMesh *meshes[3] = {&laneMesh, &pinMesh, &ballMesh};
+        for (AssetMesh *mesh : meshes)
+        {
+            mesh->cullInstances(frustum, glm::mat4(1.0f));
+            mesh->selectLods(glm::mat4(1.0f), cameraMatrix, projectionMatrix, viewportHeight);
+            mesh->sendInstanceDataToGpu(stream);
+        }
+    }
+
+    // High behind the foul lines, slowly panning along the alley
+    void alleyCamera(float time, float aspectRatio, glm::mat4 &cameraMatrix, glm::mat4 &projectionMatrix) const
+    {
+        float halfWidth = 0.5f * LANES * this->laneSpacing;
+        float sway = 0.4f * halfWidth * sinf(0.1f * time);
+        cameraMatrix = glm::lookAt(
+            glm::vec3(sway, 9.0f, -30.0f),
+            glm::vec3(0.5f * sway, 0.0f, -4.0f),
+            glm::vec3(0.0f, 1.0f, 0.0f));
+        projectionMatrix = glm::perspective(glm::radians(60.0f), aspectRatio, 0.5f, 100.0f);
+    }
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "assets/api/asset_pack.h"
+#include "assets/api/mesh_data.h"
+
+/*
+ * Read-only view of the pack made by `assman pack`. The file is mmapped and
+ * MeshData points straight into it, nothing is copied until the GPU upload.
+ * Views stay valid until closeAssetPack() or a swap by pollAssetPack().
+ */
+struct AssetPack
+{
+    const AssetPackHeader *header = nullptr;
+    const AssetPackEntry *entries = nullptr;
+
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+
+    // For pollAssetPack
+    std::string path;
+    time_t modifiedTime = 0;
+    float pollAccumulator = 0.0f;
+
+    bool openAssetPack(const char *path)
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << "No asset pack at " << path << std::endl;
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(AssetPackHeader))
+        {
+            std::cerr << "Asset pack too small: " << path << std::endl;
+            close(fd);
+            return false;
+        }
+
+        void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            std::cerr << "Failed to mmap asset pack: " << path << std::endl;
+            return false;
+        }
+
+        if (!assetPackValid(static_cast<const uint8_t *>(mapped), st.st_size))
+        {
+            std::cerr << "Asset pack is broken or from another version: " << path << std::endl;
+            munmap(mapped, st.st_size);
+            return false;
+        }
+
+        this->mapping = mapped;
+        this->mappingSize = st.st_size;
+        this->header = static_cast<const AssetPackHeader *>(mapped);
+        this->entries = reinterpret_cast<const AssetPackEntry *>(this->header + 1);
+        this->path = path;
+        this->modifiedTime = st.st_mtime;
+        return true;
+    }
+
+    void closeAssetPack()
+    {
+        if (this->mapping)
+        {
+            munmap(this->mapping, this->mappingSize);
+        }
+        *this = AssetPack();
+    }
+
+    // Checksums read every page once, it is a few hundred KB
+    static bool assetPackValid(const uint8_t *file, size_t size)
+    {
+        const AssetPackHeader *h = reinterpret_cast<const AssetPackHeader *>(file);
+        if (h->magic != ASSET_PACK_MAGIC || h->version != ASSET_PACK_VERSION || h->fileSize != size ||
+            sizeof(AssetPackHeader) + h->entryCount * sizeof(AssetPackEntry) > size)
+        {
+            return false;
+        }
+        const AssetPackEntry *entries = reinterpret_cast<const AssetPackEntry *>(h + 1);
+        for (int i = 0; i < h->entryCount; i++)
+        {
+            const AssetPackEntry &e = entries[i];
+            bool valid = e.name[ASSET_PACK_NAME_LENGTH - 1] == '\0' &&
+                         e.offset % ASSET_PACK_ALIGN == 0 &&
+                         e.offset <= size && e.size <= size - e.offset &&
+                         assetPackChecksum(file + e.offset, e.size) == e.checksum;
+            if (!valid)
+            {
+                std::cerr << "Asset pack entry " << i << " is broken" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const AssetPackEntry *findEntry(const char *name) const
+    {
+        for (int i = 0; this->header && i < this->header->entryCount; i++)
+        {
+            if (strcmp(this->entries[i].name, name) == 0)
+            {
+                return &this->entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const uint8_t *entryData(const AssetPackEntry *entry) const
+    {
+        return static_cast<const uint8_t *>(this->mapping) + entry->offset;
+    }
+
+    // Zero-copy view, like the xxd blobs used to be
+    MeshData meshFromPack(const char *name) const
+    {
+        const AssetPackEntry *entry = this->findEntry(name);
+        if (!entry || entry->type != ASSET_PACK_MESH)
+        {
+            std::cerr << "No mesh called " << name << " in the asset pack" << std::endl;
+            exit(1);
+        }
+        return loadMeshFromBlob(this->entryData(entry), entry->size);
+    }
+
+    // Call every frame. When the file on disk changed and the new one is
+    // valid it replaces this one and true is returned, so the caller can
+    // take the meshes again. Views from before the swap are gone then.
+    bool pollAssetPack(float deltaTime)
+    {
+        this->pollAccumulator += deltaTime;
+        if (!this->header || this->pollAccumulator < 1.0f)
+        {
+            return false;
+        }
+        this->pollAccumulator = 0.0f;
+
+        struct stat st;
+        if (stat(this->path.c_str(), &st) != 0 || st.st_mtime == this->modifiedTime)
+        {
+            return false;
+        }
+
+        AssetPack next;
+        if (!next.openAssetPack(this->path.c_str()))
+        {
+            return false; // Maybe still being copied, again next poll
+        }
+        this->closeAssetPack();
+        *this = next;
+        std::cerr << "Asset pack reloaded: " << this->path << std::endl;
+        return true;
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * One file with all the assets, written by `assman pack`, mmapped by the game.
+ *
+ * [AssetPackHeader]
+ * [AssetPackEntry * entryCount]           table of contents, right after the header
+ * [blob, padded to ASSET_PACK_ALIGN] ...  in TOC order
+ *
+ * Blobs start aligned so whatever they hold (PackedVertex, floats, uint32
+ * indices) can be pointed at in place. Each blob has its own checksum so a
+ * half written pack is noticed, not drawn.
+ */
+#define ASSET_PACK_MAGIC 0x4B434150 // "PACK"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_ALIGN 16
+#define ASSET_PACK_NAME_LENGTH 32
+
+enum AssetPackType : uint32_t
+{
+    ASSET_PACK_RAW = 0,
+    ASSET_PACK_MESH = 1, // What loadMeshFromBlob reads
+    ASSET_PACK_KTX = 2,  // What `assman texture` writes
+};
+
+struct AssetPackHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entryCount;
+    uint64_t fileSize; // Shorter file means it is still being written
+};
+static_assert(sizeof(AssetPackHeader) == 16, "AssetPackHeader is written to files as is");
+
+struct AssetPackEntry
+{
+    char name[ASSET_PACK_NAME_LENGTH]; // Zero terminated, file name without the extension
+    uint32_t type;
+    uint32_t formatVersion; // e.g. PACKED_MESH_VERSION of the blob, 0 when it has none
+    uint64_t offset;        // From the start of the file, ASSET_PACK_ALIGN aligned
+    uint64_t size;
+    uint32_t checksum; // assetPackChecksum of the blob
+    uint32_t reserved;
+};
+static_assert(sizeof(AssetPackEntry) == 64, "AssetPackEntry is written to files as is");
+
+// FNV-1a, same as the shader cache, plenty to spot a broken write
+inline uint32_t assetPackChecksum(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+inline size_t assetPackAlign(size_t offset)
+{
+    return (offset + ASSET_PACK_ALIGN - 1) & ~(size_t)(ASSET_PACK_ALIGN - 1);
+}
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
 
 struct Vertex
 {
@@ -29,11 +32,69 @@ struct Vertex
 };
 
 
+/*
+ * What actually goes to the GPU, 20 bytes instead of 80:
+ * position is snorm16 inside the mesh bounds (posScale/posOffset),
+ * normal is octahedral snorm16, colour unorm8, UVs half floats.
+ */
+struct PackedVertex
+{
+    int16_t position[4]; // w is padding
+    int16_t normal[2];
+    uint8_t color[4];
+    uint16_t texCoords[2];
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must stay 20 bytes");
+
+// Separate stream, only in meshes that have bones
+struct PackedSkin
+{
+    uint8_t bones[4];   // PACKED_NO_BONE when unused
+    uint8_t weights[4]; // unorm8
+};
+static_assert(sizeof(PackedSkin) == 8, "PackedSkin must stay 8 bytes");
+
+#define PACKED_NO_BONE 255
+
+// One level of detail, a range of the shared index buffer
+#define MESH_MAX_LODS 4
+struct MeshLod
+{
+    uint32_t indexOffset; // in indices, not bytes
+    uint32_t indexCount;
+    float error;          // How far (object space) any vertex is off the full mesh
+};
+static_assert(sizeof(MeshLod) == 12, "MeshLod is written to blobs as is");
+
+// Object space bounds
+struct MeshBounds
+{
+    float aabbMin[3];
+    float aabbMax[3];
+    float sphereCentre[3];
+    float sphereRadius;
+};
+static_assert(sizeof(MeshBounds) == 40, "MeshBounds is written to blobs as is");
+
 struct MeshData {
     uint32_t vertexCount;
     uint32_t indexCount;
-    Vertex*   vertices;
-    uint32_t* indices;
+    Vertex*   vertices;  // Legacy blobs only, nullptr when packed
+    uint32_t* indices;   // nullptr when indices16 is set
+    const uint16_t* indices16 = nullptr; // Packed blobs with few enough vertices
+
+    // Packed blobs only
+    const PackedVertex* packedVertices = nullptr;
+    const PackedSkin* packedSkin = nullptr; // nullptr when there are no bones
+    float posScale[3] = {1.0f, 1.0f, 1.0f};
+    float posOffset[3] = {0.0f, 0.0f, 0.0f};
+
+    // Filled by loadMeshFromBlob, [0] is the full mesh
+    uint32_t lodCount = 0;
+    MeshLod lods[MESH_MAX_LODS];
+
+    // Filled by loadMeshFromBlob
+    MeshBounds bounds = {};
 };
 
 
@@ -42,8 +103,326 @@ struct MeshDataHeader {
     uint32_t vertexCount;
     uint32_t indexCount;
 };
+
+// [header]
+// [uint32_t lodCount][MeshLod * lodCount] if it has LODs
+// [MeshBounds] if it has bounds
+// [PackedVertex * vertexCount]
+// [PackedSkin * vertexCount] if skinned
+// [uint16_t or uint32_t * indexCount], indexCount covers all LODs
+#define PACKED_MESH_MAGIC 0x4853454D // "MESH", never a sane legacy vertex count
+#define PACKED_MESH_VERSION 4
+#define PACKED_MESH_SKINNED 0x1
+#define PACKED_MESH_INDEX16 0x2 // Since version 2
+#define PACKED_MESH_LODS 0x4    // Since version 3
+#define PACKED_MESH_BOUNDS 0x8  // Since version 4
+struct PackedMeshHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    float posScale[3];
+    float posOffset[3];
+};
 #pragma pack(pop)
 
+inline uint16_t floatToHalf(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = x & 0x7fffff;
+
+    if (exponent <= 0)
+        return (uint16_t)sign; // Too small, flush to zero
+    if (exponent >= 31)
+        return (uint16_t)(sign | 0x7c00); // Too big (or NaN), infinity
+
+    // Round to nearest
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+        half++;
+    return (uint16_t)half;
+}
+
+inline int16_t floatToSnorm16(float f)
+{
+    f = f < -1.0f ? -1.0f : (f > 1.0f ? 1.0f : f);
+    return (int16_t)std::lround(f * 32767.0f);
+}
+
+inline void octEncodeNormal(float x, float y, float z, int16_t out[2])
+{
+    float l1 = std::fabs(x) + std::fabs(y) + std::fabs(z);
+    if (l1 == 0.0f)
+    {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+    float u = x / l1;
+    float v = y / l1;
+    if (z < 0.0f)
+    {
+        // Fold the lower half over the diagonals
+        float fu = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float fv = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+    out[0] = floatToSnorm16(u);
+    out[1] = floatToSnorm16(v);
+}
+
+/*
+ * Legacy vertices into the GPU layout. Returns true when any vertex
+ * has a bone, only then `skin` is filled.
+ */
+inline bool packMeshVertices(
+    const Vertex *vertices,
+    uint32_t vertexCount,
+    std::vector<PackedVertex> &packed,
+    std::vector<PackedSkin> &skin,
+    float posScale[3],
+    float posOffset[3])
+{
+    float lo[3] = {0.0f, 0.0f, 0.0f};
+    float hi[3] = {0.0f, 0.0f, 0.0f};
+    bool hasSkin = false;
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const float p[3] = {vertices[i].position.x, vertices[i].position.y, vertices[i].position.z};
+        for (int c = 0; c < 3; c++)
+        {
+            lo[c] = (i == 0 || p[c] < lo[c]) ? p[c] : lo[c];
+            hi[c] = (i == 0 || p[c] > hi[c]) ? p[c] : hi[c];
+        }
+        hasSkin |= vertices[i].bones[0] != -1;
+    }
+    for (int c = 0; c < 3; c++)
+    {
+        posOffset[c] = 0.5f * (lo[c] + hi[c]);
+        posScale[c] = 0.5f * (hi[c] - lo[c]);
+        if (posScale[c] <= 0.0f)
+            posScale[c] = 1.0f; // Flat axis, anything works
+    }
+
+    packed.resize(vertexCount);
+    skin.resize(hasSkin ? vertexCount : 0);
+    for (uint32_t i = 0; i < vertexCount; i++)
+    {
+        const Vertex &v = vertices[i];
+        PackedVertex &pv = packed[i];
+        const float p[3] = {v.position.x, v.position.y, v.position.z};
+        for (int c = 0; c < 3; c++)
+            pv.position[c] = floatToSnorm16((p[c] - posOffset[c]) / posScale[c]);
+        pv.position[3] = 0;
+
+        octEncodeNormal(v.normal.x, v.normal.y, v.normal.z, pv.normal);
+
+        const float col[4] = {v.color.r, v.color.g, v.color.b, v.color.a};
+        for (int c = 0; c < 4; c++)
+        {
+            float f = col[c] < 0.0f ? 0.0f : (col[c] > 1.0f ? 1.0f : col[c]);
+            pv.color[c] = (uint8_t)std::lround(f * 255.0f);
+        }
+
+        pv.texCoords[0] = floatToHalf(v.texCoords.u);
+        pv.texCoords[1] = floatToHalf(v.texCoords.v);
+
+        if (hasSkin)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                skin[i].bones[j] = v.bones[j] < 0 ? PACKED_NO_BONE : (uint8_t)v.bones[j];
+                float w = v.weights[j] < 0.0f ? 0.0f : (v.weights[j] > 1.0f ? 1.0f : v.weights[j]);
+                skin[i].weights[j] = (uint8_t)std::lround(w * 255.0f);
+            }
+        }
+    }
+    return hasSkin;
+}
+
+/*
+ * AABB, and a bounding sphere by Ritter's method (two passes, usually
+ * within a few percent of the smallest one). Takes xyz at `stride` bytes.
+ */
+inline MeshBounds computeMeshBounds(const float *xyz, size_t stride, uint32_t count)
+{
+    MeshBounds b = {};
+    if (count == 0)
+        return b;
+
+    auto at = [&](uint32_t i) {
+        return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(xyz) + i * stride);
+    };
+    auto dist2 = [](const float *a, const float *c) {
+        float d[3] = {a[0] - c[0], a[1] - c[1], a[2] - c[2]};
+        return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    };
+
+    for (int c = 0; c < 3; c++)
+        b.aabbMin[c] = b.aabbMax[c] = at(0)[c];
+    for (uint32_t i = 1; i < count; i++)
+        for (int c = 0; c < 3; c++)
+        {
+            b.aabbMin[c] = std::fmin(b.aabbMin[c], at(i)[c]);
+            b.aabbMax[c] = std::fmax(b.aabbMax[c], at(i)[c]);
+        }
+
+    // Farthest point from any point, then farthest from that one
+    uint32_t x = 0, y = 0;
+    for (uint32_t i = 0; i < count; i++)
+        if (dist2(at(i), at(0)) > dist2(at(x), at(0)))
+            x = i;
+    for (uint32_t i = 0; i < count; i++)
+        if (dist2(at(i), at(x)) > dist2(at(y), at(x)))
+            y = i;
+
+    for (int c = 0; c < 3; c++)
+        b.sphereCentre[c] = 0.5f * (at(x)[c] + at(y)[c]);
+    b.sphereRadius = 0.5f * std::sqrt(dist2(at(x), at(y)));
+
+    // Grow to take in whatever is still outside
+    for (uint32_t i = 0; i < count; i++)
+    {
+        float d2 = dist2(at(i), b.sphereCentre);
+        if (d2 > b.sphereRadius * b.sphereRadius)
+        {
+            float d = std::sqrt(d2);
+            float grown = 0.5f * (b.sphereRadius + d);
+            float shift = grown - b.sphereRadius;
+            for (int c = 0; c < 3; c++)
+                b.sphereCentre[c] += (at(i)[c] - b.sphereCentre[c]) * shift / d;
+            b.sphereRadius = grown;
+        }
+    }
+
+    // Sphere around the box can still win for boxy meshes (the lane)
+    float boxCentre[3], boxRadius2 = 0.0f;
+    for (int c = 0; c < 3; c++)
+    {
+        boxCentre[c] = 0.5f * (b.aabbMin[c] + b.aabbMax[c]);
+        float h = 0.5f * (b.aabbMax[c] - b.aabbMin[c]);
+        boxRadius2 += h * h;
+    }
+    if (boxRadius2 < b.sphereRadius * b.sphereRadius)
+    {
+        for (int c = 0; c < 3; c++)
+            b.sphereCentre[c] = boxCentre[c];
+        b.sphereRadius = std::sqrt(boxRadius2);
+    }
+    return b;
+}
+
+// Object space position of one vertex, whatever the blob format (e.g. for physics)
+inline void meshVertexPosition(const MeshData &md, uint32_t i, float out[3])
+{
+    if (md.packedVertices)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            float f = md.packedVertices[i].position[c] / 32767.0f;
+            out[c] = (f < -1.0f ? -1.0f : f) * md.posScale[c] + md.posOffset[c];
+        }
+        return;
+    }
+    out[0] = md.vertices[i].position.x;
+    out[1] = md.vertices[i].position.y;
+    out[2] = md.vertices[i].position.z;
+}
+
+// Flat xyz floats and 32-bit indices, whatever the blob format (e.g. for physics)
+inline std::vector<float> meshPositions(const MeshData &md)
+{
+    std::vector<float> out(md.vertexCount * 3);
+    for (uint32_t i = 0; i < md.vertexCount; i++)
+        meshVertexPosition(md, i, &out[i * 3]);
+    return out;
+}
+
+inline std::vector<uint32_t> meshIndices(const MeshData &md)
+{
+    // Only the full mesh, not the LODs
+    uint32_t first = md.lodCount > 0 ? md.lods[0].indexOffset : 0;
+    uint32_t count = md.lodCount > 0 ? md.lods[0].indexCount : md.indexCount;
+    if (md.indices16)
+        return std::vector<uint32_t>(md.indices16 + first, md.indices16 + first + count);
+    return std::vector<uint32_t>(md.indices + first, md.indices + first + count);
+}
+
+inline MeshData loadPackedMeshFromBlob(const uint8_t* blob, size_t blobLen)
+{
+    const PackedMeshHeader* header = reinterpret_cast<const PackedMeshHeader*>(blob);
+    if (header->version < 1 || header->version > PACKED_MESH_VERSION) {
+        std::cerr << "Packed mesh version " << header->version
+                  << " but expected " << PACKED_MESH_VERSION << std::endl;
+        exit(1);
+    }
+
+    bool skinned = header->flags & PACKED_MESH_SKINNED;
+    size_t vertexBytes = sizeof(PackedVertex) * header->vertexCount;
+    size_t skinBytes   = skinned ? sizeof(PackedSkin) * header->vertexCount : 0;
+    bool index16 = header->flags & PACKED_MESH_INDEX16;
+    size_t indexBytes  = (index16 ? sizeof(uint16_t) : sizeof(uint32_t)) * header->indexCount;
+
+    if (blobLen < sizeof(PackedMeshHeader) + vertexBytes + skinBytes + indexBytes)
+        throw std::runtime_error("Blob does not contain enough data.");
+
+    const uint8_t* cursor = blob + sizeof(PackedMeshHeader);
+
+    MeshData md;
+    if (header->flags & PACKED_MESH_LODS) {
+        uint32_t lodCount;
+        memcpy(&lodCount, cursor, sizeof(lodCount));
+        if (lodCount < 1 || lodCount > MESH_MAX_LODS) {
+            std::cerr << "Packed mesh has " << lodCount << " LODs" << std::endl;
+            exit(1);
+        }
+        if (blobLen < sizeof(PackedMeshHeader) + sizeof(uint32_t) + lodCount * sizeof(MeshLod) + vertexBytes + skinBytes + indexBytes)
+            throw std::runtime_error("Blob does not contain enough data.");
+        md.lodCount = lodCount;
+        memcpy(md.lods, cursor + sizeof(uint32_t), lodCount * sizeof(MeshLod));
+        cursor += sizeof(uint32_t) + lodCount * sizeof(MeshLod);
+    } else {
+        md.lodCount = 1;
+        md.lods[0] = {0, header->indexCount, 0.0f};
+    }
+    if (header->flags & PACKED_MESH_BOUNDS) {
+        if (blobLen < (size_t)(cursor - blob) + sizeof(MeshBounds) + vertexBytes + skinBytes + indexBytes)
+            throw std::runtime_error("Blob does not contain enough data.");
+        memcpy(&md.bounds, cursor, sizeof(MeshBounds));
+        cursor += sizeof(MeshBounds);
+    }
+    md.vertexCount    = header->vertexCount;
+    md.indexCount     = header->indexCount;
+    md.vertices       = nullptr;
+    md.packedVertices = reinterpret_cast<const PackedVertex*>(cursor);
+    cursor += vertexBytes;
+    md.packedSkin     = skinned ? reinterpret_cast<const PackedSkin*>(cursor) : nullptr;
+    cursor += skinBytes;
+    md.indices        = index16 ? nullptr : reinterpret_cast<uint32_t*>(const_cast<uint8_t*>(cursor));
+    md.indices16      = index16 ? reinterpret_cast<const uint16_t*>(cursor) : nullptr;
+    for (int c = 0; c < 3; c++) {
+        md.posScale[c]  = header->posScale[c];
+        md.posOffset[c] = header->posOffset[c];
+    }
+    if (!(header->flags & PACKED_MESH_BOUNDS)) {
+        // Older blob, the quantisation box is the AABB
+        float r2 = 0.0f;
+        for (int c = 0; c < 3; c++) {
+            md.bounds.aabbMin[c] = md.posOffset[c] - md.posScale[c];
+            md.bounds.aabbMax[c] = md.posOffset[c] + md.posScale[c];
+            md.bounds.sphereCentre[c] = md.posOffset[c];
+            r2 += md.posScale[c] * md.posScale[c];
+        }
+        md.bounds.sphereRadius = std::sqrt(r2);
+    }
+    return md;
+}
+
 
 inline MeshData loadMeshFromBlob(const uint8_t* blob, size_t blobLen)
 {
@@ -52,6 +431,10 @@ inline MeshData loadMeshFromBlob(const uint8_t* blob, size_t blobLen)
         exit(1);
     }
 
+    if (blobLen >= sizeof(PackedMeshHeader) &&
+        reinterpret_cast<const PackedMeshHeader*>(blob)->magic == PACKED_MESH_MAGIC)
+        return loadPackedMeshFromBlob(blob, blobLen);
+
     const MeshDataHeader* header = reinterpret_cast<const MeshDataHeader*>(blob);
 
     size_t vertexBytes = sizeof(Vertex) * header->vertexCount;
@@ -78,6 +461,9 @@ inline MeshData loadMeshFromBlob(const uint8_t* blob, size_t blobLen)
     md.indexCount  = header->indexCount;
     md.vertices    = vertices;
     md.indices     = indices;
+    md.lodCount    = 1;
+    md.lods[0]     = {0, header->indexCount, 0.0f};
+    md.bounds      = computeMeshBounds(&vertices[0].position.x, sizeof(Vertex), md.vertexCount);
 
     return md;
 }
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+
+// Precomputed outcome of a throw for a grid of
+// release position (x) × launch speed × spin.
+//
+//[header][cells: countX * countSpeed * countSpin][ranked cell indices]
+
+#define STRIKE_TABLE_MAGIC 0x4C425453u // "STBL"
+#define STRIKE_TABLE_VERSION 1u
+
+#pragma pack(push, 1)
+struct StrikeTableHeader {
+    uint32_t magic;
+    uint32_t version;
+
+    uint32_t countX;
+    uint32_t countSpeed;
+    uint32_t countSpin;
+    uint32_t samplesPerCell;
+
+    float minX, maxX;         // metres from the lane centre
+    float minSpeed, maxSpeed; // metres per second along the lane
+    float minSpin, maxSpin;   // same units as Physics::set_spin_speed
+
+    uint32_t cellsOffset;  // bytes from the start of the file
+    uint32_t rankedOffset; // bytes from the start of the file
+    uint32_t rankedCount;
+};
+
+struct StrikeCell {
+    uint8_t histogram[11]; // P(n pins down) * 255, n = 0..10
+    uint8_t expectedPins;  // E[pins down] * 25
+    uint8_t strikeChance;  // P(10 pins) * 255, same as histogram[10]
+    uint8_t _pad[3];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(StrikeCell) == 16, "StrikeCell must stay 16 bytes");
+
+inline uint32_t strikeTableCellCount(const StrikeTableHeader *h)
+{
+    return h->countX * h->countSpeed * h->countSpin;
+}
+
+// Nearest cell for a throw, clamped to the grid. O(1).
+inline uint32_t strikeTableCellIndex(const StrikeTableHeader *h, float x, float speed, float spin)
+{
+    auto axis = [](float v, float lo, float hi, uint32_t count) -> uint32_t {
+        if (count < 2 || hi <= lo)
+            return 0;
+        float t = (v - lo) / (hi - lo) * float(count - 1) + 0.5f;
+        if (t < 0.0f)
+            return 0;
+        uint32_t i = uint32_t(t);
+        return i >= count ? count - 1 : i;
+    };
+
+    uint32_t ix = axis(x, h->minX, h->maxX, h->countX);
+    uint32_t iv = axis(speed, h->minSpeed, h->maxSpeed, h->countSpeed);
+    uint32_t is = axis(spin, h->minSpin, h->maxSpin, h->countSpin);
+    return (ix * h->countSpeed + iv) * h->countSpin + is;
+}
+
+// Throw parameters at the centre of a cell
+inline void strikeTableCellParams(const StrikeTableHeader *h, uint32_t index, float *x, float *speed, float *spin)
+{
+    uint32_t is = index % h->countSpin;
+    uint32_t iv = (index / h->countSpin) % h->countSpeed;
+    uint32_t ix = index / (h->countSpin * h->countSpeed);
+
+    auto at = [](uint32_t i, float lo, float hi, uint32_t count) -> float {
+        return count < 2 ? lo : lo + (hi - lo) * float(i) / float(count - 1);
+    };
+
+    *x = at(ix, h->minX, h->maxX, h->countX);
+    *speed = at(iv, h->minSpeed, h->maxSpeed, h->countSpeed);
+    *spin = at(is, h->minSpin, h->maxSpin, h->countSpin);
+}
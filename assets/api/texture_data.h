@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Compressed textures are KTX 1.1 files (the Khronos container), written by
+ * `assman texture`: the header below, then for every mip level, largest
+ * first, a uint32 byte size and the compressed blocks. No key/value data,
+ * one face, little endian, rows top first like stb gives them.
+ */
+static const uint8_t KTX_IDENTIFIER[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+#define KTX_ENDIANNESS 0x04030201u
+
+// Same values as the GL enums, assman does not include GL
+#define KTX_COMPRESSED_RGB8_ETC2 0x9274u
+#define KTX_COMPRESSED_RGBA8_ETC2_EAC 0x9278u
+#define KTX_BASE_RGB 0x1907u
+#define KTX_BASE_RGBA 0x1908u
+
+struct KtxHeader
+{
+    uint8_t identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+static_assert(sizeof(KtxHeader) == 64, "KtxHeader is written to files as is");
+
+// ETC2 works in 4x4 blocks, 8 bytes for RGB, 16 with the EAC alpha block
+inline uint32_t ktxBlockBytes(uint32_t internalFormat)
+{
+    return internalFormat == KTX_COMPRESSED_RGBA8_ETC2_EAC ? 16 : 8;
+}
+
+inline uint32_t ktxLevelSize(uint32_t internalFormat, uint32_t width, uint32_t height)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * ktxBlockBytes(internalFormat);
+}
+
+inline bool ktxHeaderValid(const KtxHeader &h)
+{
+    return memcmp(h.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0 &&
+           h.endianness == KTX_ENDIANNESS &&
+           (h.glInternalFormat == KTX_COMPRESSED_RGB8_ETC2 ||
+            h.glInternalFormat == KTX_COMPRESSED_RGBA8_ETC2_EAC) &&
+           h.pixelWidth > 0 && h.pixelHeight > 0 && h.pixelDepth == 0 &&
+           h.numberOfFaces == 1 && h.numberOfMipmapLevels > 0;
+}
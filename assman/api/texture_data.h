@@ -0,0 +1,4 @@
+#pragma once
+
+// Same format as the game reads, keep one copy of it
+#include "../../assets/api/texture_data.h"
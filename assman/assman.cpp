@@ -1,4 +1,5 @@
 #include <iostream>
+#include <random>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -6,7 +7,10 @@
 
 #include "api/mesh_data.h"
 
+#include "mesh_optimize.cpp"
 #include "cmd_mesh.cpp"
+#include "cmd_texture.cpp"
+#include "cmd_pack.cpp"
 
 struct CmdArgs {
     std::vector<std::string> positionals;
@@ -61,13 +65,72 @@ int handle_mesh(const CmdArgs& args)
     }
     const std::string output = it->second;
 
+    // legacy: float Vertex as is, packed: PackedVertex
+    auto formatIt = args.options.find("-f");
+    const std::string format = formatIt == args.options.end() ? "legacy" : formatIt->second;
+    if (format != "legacy" && format != "packed") {
+        std::cerr << "mesh: -f must be legacy or packed\n";
+        return 1;
+    }
 
     std::cout << "→ mesh command\n";
     std::cout << "   input:  " << input << "\n";
     std::cout << "   mesh:   " << meshName << "\n";
     std::cout << "   output: " << output << "\n";
+    std::cout << "   format: " << format << "\n";
 
-    cmd_mesh(input, meshName, output);
+    cmd_mesh(input, meshName, output, format == "packed");
+
+    return 0;
+}
+
+
+int handle_texture(const CmdArgs& args)
+{
+    if (args.positionals.size() < 1) {
+        std::cerr << "texture: requires <input_image>\n";
+        return 1;
+    }
+
+    const std::string input = args.positionals[0];
+
+    auto outIt = args.options.find("-o");
+    if (outIt == args.options.end()) {
+        std::cerr << "texture: missing -o <output>\n";
+        return 1;
+    }
+
+    // Mip levels to keep, 0 is all the way down
+    auto mipsIt = args.options.find("-m");
+    const int mips = mipsIt == args.options.end() ? 0 : std::stoi(mipsIt->second);
+
+    std::cout << "→ texture command\n";
+    std::cout << "   input:  " << input << "\n";
+    std::cout << "   output: " << outIt->second << "\n";
+
+    cmd_texture(input, outIt->second, mips);
+
+    return 0;
+}
+
+
+int handle_pack(const CmdArgs& args)
+{
+    if (args.positionals.size() < 1) {
+        std::cerr << "pack: requires <input>...\n";
+        return 1;
+    }
+
+    auto outIt = args.options.find("-o");
+    if (outIt == args.options.end()) {
+        std::cerr << "pack: missing -o <output>\n";
+        return 1;
+    }
+
+    std::cout << "→ pack command\n";
+    std::cout << "   output: " << outIt->second << "\n";
+
+    cmd_pack(args.positionals, outIt->second);
 
     return 0;
 }
@@ -137,6 +200,71 @@ int handle_animation(const CmdArgs& args)
 
 
 
+// ---------------------------------------------
+// Check of the mesh reordering on a fixed mesh
+// ---------------------------------------------
+// UV sphere with its triangles shuffled, like an exporter that does not care.
+// The passes `mesh` runs must bring the cache misses per triangle (ACMR,
+// FIFO cache of 16) below 1 and keep every triangle.
+int handle_meshcheck(const CmdArgs& args)
+{
+    auto ringsIt = args.options.find("-r");
+    auto seedIt = args.options.find("-s");
+    int rings = ringsIt == args.options.end() ? 32 : std::stoi(ringsIt->second);
+    unsigned seed = seedIt == args.options.end() ? 1 : (unsigned)std::stoul(seedIt->second);
+    int segments = rings * 2;
+
+    std::vector<Vertex> vertices;
+    for (int r = 0; r <= rings; r++) {
+        float theta = 3.14159265f * r / rings;
+        for (int s = 0; s <= segments; s++) {
+            float phi = 2.0f * 3.14159265f * s / segments;
+            Vertex v = {};
+            v.position.x = std::sin(theta) * std::cos(phi);
+            v.position.y = std::cos(theta);
+            v.position.z = std::sin(theta) * std::sin(phi);
+            vertices.push_back(v);
+        }
+    }
+    std::vector<uint32_t> triangles;
+    for (int r = 0; r < rings; r++) {
+        for (int s = 0; s < segments; s++) {
+            uint32_t a = r * (segments + 1) + s;
+            uint32_t b = a + segments + 1;
+            triangles.insert(triangles.end(), {a, b, a + 1});
+            triangles.insert(triangles.end(), {a + 1, b, b + 1});
+        }
+    }
+
+    std::vector<uint32_t> order(triangles.size() / 3);
+    for (size_t t = 0; t < order.size(); t++)
+        order[t] = (uint32_t)t;
+    std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+    std::vector<uint32_t> indices;
+    for (uint32_t t : order)
+        indices.insert(indices.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+
+    uint32_t vertexCount = (uint32_t)vertices.size();
+    float shuffled = meshCacheMissRatio(indices, vertexCount);
+    optimizeVertexCache(indices, vertexCount);
+    float cacheOrdered = meshCacheMissRatio(indices, vertexCount);
+    optimizeOverdraw(indices, vertices);
+    float patchSorted = meshCacheMissRatio(indices, vertexCount);
+    optimizeVertexFetch(indices, vertices);
+
+    std::cout << "→ meshcheck: sphere of " << order.size() << " triangles, seed " << seed << "\n";
+    std::cout << "   ACMR shuffled:         " << shuffled << "\n";
+    std::cout << "   ACMR vertex cache:     " << cacheOrdered << "\n";
+    std::cout << "   ACMR overdraw patches: " << patchSorted << "\n";
+
+    bool ok = indices.size() == triangles.size() && patchSorted < 1.0f && patchSorted < shuffled;
+    for (uint32_t i : indices)
+        ok = ok && i < vertices.size();
+    std::cout << (ok ? "   ok\n" : "   FAILED\n");
+    return ok ? 0 : 1;
+}
+
+
 // ------------------
 // Subcommand table
 // ------------------
@@ -151,6 +279,9 @@ int main(int argc, char** argv)
 
     static std::unordered_map<std::string, CommandHandler> table = {
         { "mesh",      handle_mesh },
+        { "texture",   handle_texture },
+        { "pack",      handle_pack },
+        { "meshcheck", handle_meshcheck },
         { "font",      handle_font },
         { "animation", handle_animation },
     };
@@ -228,19 +228,113 @@ void writeMeshDataToFile(const MeshData& md, const std::string& outPath)
               md.indexCount * sizeof(uint32_t));
 }
 
-int cmd_mesh(std::string inputPath, std::string meshName, std::string outPath)
+// Same MeshData, but in the GPU layout (see PackedVertex), about 4x smaller
+void writePackedMeshDataToFile(const MeshData& md, const std::string& outPath)
+{
+    std::ofstream out(outPath, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Could not open output file: " + outPath);
+
+    std::vector<PackedVertex> packed;
+    std::vector<PackedSkin> skin;
+    PackedMeshHeader header;
+    bool hasSkin = packMeshVertices(
+        md.vertices, md.vertexCount, packed, skin, header.posScale, header.posOffset);
+
+    header.magic = PACKED_MESH_MAGIC;
+    header.version = PACKED_MESH_VERSION;
+    bool index16 = md.vertexCount < 65536;
+    bool hasLods = md.lodCount > 1;
+    header.flags = (hasSkin ? PACKED_MESH_SKINNED : 0) |
+                   (index16 ? PACKED_MESH_INDEX16 : 0) |
+                   (hasLods ? PACKED_MESH_LODS : 0) |
+                   PACKED_MESH_BOUNDS;
+    header.vertexCount = md.vertexCount;
+    header.indexCount = md.indexCount;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (hasLods)
+    {
+        out.write(reinterpret_cast<const char*>(&md.lodCount), sizeof(md.lodCount));
+        out.write(reinterpret_cast<const char*>(md.lods), md.lodCount * sizeof(MeshLod));
+    }
+
+    MeshBounds bounds = computeMeshBounds(&md.vertices[0].position.x, sizeof(Vertex), md.vertexCount);
+    out.write(reinterpret_cast<const char*>(&bounds), sizeof(bounds));
+    std::cout << "   bounds: sphere r=" << bounds.sphereRadius << "\n";
+
+    out.write(reinterpret_cast<const char*>(packed.data()),
+              packed.size() * sizeof(PackedVertex));
+    if (hasSkin)
+        out.write(reinterpret_cast<const char*>(skin.data()),
+                  skin.size() * sizeof(PackedSkin));
+
+    if (index16)
+    {
+        std::vector<uint16_t> indices16(md.indices, md.indices + md.indexCount);
+        out.write(reinterpret_cast<const char*>(indices16.data()),
+                  indices16.size() * sizeof(uint16_t));
+    }
+    else
+    {
+        out.write(reinterpret_cast<const char*>(md.indices),
+                  md.indexCount * sizeof(uint32_t));
+    }
+
+    std::cout << "   packed: " << md.vertexCount * sizeof(Vertex) << " -> "
+              << packed.size() * sizeof(PackedVertex) + skin.size() * sizeof(PackedSkin)
+              << " vertex bytes" << (hasSkin ? " (skinned)" : "") << "\n";
+}
+
+int cmd_mesh(std::string inputPath, std::string meshName, std::string outPath, bool packed)
 {
     std::vector<Vertex> vertexAcc;
     std::vector<uint32_t> indexAcc;
 
     loadMeshDataFromAsset(vertexAcc, indexAcc, inputPath.c_str(), meshName.c_str(), 1);
 
+    float missesBefore = meshCacheMissRatio(indexAcc, static_cast<uint32_t>(vertexAcc.size()));
+    optimizeVertexCache(indexAcc, static_cast<uint32_t>(vertexAcc.size()));
+    optimizeOverdraw(indexAcc, vertexAcc);
+    std::cout << "   cache misses per triangle: " << missesBefore << " -> "
+              << meshCacheMissRatio(indexAcc, static_cast<uint32_t>(vertexAcc.size())) << "\n";
+
     MeshData md;
+
+    // LODs only fit in the packed format, all of them go in one index buffer
+    MeshLodChain chain;
+    if (packed)
+    {
+        chain = buildLodChain(indexAcc, vertexAcc);
+    }
+    else
+    {
+        chain.indices.push_back(indexAcc);
+        chain.errors.push_back(0.0f);
+    }
+    indexAcc.clear();
+    md.lodCount = static_cast<uint32_t>(chain.indices.size());
+    for (uint32_t i = 0; i < md.lodCount; i++)
+    {
+        md.lods[i].indexOffset = static_cast<uint32_t>(indexAcc.size());
+        md.lods[i].indexCount = static_cast<uint32_t>(chain.indices[i].size());
+        md.lods[i].error = chain.errors[i];
+        indexAcc.insert(indexAcc.end(), chain.indices[i].begin(), chain.indices[i].end());
+        std::cout << "   lod " << i << ": " << md.lods[i].indexCount / 3
+                  << " triangles, error " << md.lods[i].error << "\n";
+    }
+
+    // Full mesh comes first, so it decides the vertex order
+    optimizeVertexFetch(indexAcc, vertexAcc);
+
     md.vertexCount = static_cast<uint32_t>(vertexAcc.size());
     md.vertices = vertexAcc.data();
     md.indexCount  = static_cast<uint32_t>(indexAcc.size());
     md.indices = indexAcc.data();
-    writeMeshDataToFile(md, outPath); 
+    if (packed)
+        writePackedMeshDataToFile(md, outPath);
+    else
+        writeMeshDataToFile(md, outPath);
 
     return 0;
 }
@@ -0,0 +1,105 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "api/asset_pack.h"
+#include "api/mesh_data.h"
+#include "api/texture_data.h"
+
+static std::string packEntryName(const std::string &path)
+{
+    size_t slash = path.find_last_of("/\\");
+    std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static bool endsWith(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Written next to the output and renamed over it, so a game watching the
+// pack never maps a half written one
+void cmd_pack(const std::vector<std::string> &inputs, const std::string &outPath)
+{
+    if (inputs.size() > 0xffff)
+        throw std::runtime_error("Too many files for one pack");
+
+    std::vector<std::vector<uint8_t>> blobs;
+    std::vector<AssetPackEntry> entries;
+    for (const std::string &path : inputs)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            throw std::runtime_error("Could not open input file: " + path);
+        std::vector<uint8_t> blob((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        AssetPackEntry entry = {};
+        std::string name = packEntryName(path);
+        if (name.size() >= ASSET_PACK_NAME_LENGTH)
+            throw std::runtime_error("Name too long for a pack entry: " + name);
+        for (const AssetPackEntry &e : entries)
+        {
+            if (name == e.name)
+                throw std::runtime_error("Two files would be called " + name);
+        }
+        memcpy(entry.name, name.c_str(), name.size());
+
+        if (endsWith(path, ".mesh"))
+        {
+            entry.type = ASSET_PACK_MESH;
+            if (blob.size() >= sizeof(PackedMeshHeader) &&
+                reinterpret_cast<const PackedMeshHeader *>(blob.data())->magic == PACKED_MESH_MAGIC)
+                entry.formatVersion = reinterpret_cast<const PackedMeshHeader *>(blob.data())->version;
+        }
+        else if (endsWith(path, ".ktx"))
+        {
+            entry.type = ASSET_PACK_KTX;
+            entry.formatVersion = 1;
+        }
+        entry.size = blob.size();
+        entry.checksum = assetPackChecksum(blob.data(), blob.size());
+
+        entries.push_back(entry);
+        blobs.push_back(std::move(blob));
+    }
+
+    size_t offset = assetPackAlign(sizeof(AssetPackHeader) + entries.size() * sizeof(AssetPackEntry));
+    for (AssetPackEntry &entry : entries)
+    {
+        entry.offset = offset;
+        offset = assetPackAlign(offset + entry.size);
+    }
+
+    AssetPackHeader header = {};
+    header.magic = ASSET_PACK_MAGIC;
+    header.version = ASSET_PACK_VERSION;
+    header.entryCount = (uint16_t)entries.size();
+    header.fileSize = offset;
+
+    std::string tmpPath = outPath + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary);
+        if (!out)
+            throw std::runtime_error("Could not open output file: " + tmpPath);
+
+        std::vector<uint8_t> file(offset, 0);
+        memcpy(file.data(), &header, sizeof(header));
+        memcpy(file.data() + sizeof(header), entries.data(), entries.size() * sizeof(AssetPackEntry));
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            memcpy(file.data() + entries[i].offset, blobs[i].data(), blobs[i].size());
+            std::cout << "   " << entries[i].name << ": " << entries[i].size << " bytes at " << entries[i].offset << "\n";
+        }
+        out.write(reinterpret_cast<const char *>(file.data()), (std::streamsize)file.size());
+        if (!out)
+            throw std::runtime_error("Could not write: " + tmpPath);
+    }
+    if (std::rename(tmpPath.c_str(), outPath.c_str()) != 0)
+        throw std::runtime_error("Could not move " + tmpPath + " to " + outPath);
+}
@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "api/texture_data.h"
+
+/*
+ * Image in, KTX with ETC2 blocks and the whole mip chain out, so the game
+ * neither decodes PNG nor builds mips at startup.
+ *
+ * The colour encoder only uses the ETC1 compatible individual and
+ * differential modes (ETC2 T, H and planar modes are left out). It tries
+ * both block flips, both modes and all 8 tables per half block, which is
+ * plenty for flat coloured artwork.
+ */
+
+struct RgbaImage
+{
+    int width;
+    int height;
+    std::vector<uint8_t> pixels; // RGBA8, rows top first
+
+    const uint8_t *at(int x, int y) const
+    {
+        x = std::min(x, this->width - 1);
+        y = std::min(y, this->height - 1);
+        return &this->pixels[(y * this->width + x) * 4];
+    }
+};
+
+// 2x2 box filter, odd edges repeat the last row/column
+static RgbaImage downsample(const RgbaImage &src)
+{
+    RgbaImage dst;
+    dst.width = std::max(src.width / 2, 1);
+    dst.height = std::max(src.height / 2, 1);
+    dst.pixels.resize(dst.width * dst.height * 4);
+    for (int y = 0; y < dst.height; y++)
+    {
+        for (int x = 0; x < dst.width; x++)
+        {
+            const uint8_t *a = src.at(x * 2, y * 2);
+            const uint8_t *b = src.at(x * 2 + 1, y * 2);
+            const uint8_t *c = src.at(x * 2, y * 2 + 1);
+            const uint8_t *d = src.at(x * 2 + 1, y * 2 + 1);
+            for (int ch = 0; ch < 4; ch++)
+            {
+                dst.pixels[(y * dst.width + x) * 4 + ch] = (uint8_t)((a[ch] + b[ch] + c[ch] + d[ch] + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+static const int ETC1_MODIFIERS[8][2] = {
+    {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+
+static const int EAC_MODIFIERS[16][8] = {
+    {-3, -6, -9, -15, 2, 5, 8, 14},
+    {-3, -7, -10, -13, 2, 6, 9, 12},
+    {-2, -5, -8, -13, 1, 4, 7, 12},
+    {-2, -4, -6, -13, 1, 3, 5, 12},
+    {-3, -6, -8, -12, 2, 5, 7, 11},
+    {-3, -7, -9, -11, 2, 6, 8, 10},
+    {-4, -7, -8, -11, 3, 6, 7, 10},
+    {-3, -5, -8, -11, 2, 4, 7, 10},
+    {-2, -6, -8, -10, 1, 5, 7, 9},
+    {-2, -5, -8, -10, 1, 4, 7, 9},
+    {-2, -4, -8, -10, 1, 3, 7, 9},
+    {-2, -5, -7, -10, 1, 4, 6, 9},
+    {-3, -4, -7, -10, 2, 3, 6, 9},
+    {-1, -2, -3, -10, 0, 1, 2, 9},
+    {-4, -6, -8, -9, 3, 5, 7, 8},
+    {-3, -5, -7, -9, 2, 4, 6, 8},
+};
+
+static inline int clamp255(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// Pixel p of a block is x * 4 + y, that is how ETC numbers them
+struct HalfBlockFit
+{
+    int error;
+    int table;
+    uint8_t indices[16]; // Only the half block's pixels are filled in
+};
+
+// Best table and per pixel modifier for one half of the block around `base`
+static HalfBlockFit fitHalfBlock(const uint8_t block[16][4], const int *pixels, const int base[3])
+{
+    HalfBlockFit best;
+    best.error = INT_MAX;
+    for (int t = 0; t < 8; t++)
+    {
+        const int mods[4] = {ETC1_MODIFIERS[t][0], ETC1_MODIFIERS[t][1], -ETC1_MODIFIERS[t][0], -ETC1_MODIFIERS[t][1]};
+        HalfBlockFit fit;
+        fit.error = 0;
+        fit.table = t;
+        for (int i = 0; i < 8; i++)
+        {
+            const uint8_t *px = block[pixels[i]];
+            int bestPixelError = INT_MAX;
+            for (int m = 0; m < 4; m++)
+            {
+                int e = 0;
+                for (int ch = 0; ch < 3; ch++)
+                {
+                    int d = clamp255(base[ch] + mods[m]) - px[ch];
+                    e += d * d;
+                }
+                if (e < bestPixelError)
+                {
+                    bestPixelError = e;
+                    fit.indices[pixels[i]] = (uint8_t)m;
+                }
+            }
+            fit.error += bestPixelError;
+        }
+        if (fit.error < best.error)
+        {
+            best = fit;
+        }
+    }
+    return best;
+}
+
+static uint64_t encodeEtc1Block(const uint8_t block[16][4])
+{
+    // Pixels of the two halves: flip 0 is left|right, flip 1 is top/bottom
+    int halves[2][2][8];
+    for (int flip = 0; flip < 2; flip++)
+    {
+        int n[2] = {0, 0};
+        for (int p = 0; p < 16; p++)
+        {
+            int x = p / 4;
+            int y = p % 4;
+            int half = flip ? (y >= 2) : (x >= 2);
+            halves[flip][half][n[half]++] = p;
+        }
+    }
+
+    uint64_t bestBits = 0;
+    int bestError = INT_MAX;
+    for (int flip = 0; flip < 2; flip++)
+    {
+        float avg[2][3] = {};
+        for (int h = 0; h < 2; h++)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                for (int ch = 0; ch < 3; ch++)
+                {
+                    avg[h][ch] += block[halves[flip][h][i]][ch] / 8.0f;
+                }
+            }
+        }
+
+        for (int diff = 0; diff < 2; diff++)
+        {
+            int quant[2][3];
+            int base[2][3];
+            bool fits = true;
+            for (int h = 0; h < 2; h++)
+            {
+                for (int ch = 0; ch < 3; ch++)
+                {
+                    int levels = diff ? 31 : 15;
+                    int q = (int)(avg[h][ch] * (float)levels / 255.0f + 0.5f);
+                    quant[h][ch] = q;
+                    base[h][ch] = diff ? (q << 3) | (q >> 2) : (q << 4) | q;
+                }
+            }
+            if (diff)
+            {
+                for (int ch = 0; ch < 3; ch++)
+                {
+                    int d = quant[1][ch] - quant[0][ch];
+                    fits = fits && d >= -4 && d <= 3;
+                }
+            }
+            if (!fits)
+            {
+                continue;
+            }
+
+            HalfBlockFit fit0 = fitHalfBlock(block, halves[flip][0], base[0]);
+            HalfBlockFit fit1 = fitHalfBlock(block, halves[flip][1], base[1]);
+            int error = fit0.error + fit1.error;
+            if (error >= bestError)
+            {
+                continue;
+            }
+            bestError = error;
+
+            uint64_t bits = 0;
+            for (int ch = 0; ch < 3; ch++)
+            {
+                uint64_t byte = diff
+                                    ? (uint64_t)((quant[0][ch] << 3) | ((quant[1][ch] - quant[0][ch]) & 7))
+                                    : (uint64_t)((quant[0][ch] << 4) | quant[1][ch]);
+                bits |= byte << (56 - ch * 8);
+            }
+            bits |= (uint64_t)((fit0.table << 5) | (fit1.table << 2) | (diff << 1) | flip) << 32;
+            for (int h = 0; h < 2; h++)
+            {
+                const HalfBlockFit &fit = h ? fit1 : fit0;
+                for (int i = 0; i < 8; i++)
+                {
+                    int p = halves[flip][h][i];
+                    // Index 0..3 is +a, +b, -a, -b, stored as MSB plane then LSB plane
+                    uint64_t idx = fit.indices[p];
+                    bits |= ((idx >> 1) & 1) << (16 + p);
+                    bits |= (idx & 1) << p;
+                }
+            }
+            bestBits = bits;
+        }
+    }
+    return bestBits;
+}
+
+static uint64_t encodeEacAlphaBlock(const uint8_t block[16][4])
+{
+    int lo = 255;
+    int hi = 0;
+    for (int p = 0; p < 16; p++)
+    {
+        lo = std::min(lo, (int)block[p][3]);
+        hi = std::max(hi, (int)block[p][3]);
+    }
+
+    uint64_t bestBits = 0;
+    int bestError = INT_MAX;
+    for (int t = 0; t < 16 && bestError > 0; t++)
+    {
+        const int *mods = EAC_MODIFIERS[t];
+        int modLo = *std::min_element(mods, mods + 8);
+        int modHi = *std::max_element(mods, mods + 8);
+        int guess = (hi - lo) / (modHi - modLo);
+        for (int mul = std::max(guess - 1, 1); mul <= std::min(guess + 2, 15); mul++)
+        {
+            int base = clamp255((int)((float)(lo + hi) / 2.0f - (float)(mul * (modLo + modHi)) / 2.0f + 0.5f));
+            int error = 0;
+            uint64_t indexBits = 0;
+            for (int p = 0; p < 16; p++)
+            {
+                int bestIdx = 0;
+                int bestPixelError = INT_MAX;
+                for (int i = 0; i < 8; i++)
+                {
+                    int d = clamp255(base + mods[i] * mul) - block[p][3];
+                    if (d * d < bestPixelError)
+                    {
+                        bestPixelError = d * d;
+                        bestIdx = i;
+                    }
+                }
+                error += bestPixelError;
+                indexBits |= (uint64_t)bestIdx << (45 - p * 3);
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                bestBits = ((uint64_t)base << 56) | ((uint64_t)mul << 52) | ((uint64_t)t << 48) | indexBits;
+            }
+        }
+    }
+    return bestBits;
+}
+
+static void putBigEndian(std::vector<uint8_t> &out, uint64_t bits)
+{
+    for (int i = 7; i >= 0; i--)
+    {
+        out.push_back((uint8_t)(bits >> (i * 8)));
+    }
+}
+
+static std::vector<uint8_t> encodeEtc2Level(const RgbaImage &img, bool alpha)
+{
+    std::vector<uint8_t> out;
+    uint8_t block[16][4];
+    for (int by = 0; by < img.height; by += 4)
+    {
+        for (int bx = 0; bx < img.width; bx += 4)
+        {
+            for (int p = 0; p < 16; p++)
+            {
+                memcpy(block[p], img.at(bx + p / 4, by + p % 4), 4);
+            }
+            if (alpha)
+            {
+                putBigEndian(out, encodeEacAlphaBlock(block));
+            }
+            putBigEndian(out, encodeEtc1Block(block));
+        }
+    }
+    return out;
+}
+
+static void writeU32(std::ofstream &out, uint32_t v)
+{
+    out.write(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+// maxLevels 0 is the full chain, down to a single block
+void cmd_texture(const std::string &inPath, const std::string &outPath, int maxLevels)
+{
+    RgbaImage img;
+    int channels = 0;
+    unsigned char *data = stbi_load(inPath.c_str(), &img.width, &img.height, &channels, 4);
+    if (!data)
+        throw std::runtime_error("Could not load image: " + inPath + " (" + stbi_failure_reason() + ")");
+    img.pixels.assign(data, data + img.width * img.height * 4);
+    stbi_image_free(data);
+
+    // Only pay for the alpha block when something is see through
+    bool alpha = false;
+    for (size_t i = 3; i < img.pixels.size() && !alpha; i += 4)
+    {
+        alpha = img.pixels[i] != 255;
+    }
+    uint32_t format = alpha ? KTX_COMPRESSED_RGBA8_ETC2_EAC : KTX_COMPRESSED_RGB8_ETC2;
+
+    std::vector<RgbaImage> levels = {img};
+    while ((maxLevels == 0 || (int)levels.size() < maxLevels) &&
+           (levels.back().width > 4 || levels.back().height > 4))
+    {
+        levels.push_back(downsample(levels.back()));
+    }
+
+    std::ofstream out(outPath, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Could not open output file: " + outPath);
+
+    KtxHeader header = {};
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.endianness = KTX_ENDIANNESS;
+    header.glTypeSize = 1;
+    header.glInternalFormat = format;
+    header.glBaseInternalFormat = alpha ? KTX_BASE_RGBA : KTX_BASE_RGB;
+    header.pixelWidth = (uint32_t)img.width;
+    header.pixelHeight = (uint32_t)img.height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = (uint32_t)levels.size();
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    size_t total = 0;
+    for (const RgbaImage &level : levels)
+    {
+        std::vector<uint8_t> blocks = encodeEtc2Level(level, alpha);
+        // Blocks are 8 or 16 bytes, always 4 byte aligned as KTX wants
+        writeU32(out, (uint32_t)blocks.size());
+        out.write(reinterpret_cast<const char *>(blocks.data()), (std::streamsize)blocks.size());
+        total += blocks.size();
+    }
+
+    std::cout << "   " << (alpha ? "RGBA8 ETC2 EAC" : "RGB8 ETC2") << ", "
+              << img.width << "x" << img.height << ", " << levels.size() << " levels, "
+              << total << " bytes (RGBA8 with mips would be ~"
+              << (size_t)img.width * img.height * 4 * 4 / 3 << ")\n";
+}
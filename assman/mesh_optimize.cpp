@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "api/mesh_data.h"
+
+// Offline triangle and vertex reordering, so the GPU does less work per draw:
+//  1. vertex cache order (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation")
+//  2. overdraw: cut that order into patches and draw outward facing ones first
+//  3. fetch: renumber vertices in the order they are first used
+
+static const int CACHE_SIZE = 32;
+
+static float forsythVertexScore(int cachePosition, int remainingTriangles)
+{
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+        {
+            // Just used by the last triangle, don't favour it too much
+            score = 0.75f;
+        }
+        else
+        {
+            float s = 1.0f - (float)(cachePosition - 3) / (float)(CACHE_SIZE - 3);
+            score = std::pow(s, 1.5f);
+        }
+    }
+    // Finish off vertices with few triangles left, so they leave the cache for good
+    score += 2.0f * std::pow((float)remainingTriangles, -0.5f);
+    return score;
+}
+
+// Average cache miss ratio (misses per triangle) with a FIFO cache, for reporting
+float meshCacheMissRatio(const std::vector<uint32_t> &indices, uint32_t vertexCount, int cacheSize = 16)
+{
+    if (indices.empty())
+        return 0.0f;
+    std::vector<int64_t> insertedAt(vertexCount, -1000000);
+    int64_t clock = 0;
+    size_t misses = 0;
+    for (uint32_t v : indices)
+    {
+        if (clock - insertedAt[v] >= cacheSize)
+        {
+            insertedAt[v] = clock++;
+            misses++;
+        }
+    }
+    return (float)misses / (float)(indices.size() / 3);
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles of each vertex, flattened
+    std::vector<uint32_t> triangleStart(vertexCount + 1, 0);
+    for (uint32_t v : indices)
+        triangleStart[v + 1]++;
+    for (uint32_t v = 0; v < vertexCount; v++)
+        triangleStart[v + 1] += triangleStart[v];
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    std::vector<uint32_t> fill(triangleStart.begin(), triangleStart.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            vertexTriangles[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+
+    std::vector<int> remaining(vertexCount);
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        remaining[v] = (int)(triangleStart[v + 1] - triangleStart[v]);
+        vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+    std::vector<uint32_t> out;
+    out.reserve(indices.size());
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    size_t scanCursor = 0;
+    int64_t best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        if (best < 0)
+        {
+            // Nothing in the cache has work left, take the best of what is left
+            float bestScore = -1e30f;
+            while (scanCursor < triangleCount && emitted[scanCursor])
+                scanCursor++;
+            for (size_t t = scanCursor; t < triangleCount; t++)
+            {
+                if (!emitted[t] && triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = (int64_t)t;
+                }
+            }
+        }
+
+        uint32_t tri = (uint32_t)best;
+        emitted[tri] = true;
+        const uint32_t *v = &indices[tri * 3];
+        out.insert(out.end(), v, v + 3);
+
+        // Emitted triangle is no longer adjacent to its vertices
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t vert = v[k];
+            uint32_t *begin = &vertexTriangles[triangleStart[vert]];
+            uint32_t *end = begin + remaining[vert];
+            *std::find(begin, end, tri) = *(end - 1);
+            remaining[vert]--;
+        }
+
+        // Used vertices go to the front, the rest is pushed back
+        nextCache.assign(v, v + 3);
+        for (uint32_t c : cache)
+            if (c != v[0] && c != v[1] && c != v[2])
+                nextCache.push_back(c);
+        for (size_t i = 0; i < nextCache.size(); i++)
+        {
+            uint32_t c = nextCache[i];
+            cachePosition[c] = i < (size_t)CACHE_SIZE ? (int)i : -1;
+            vertexScore[c] = forsythVertexScore(cachePosition[c], remaining[c]);
+        }
+        if (nextCache.size() > (size_t)CACHE_SIZE)
+            nextCache.resize(CACHE_SIZE);
+        cache.swap(nextCache);
+
+        // Only triangles touching the cache changed score
+        best = -1;
+        float bestScore = -1e30f;
+        for (uint32_t c : cache)
+        {
+            for (int i = 0; i < remaining[c]; i++)
+            {
+                uint32_t t = vertexTriangles[triangleStart[c] + i];
+                const uint32_t *tv = &indices[t * 3];
+                float s = vertexScore[tv[0]] + vertexScore[tv[1]] + vertexScore[tv[2]];
+                triangleScore[t] = s;
+                if (s > bestScore)
+                {
+                    bestScore = s;
+                    best = (int64_t)t;
+                }
+            }
+        }
+    }
+
+    indices.swap(out);
+}
+
+/*
+ * Keeps the cache friendly order, but cuts it into patches where the cache
+ * starts from scratch anyway (a triangle with no cached vertex) and draws
+ * the patches facing away from the mesh centre first. For convex-ish meshes
+ * like the ball and the pins those are the ones in front.
+ */
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Vertex> &vertices)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    auto position = [&](uint32_t i, float out[3]) {
+        out[0] = vertices[i].position.x;
+        out[1] = vertices[i].position.y;
+        out[2] = vertices[i].position.z;
+    };
+
+    // Patch boundaries
+    std::vector<size_t> patchStart;
+    std::vector<int64_t> insertedAt(vertices.size(), -1000000);
+    int64_t clock = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = indices[t * 3 + k];
+            if (clock - insertedAt[v] >= CACHE_SIZE)
+            {
+                insertedAt[v] = clock++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3)
+            patchStart.push_back(t);
+    }
+    patchStart.push_back(triangleCount);
+
+    float meshCentre[3] = {0.0f, 0.0f, 0.0f};
+    float meshArea = 0.0f;
+    struct Patch
+    {
+        size_t first, last;
+        float centre[3];
+        float normal[3];
+        float sortKey;
+    };
+    std::vector<Patch> patches(patchStart.size() - 1);
+    for (size_t p = 0; p < patches.size(); p++)
+    {
+        Patch &patch = patches[p];
+        patch.first = patchStart[p];
+        patch.last = patchStart[p + 1];
+        float area = 0.0f;
+        for (int c = 0; c < 3; c++)
+            patch.centre[c] = patch.normal[c] = 0.0f;
+
+        for (size_t t = patch.first; t < patch.last; t++)
+        {
+            float a[3], b[3], c[3];
+            position(indices[t * 3], a);
+            position(indices[t * 3 + 1], b);
+            position(indices[t * 3 + 2], c);
+            float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+            float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            float twiceArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++)
+            {
+                patch.centre[k] += (a[k] + b[k] + c[k]) / 3.0f * twiceArea;
+                patch.normal[k] += n[k];
+            }
+            area += twiceArea;
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            meshCentre[k] += patch.centre[k];
+            patch.centre[k] = area > 0.0f ? patch.centre[k] / area : 0.0f;
+        }
+        meshArea += area;
+    }
+    for (int k = 0; k < 3; k++)
+        meshCentre[k] = meshArea > 0.0f ? meshCentre[k] / meshArea : 0.0f;
+
+    for (Patch &patch : patches)
+    {
+        float len = std::sqrt(patch.normal[0] * patch.normal[0] + patch.normal[1] * patch.normal[1] + patch.normal[2] * patch.normal[2]);
+        patch.sortKey = 0.0f;
+        if (len > 0.0f)
+            for (int k = 0; k < 3; k++)
+                patch.sortKey += (patch.centre[k] - meshCentre[k]) * patch.normal[k] / len;
+    }
+
+    std::stable_sort(patches.begin(), patches.end(), [](const Patch &a, const Patch &b) {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<uint32_t> out;
+    out.reserve(indices.size());
+    for (const Patch &patch : patches)
+        out.insert(out.end(), indices.begin() + patch.first * 3, indices.begin() + patch.last * 3);
+    indices.swap(out);
+}
+
+// Renumber vertices in the order the index buffer first touches them.
+// Vertices no triangle uses are dropped.
+void optimizeVertexFetch(std::vector<uint32_t> &indices, std::vector<Vertex> &vertices)
+{
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> out;
+    out.reserve(vertices.size());
+    for (uint32_t &i : indices)
+    {
+        if (remap[i] == UINT32_MAX)
+        {
+            remap[i] = (uint32_t)out.size();
+            out.push_back(vertices[i]);
+        }
+        i = remap[i];
+    }
+    vertices.swap(out);
+}
+
+/*
+ * Simplified copy of `indices` by vertex clustering: vertices are snapped
+ * to a grid of `cellsAcross` cells along the longest side, each cell keeps
+ * the vertex nearest to the cell average, and triangles that collapse are
+ * dropped. Uses only existing vertices, so every LOD shares one vertex buffer.
+ * Returns the object space error, how far any vertex moved.
+ */
+float simplifyByClustering(
+    const std::vector<uint32_t> &indices,
+    const std::vector<Vertex> &vertices,
+    int cellsAcross,
+    std::vector<uint32_t> &out)
+{
+    float lo[3], hi[3];
+    for (int c = 0; c < 3; c++)
+    {
+        lo[c] = 1e30f;
+        hi[c] = -1e30f;
+    }
+    for (const Vertex &v : vertices)
+    {
+        const float p[3] = {v.position.x, v.position.y, v.position.z};
+        for (int c = 0; c < 3; c++)
+        {
+            lo[c] = std::min(lo[c], p[c]);
+            hi[c] = std::max(hi[c], p[c]);
+        }
+    }
+    float longest = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+    float cellSize = longest > 0.0f ? longest / (float)cellsAcross : 1.0f;
+
+    auto cellOf = [&](const Vertex &v) {
+        const float p[3] = {v.position.x, v.position.y, v.position.z};
+        uint64_t key = 0;
+        for (int c = 0; c < 3; c++)
+            key = (key << 21) | (uint64_t)std::min(2097151.0f, std::floor((p[c] - lo[c]) / cellSize));
+        return key;
+    };
+
+    struct Cluster
+    {
+        float sum[3] = {0.0f, 0.0f, 0.0f};
+        int count = 0;
+        uint32_t representative = UINT32_MAX;
+        float bestDistance = 1e30f;
+    };
+    std::unordered_map<uint64_t, Cluster> clusters;
+    std::vector<uint64_t> vertexCell(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        vertexCell[i] = cellOf(vertices[i]);
+        Cluster &cl = clusters[vertexCell[i]];
+        cl.sum[0] += vertices[i].position.x;
+        cl.sum[1] += vertices[i].position.y;
+        cl.sum[2] += vertices[i].position.z;
+        cl.count++;
+    }
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        Cluster &cl = clusters[vertexCell[i]];
+        float d[3] = {
+            vertices[i].position.x - cl.sum[0] / cl.count,
+            vertices[i].position.y - cl.sum[1] / cl.count,
+            vertices[i].position.z - cl.sum[2] / cl.count,
+        };
+        float dist = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        if (dist < cl.bestDistance)
+        {
+            cl.bestDistance = dist;
+            cl.representative = (uint32_t)i;
+        }
+    }
+
+    float error = 0.0f;
+    std::vector<uint32_t> remap(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        remap[i] = clusters[vertexCell[i]].representative;
+        const Vertex &a = vertices[i];
+        const Vertex &b = vertices[remap[i]];
+        float d[3] = {a.position.x - b.position.x, a.position.y - b.position.y, a.position.z - b.position.z};
+        error = std::max(error, std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]));
+    }
+
+    out.clear();
+    std::unordered_set<uint64_t> seen;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        uint32_t a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+        if (a == b || b == c || a == c)
+            continue;
+
+        // Same triangle from many small ones, keep it once (any winding start)
+        uint32_t lowest = std::min(a, std::min(b, c));
+        uint32_t r[3] = {a, b, c};
+        while (r[0] != lowest)
+            std::rotate(r, r + 1, r + 3);
+        uint64_t key = ((uint64_t)r[0] * 0x9E3779B97F4A7C15ull) ^ ((uint64_t)r[1] << 32) ^ r[2];
+        if (!seen.insert(key).second)
+            continue;
+
+        out.insert(out.end(), r, r + 3);
+    }
+    return error;
+}
+
+struct MeshLodChain
+{
+    std::vector<std::vector<uint32_t>> indices; // [0] is the full mesh
+    std::vector<float> errors;
+};
+
+// Coarser and coarser grids until the mesh stops shrinking
+MeshLodChain buildLodChain(const std::vector<uint32_t> &indices, const std::vector<Vertex> &vertices)
+{
+    MeshLodChain chain;
+    chain.indices.push_back(indices);
+    chain.errors.push_back(0.0f);
+
+    int cellsAcross = 32;
+    while ((int)chain.indices.size() < MESH_MAX_LODS && cellsAcross >= 2)
+    {
+        std::vector<uint32_t> lod;
+        float error = simplifyByClustering(indices, vertices, cellsAcross, lod);
+        cellsAcross /= 2;
+
+        // Not worth a LOD unless it saves a quarter of the triangles
+        const std::vector<uint32_t> &previous = chain.indices.back();
+        if (lod.size() < 3 * 4 || lod.size() * 4 > previous.size() * 3)
+            continue;
+
+        optimizeVertexCache(lod, (uint32_t)vertices.size());
+        chain.indices.push_back(lod);
+        chain.errors.push_back(error);
+    }
+    return chain;
+}
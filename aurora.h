@@ -12,15 +12,36 @@
 #include "framework/boot.h"
 #include "framework/gl_util.h"
 
+/*
+ * Noise is slow and the sky moves slowly, so by default it is rendered into
+ * a small texture every few frames and only that texture is stretched over
+ * the screen each frame. Bilinear upsampling of smooth noise looks the same.
+ * downscale = 1 and refreshEvery = 1 is the old direct path.
+ *
+ * Drawn after the opaque geometry. The quad sits on the far plane and the
+ * depth test is LEQUAL, so only pixels nothing else covered get shaded.
+ */
 struct Aurora
 {
     static const char *AURORA_VERTEX_SHADER;
     static const char *AURORA_FRAGMENT_SHADER;
+    static const char *UPSAMPLE_FRAGMENT_SHADER;
 
     GLuint auroraVAO;
     GLuint auroraShaderId;
+    GLint yawLoc, pitchLoc, timeLoc;
     float time;
 
+    int downscale = 8;    // Offscreen target is this many times smaller on each axis
+    int refreshEvery = 4; // Frames between noise updates, camera turning refreshes sooner
+
+    GLuint upsampleShaderId;
+    GLuint lowResFbo = 0;
+    GLuint lowResTexture = 0;
+    int lowResWidth = 0, lowResHeight = 0;
+    int framesSinceRefresh = 0;
+    float lastYaw = 0.0f, lastPitch = 0.0f;
+
 
     void initAurora()
     {
@@ -31,9 +52,9 @@ struct Aurora
 
         const GLfloat fullscreenQuadVertices[] = {
             -1.0f, -1.0f, 1.0f, 0.0f, 0.0f,
-            1.0f, -1.0f, 0.998f, 1.0f, 0.0f,
-            -1.0f, 1.0f, 0.998f, 0.0f, 1.0f,
-            1.0f, 1.0f, 0.998f, 1.0f, 1.0f};
+            1.0f, -1.0f, 1.0f, 1.0f, 0.0f,
+            -1.0f, 1.0f, 1.0f, 0.0f, 1.0f,
+            1.0f, 1.0f, 1.0f, 1.0f, 1.0f};
 
         // const GLfloat fullscreenQuadVertices[] = {
         //     //  x     y     z      u     v
@@ -52,7 +73,7 @@ struct Aurora
         glGenBuffers(1, &vbo);
         glGenBuffers(1, &ebo);
 
-        glBindVertexArray(this->auroraVAO);
+        vtx::glState.bindVertexArray(this->auroraVAO);
 
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, sizeof(fullscreenQuadVertices), fullscreenQuadVertices, GL_STATIC_DRAW);
@@ -66,7 +87,7 @@ struct Aurora
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void *)(3 * sizeof(GLfloat)));
 
-        glBindVertexArray(0);
+        vtx::glState.bindVertexArray(0);
         
 
         checkOpenGLError();
@@ -75,6 +96,54 @@ struct Aurora
     void loadAuroraShader() {
         this->auroraShaderId = vtx::createShaderProgram(
             AURORA_VERTEX_SHADER, AURORA_FRAGMENT_SHADER);
+        this->yawLoc = glGetUniformLocation(this->auroraShaderId, "uYaw");
+        this->pitchLoc = glGetUniformLocation(this->auroraShaderId, "uPitch");
+        this->timeLoc = glGetUniformLocation(this->auroraShaderId, "uTime");
+
+        this->upsampleShaderId = vtx::createShaderProgram(
+            AURORA_VERTEX_SHADER, UPSAMPLE_FRAGMENT_SHADER);
+        vtx::glState.useProgram(this->upsampleShaderId);
+        glUniform1i(glGetUniformLocation(this->upsampleShaderId, "uAurora"), 0);
+
+        // Shader may have changed, do not wait for the next refresh
+        this->lowResWidth = 0;
+    }
+
+    // (Re)creates the offscreen target when the screen size changed
+    bool resizeLowResTarget(int screenWidth, int screenHeight)
+    {
+        int width = glm::max(screenWidth / this->downscale, 1);
+        int height = glm::max(screenHeight / this->downscale, 1);
+        if (width == this->lowResWidth && height == this->lowResHeight)
+        {
+            return false;
+        }
+        this->lowResWidth = width;
+        this->lowResHeight = height;
+
+        if (!this->lowResTexture)
+        {
+            glGenTextures(1, &this->lowResTexture);
+            glGenFramebuffers(1, &this->lowResFbo);
+        }
+        vtx::glState.bindTexture(0, this->lowResTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        GLint previousFbo;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->lowResFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->lowResTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "Aurora framebuffer is not complete" << std::endl;
+            exit(1);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+        return true;
     }
     void hangAuroraShader() {
 
@@ -84,8 +153,6 @@ struct Aurora
         float deltaTime,
         const glm::mat4 cameraMatrix)
     {
-        glUseProgram(this->auroraShaderId);
-
         // Extract the forward vector from the view matrix
         glm::vec3 forward = glm::normalize(
             glm::vec3(
@@ -97,20 +164,64 @@ struct Aurora
         float yaw = atan2(forward.x, forward.z) * 5.0f; // Yaw affects x-axis
         float pitch = asin((forward.y + 1.0f) * 0.5f);  // Pitch affects y-axis
 
-        // Pass yaw and pitch as uniforms
-        glUniform1f(glGetUniformLocation(this->auroraShaderId, "uYaw"), yaw);
-        glUniform1f(glGetUniformLocation(this->auroraShaderId, "uPitch"), pitch);
-
         this->time += deltaTime;
 
-        glUniform1f(glGetUniformLocation(
-                        this->auroraShaderId,
-                        "uTime"),
-                    this->time);
+        // Where the depth buffer is still clear only, and it stays clear
+        vtx::glState.setEnabled(GlStateCache::CAP_DEPTH_TEST, true);
+        vtx::glState.setDepthMask(false);
+        vtx::glState.setDepthFunc(GL_LEQUAL);
+
+        if (this->downscale <= 1 && this->refreshEvery <= 1)
+        {
+            vtx::glState.setEnabled(GlStateCache::CAP_BLEND, true);
+            this->renderAuroraNoise(yaw, pitch);
+            vtx::glState.setDepthFunc(GL_LESS);
+            return;
+        }
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        bool resized = this->resizeLowResTarget(viewport[2], viewport[3]);
+        bool turned = glm::abs(yaw - this->lastYaw) > 1e-3f || glm::abs(pitch - this->lastPitch) > 1e-3f;
+        if (resized || turned || ++this->framesSinceRefresh >= this->refreshEvery)
+        {
+            this->framesSinceRefresh = 0;
+            this->lastYaw = yaw;
+            this->lastPitch = pitch;
+
+            GLint previousFbo;
+            glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+
+            // Colour and opacity go into the texture as they are, blending happens when upsampling.
+            // No depth buffer there, every texel is drawn.
+            glBindFramebuffer(GL_FRAMEBUFFER, this->lowResFbo);
+            glViewport(0, 0, this->lowResWidth, this->lowResHeight);
+            vtx::glState.setEnabled(GlStateCache::CAP_BLEND, false);
+            this->renderAuroraNoise(yaw, pitch);
+            glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        }
+
+        vtx::glState.setEnabled(GlStateCache::CAP_BLEND, true);
+        vtx::glState.useProgram(this->upsampleShaderId);
+        vtx::glState.bindTexture(0, this->lowResTexture);
+        vtx::glState.bindVertexArray(this->auroraVAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        vtx::glState.setDepthFunc(GL_LESS);
+    }
+
+    // The expensive part, three octaves of simplex noise per pixel
+    void renderAuroraNoise(float yaw, float pitch)
+    {
+        vtx::glState.useProgram(this->auroraShaderId);
+
+        // Pass yaw and pitch as uniforms
+        glUniform1f(this->yawLoc, yaw);
+        glUniform1f(this->pitchLoc, pitch);
+        glUniform1f(this->timeLoc, this->time);
 
-        glBindVertexArray(this->auroraVAO);
+        vtx::glState.bindVertexArray(this->auroraVAO);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
     }
 };
 
@@ -204,3 +315,19 @@ const char *Aurora::AURORA_FRAGMENT_SHADER =
         FragColor = vec4(auroraColor, opacity);
     }
     )";
+
+const char *Aurora::UPSAMPLE_FRAGMENT_SHADER =
+    GLSL_VERSION
+    R"(
+    precision mediump float;
+
+    in vec2 TexCoord;
+
+    out vec4 FragColor;
+
+    uniform sampler2D uAurora;
+
+    void main() {
+        FragColor = texture(uAurora, TexCoord);
+    }
+    )";
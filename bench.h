@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "framework/boot.h"
+
+/*
+ * Scripted render benchmark. The bot bowls on a fixed 60 Hz clock for
+ * VTX_BENCH_FRAMES frames, then CPU and GPU frame time percentiles are
+ * printed and the game exits. Fixed time steps make every run draw the
+ * same frames, so VTX_BENCH_DUMP=out.ppm of the last frame can be
+ * pixel-diffed against a reference.
+ *
+ * Always on in VTX_HEADLESS builds (see `make -f Makefile.linux bench`),
+ * or in a normal build when VTX_BENCH_FRAMES is set.
+ * VTX_ALLEY=1 benches the whole alley view instead of the single lane.
+ */
+struct RenderBench
+{
+    static constexpr float STEP = 1.0f / 60.0f;
+
+    bool enabled = false;
+    int frames = 600;
+    int warmupFrames = 30; // Shader compiles and first uploads are not what we measure
+    int frameIndex = 0;
+    const char *dumpPath = nullptr;
+
+    uint64_t frameStart;
+    std::vector<float> cpuMs;
+    std::vector<float> gpuMs; // Filled by GpuTimer, a few frames late
+
+    void initRenderBench()
+    {
+        const char *framesEnv = getenv("VTX_BENCH_FRAMES");
+#ifdef VTX_HEADLESS
+        this->enabled = true;
+#else
+        this->enabled = framesEnv != nullptr;
+#endif
+        if (!this->enabled)
+        {
+            return;
+        }
+        if (framesEnv)
+        {
+            this->frames = std::max(atoi(framesEnv), 1);
+        }
+        this->warmupFrames = std::min(this->warmupFrames, this->frames / 2);
+        this->dumpPath = getenv("VTX_BENCH_DUMP");
+        this->cpuMs.reserve(this->frames);
+        this->gpuMs.reserve(this->frames);
+        std::cerr << "Render bench: " << this->frames << " frames" << std::endl;
+    }
+
+    // Simulated clock, so the run does not depend on how fast the box is
+    float benchDeltaTime() const
+    {
+        return this->frameIndex == 0 ? 0.0f : STEP;
+    }
+
+    uint64_t benchTimeMs() const
+    {
+        return (uint64_t)(this->frameIndex * STEP * 1000.0f);
+    }
+
+    bool measuring() const
+    {
+        return this->enabled && this->frameIndex >= this->warmupFrames;
+    }
+
+    void beginBenchFrame()
+    {
+        this->frameStart = SDL_GetPerformanceCounter();
+    }
+
+    // Before the swap, so the dump reads what was just drawn.
+    // Returns false when the run is over.
+    bool endBenchFrame(vtx::VertexContext *ctx)
+    {
+        // CPU side only, the driver may still be drawing
+        if (this->measuring())
+        {
+            uint64_t ticks = SDL_GetPerformanceCounter() - this->frameStart;
+            this->cpuMs.push_back((float)(ticks * 1000.0 / SDL_GetPerformanceFrequency()));
+        }
+
+        this->frameIndex++;
+        if (this->frameIndex < this->frames)
+        {
+            return true;
+        }
+
+        if (this->dumpPath)
+        {
+            this->dumpFramebuffer(ctx->screenWidth, ctx->screenHeight);
+        }
+        this->printBenchReport();
+        return false;
+    }
+
+    static void printPercentiles(const char *name, std::vector<float> &samples)
+    {
+        if (samples.empty())
+        {
+            printf("bench %s: no samples\n", name);
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto at = [&](float p)
+        { return samples[std::min((size_t)(p * samples.size()), samples.size() - 1)]; };
+        float sum = 0.0f;
+        for (float s : samples)
+        {
+            sum += s;
+        }
+        printf("bench %s ms: mean=%.3f p50=%.3f p90=%.3f p95=%.3f p99=%.3f max=%.3f (n=%zu)\n",
+               name, sum / samples.size(), at(0.50f), at(0.90f), at(0.95f), at(0.99f), samples.back(), samples.size());
+    }
+
+    void printBenchReport()
+    {
+        printf("bench renderer: %s | %s\n",
+               (const char *)glGetString(GL_RENDERER),
+               (const char *)glGetString(GL_VERSION));
+        printPercentiles("cpu", this->cpuMs);
+        printPercentiles("gpu", this->gpuMs);
+        fflush(stdout);
+    }
+
+    // Binary PPM, bottom row last, no dependencies needed to diff it
+    void dumpFramebuffer(int width, int height)
+    {
+        std::vector<uint8_t> rgba(width * height * 4);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+
+        FILE *f = fopen(this->dumpPath, "wb");
+        if (!f)
+        {
+            std::cerr << "Bench can not write " << this->dumpPath << std::endl;
+            return;
+        }
+        fprintf(f, "P6\n%d %d\n255\n", width, height);
+        std::vector<uint8_t> row(width * 3);
+        for (int y = height - 1; y >= 0; y--)
+        {
+            const uint8_t *src = &rgba[y * width * 4];
+            for (int x = 0; x < width; x++)
+            {
+                row[x * 3 + 0] = src[x * 4 + 0];
+                row[x * 3 + 1] = src[x * 4 + 1];
+                row[x * 3 + 2] = src[x * 4 + 2];
+            }
+            fwrite(row.data(), 1, row.size(), f);
+        }
+        fclose(f);
+        std::cerr << "Bench frame written to " << this->dumpPath << std::endl;
+    }
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "assets/api/strike_table.h"
+
+/*
+ * Read-only view of the table made by strikegen.
+ * The file is mmapped, so many bots (and processes) share the same pages.
+ * Nothing here allocates after openStrikeTable().
+ */
+struct StrikeTable
+{
+    const StrikeTableHeader *header = nullptr;
+    const StrikeCell *cells = nullptr;
+    const uint32_t *ranked = nullptr;
+
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+
+    bool openStrikeTable(const char *path)
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << "No strike table at " << path << ", bot and aim assist are off" << std::endl;
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(StrikeTableHeader))
+        {
+            std::cerr << "Strike table too small: " << path << std::endl;
+            close(fd);
+            return false;
+        }
+
+        void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            std::cerr << "Failed to mmap strike table: " << path << std::endl;
+            return false;
+        }
+
+        const StrikeTableHeader *h = static_cast<const StrikeTableHeader *>(mapped);
+        size_t total = strikeTableCellCount(h);
+        bool valid = h->magic == STRIKE_TABLE_MAGIC &&
+                     h->version == STRIKE_TABLE_VERSION &&
+                     total > 0 &&
+                     h->rankedCount > 0 &&
+                     h->rankedCount <= total &&
+                     h->cellsOffset + total * sizeof(StrikeCell) <= size_t(st.st_size) &&
+                     h->rankedOffset + h->rankedCount * sizeof(uint32_t) <= size_t(st.st_size);
+        if (!valid)
+        {
+            std::cerr << "Strike table is broken or from another version: " << path << std::endl;
+            munmap(mapped, st.st_size);
+            return false;
+        }
+
+        this->mapping = mapped;
+        this->mappingSize = st.st_size;
+        this->header = h;
+        this->cells = reinterpret_cast<const StrikeCell *>(static_cast<const uint8_t *>(mapped) + h->cellsOffset);
+        this->ranked = reinterpret_cast<const uint32_t *>(static_cast<const uint8_t *>(mapped) + h->rankedOffset);
+        return true;
+    }
+
+    void closeStrikeTable()
+    {
+        if (this->mapping)
+        {
+            munmap(this->mapping, this->mappingSize);
+        }
+        *this = StrikeTable();
+    }
+
+    bool isLoaded() const
+    {
+        return this->header != nullptr;
+    }
+
+    // Aim assist: what the table says about the throw being lined up
+    const StrikeCell *lookup(float x, float speed, float spin) const
+    {
+        if (!this->header)
+            return nullptr;
+        return &this->cells[strikeTableCellIndex(this->header, x, speed, spin)];
+    }
+};
+
+struct BotThrow
+{
+    float x;
+    float speed;
+    float spin;
+};
+
+/*
+ * Picks throws from the ranked list of the table.
+ * skill 1.0 always goes for the best cell, lower skill
+ * reaches further down the list. O(1), no allocations.
+ */
+struct BowlingBot
+{
+    const StrikeTable *table = nullptr;
+    float skill = 0.8f;
+    uint32_t rng = 0x9E3779B9u;
+
+    void initBowlingBot(const StrikeTable *table, float skill, uint32_t seed)
+    {
+        this->table = table;
+        this->skill = skill;
+        this->rng = seed ? seed : 0x9E3779B9u;
+    }
+
+    float nextRandom()
+    {
+        // xorshift32
+        this->rng ^= this->rng << 13;
+        this->rng ^= this->rng >> 17;
+        this->rng ^= this->rng << 5;
+        return float(this->rng >> 8) / float(1 << 24);
+    }
+
+    bool pickThrow(BotThrow *out)
+    {
+        if (!this->table || !this->table->isLoaded())
+            return false;
+
+        const StrikeTableHeader *h = this->table->header;
+
+        // Bad bots land further down the list, good bots stay near the top
+        float r = nextRandom();
+        float reach = (1.0f - this->skill) * (1.0f - this->skill);
+        uint32_t rank = uint32_t(r * reach * float(h->rankedCount));
+        if (rank >= h->rankedCount)
+            rank = h->rankedCount - 1;
+
+        strikeTableCellParams(h, this->table->ranked[rank], &out->x, &out->speed, &out->spin);
+        return true;
+    }
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "framework/gl_header.h"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include <iostream>
+
+#include "framework/boot.h"
+#include "framework/gl_util.h"
+#include "framework/stream_buffer.h"
+#include "physics/physics.h"
+
+/*
+ * Draws what Jolt sees (shapes, contacts, bounds) over the scene.
+ * Line and triangle vertices are streamed into the frame's vertex ring,
+ * two draw calls starting where each landed.
+ */
+struct DebugDraw
+{
+    static const char *DEBUG_DRAW_VERTEX_SHADER;
+    static const char *DEBUG_DRAW_FRAGMENT_SHADER;
+
+    GLuint shaderId = 0;
+    GLint viewProjectionLoc, alphaLoc;
+    GLuint vao;
+    StreamBuffer *stream; // Owned by the game
+
+    void initDebugDraw(StreamBuffer *stream)
+    {
+        this->loadDebugDrawShader();
+        this->stream = stream;
+
+        glGenVertexArrays(1, &this->vao);
+
+        vtx::glState.bindVertexArray(this->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PhysicsDebugVertex), (void *)offsetof(PhysicsDebugVertex, x));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PhysicsDebugVertex), (void *)offsetof(PhysicsDebugVertex, rgba));
+
+        vtx::glState.bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        checkOpenGLError("DEBUG_DRAW_INIT");
+    }
+
+    void loadDebugDrawShader()
+    {
+        // Reload, the new program may reuse the old name
+        vtx::glState.useProgram(0);
+        if (this->shaderId)
+        {
+            glDeleteProgram(this->shaderId);
+        }
+        this->shaderId = vtx::createShaderProgram(
+            DEBUG_DRAW_VERTEX_SHADER, DEBUG_DRAW_FRAGMENT_SHADER);
+        this->viewProjectionLoc = glGetUniformLocation(this->shaderId, "uViewProjection");
+        this->alphaLoc = glGetUniformLocation(this->shaderId, "uAlpha");
+    }
+
+    void renderDebugDraw(const Physics &phy, const glm::mat4 &cameraMatrix, const glm::mat4 &projectionMatrix)
+    {
+        int lineCount = phy.debugLineVertexCount;
+        int triCount = phy.debugTriangleVertexCount;
+        if (!phy.debugDrawEnabled || lineCount + triCount == 0)
+            return;
+
+        // Aligned to the vertex, so offset / stride is the first vertex
+        size_t stride = sizeof(PhysicsDebugVertex);
+        size_t lineOffset = this->stream->streamData(phy.debugLineVertices, lineCount * stride, stride);
+        size_t triOffset = this->stream->streamData(phy.debugTriangleVertices, triCount * stride, stride);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        vtx::glState.useProgram(this->shaderId);
+        glm::mat4 viewProjection = projectionMatrix * cameraMatrix;
+        glUniformMatrix4fv(this->viewProjectionLoc, 1, GL_FALSE, glm::value_ptr(viewProjection));
+
+        // On top of everything, otherwise we can't see what is inside the pins
+        vtx::glState.setEnabled(GlStateCache::CAP_DEPTH_TEST, false);
+        vtx::glState.setDepthMask(false);
+        vtx::glState.setEnabled(GlStateCache::CAP_BLEND, true);
+        vtx::glState.setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        // Solid parts are see-through so lines stay readable
+        vtx::glState.bindVertexArray(this->vao);
+        if (triCount > 0)
+        {
+            glUniform1f(this->alphaLoc, 0.35f);
+            glDrawArrays(GL_TRIANGLES, (GLint)(triOffset / stride), triCount);
+        }
+        if (lineCount > 0)
+        {
+            glUniform1f(this->alphaLoc, 1.0f);
+            glDrawArrays(GL_LINES, (GLint)(lineOffset / stride), lineCount);
+        }
+
+        vtx::glState.setEnabled(GlStateCache::CAP_BLEND, false);
+        vtx::glState.setEnabled(GlStateCache::CAP_DEPTH_TEST, true);
+        vtx::glState.setDepthMask(true);
+    }
+};
+
+const char *DebugDraw::DEBUG_DRAW_VERTEX_SHADER =
+    GLSL_VERSION
+    R"(
+    precision highp float;
+
+    layout(location = 0) in vec3 aPos;
+    layout(location = 1) in vec4 aColor;
+
+    uniform mat4 uViewProjection;
+
+    out vec4 vColor;
+
+    void main() {
+        vColor = aColor;
+        gl_Position = uViewProjection * vec4(aPos, 1.0);
+    }
+    )";
+
+const char *DebugDraw::DEBUG_DRAW_FRAGMENT_SHADER =
+    GLSL_VERSION
+    R"(
+    precision mediump float;
+
+    in vec4 vColor;
+    uniform float uAlpha;
+    out vec4 FragColor;
+
+    void main() {
+        FragColor = vec4(vColor.rgb, vColor.a * uAlpha);
+    }
+    )";
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "framework/boot.h"
+
+/*
+ * Decides when a frame starts and how long the last one took, from
+ * SDL_GetPerformanceCounter instead of millisecond ticks.
+ *
+ * - target >= display refresh: vsync paces us, no waiting here
+ * - target below it: vsync stays on for tear-free swaps, frames start on a
+ *   fixed grid of 1/target, slept to just before the deadline then spun
+ * - uncapped (0): no vsync, no waiting
+ *
+ * On the web the browser drives frames with requestAnimationFrame, so only
+ * the timing part is used there.
+ */
+struct FramePacer
+{
+    static constexpr int UNCAPPED = 0;
+
+    int targetFps = -1; // -1 until set, then one of the above
+    int displayHz = 60;
+    bool vsync = false;
+
+    uint64_t frequency;
+    uint64_t lastFrameStart;
+    uint64_t nextDeadline;
+    uint64_t period = 0; // In counter ticks, 0 when not pacing
+
+    // OS sleep is only trusted to within this, the rest is spun away
+    float spinSeconds = 0.002f;
+
+    void initFramePacer(vtx::VertexContext *ctx)
+    {
+        this->frequency = SDL_GetPerformanceFrequency();
+        this->lastFrameStart = SDL_GetPerformanceCounter();
+        this->nextDeadline = this->lastFrameStart;
+
+        SDL_DisplayMode mode;
+        int display = SDL_GetWindowDisplayIndex(ctx->sdlWindow);
+        if (display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 && mode.refresh_rate > 0)
+        {
+            this->displayHz = mode.refresh_rate;
+        }
+
+        // VTX_TARGET_FPS=144, 0 for uncapped, default is the display rate
+        const char *env = getenv("VTX_TARGET_FPS");
+        this->setTargetFps(env ? atoi(env) : this->displayHz);
+    }
+
+    void setTargetFps(int fps)
+    {
+        if (fps == this->targetFps)
+        {
+            return;
+        }
+        this->targetFps = fps;
+
+#ifndef __EMSCRIPTEN__
+        if (fps == UNCAPPED)
+        {
+            this->vsync = false;
+            SDL_GL_SetSwapInterval(0);
+        }
+        else
+        {
+            // Adaptive first, so a missed vblank tears instead of halving the rate
+            this->vsync = SDL_GL_SetSwapInterval(-1) == 0 || SDL_GL_SetSwapInterval(1) == 0;
+        }
+
+        bool vsyncPaced = this->vsync && fps >= this->displayHz;
+        this->period = (fps == UNCAPPED || vsyncPaced) ? 0 : this->frequency / fps;
+#endif
+        this->nextDeadline = SDL_GetPerformanceCounter() + this->period;
+
+        std::cerr << "Frame pacing: " << (fps == UNCAPPED ? std::string("uncapped") : std::to_string(fps) + " fps")
+                  << ", display " << this->displayHz << " Hz, vsync " << (this->vsync ? "on" : "off") << std::endl;
+    }
+
+    // Blocks until the next frame should start, returns seconds since the previous start
+    float waitForNextFrame()
+    {
+        if (this->period > 0)
+        {
+            uint64_t now = SDL_GetPerformanceCounter();
+            if (now < this->nextDeadline)
+            {
+                double remaining = (double)(this->nextDeadline - now) / this->frequency;
+                if (remaining > this->spinSeconds)
+                {
+                    std::this_thread::sleep_for(std::chrono::duration<double>(remaining - this->spinSeconds));
+                }
+                while (SDL_GetPerformanceCounter() < this->nextDeadline)
+                {
+                    // Spin the last bit, sleep wakes up too late too often
+                }
+            }
+
+            // Stay on the grid, unless we fell more than a frame behind
+            this->nextDeadline += this->period;
+            now = SDL_GetPerformanceCounter();
+            if (now > this->nextDeadline)
+            {
+                this->nextDeadline = now + this->period;
+            }
+        }
+
+        uint64_t frameStart = SDL_GetPerformanceCounter();
+        float deltaTime = (float)((double)(frameStart - this->lastFrameStart) / this->frequency);
+        this->lastFrameStart = frameStart;
+        return deltaTime;
+    }
+};
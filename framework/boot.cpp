@@ -8,6 +8,10 @@
 // **************************
 static bool initVideo(vtx::VertexContext *ctx, const int initialWidth, const int initialHeight)
 {
+#ifdef VTX_HEADLESS
+    // No display needed, SDL renders into an EGL pbuffer (Mesa llvmpipe on CI)
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+#endif
     SDL_Init(SDL_INIT_VIDEO);
 
 #if defined(FORCE_DESKTOP_OPENGL)
@@ -27,6 +31,7 @@ static bool initVideo(vtx::VertexContext *ctx, const int initialWidth, const int
     SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
+    SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8); // Overdraw view counts fragments in it
 
 
     SDL_Window* window = SDL_CreateWindow(
@@ -36,8 +41,12 @@ static bool initVideo(vtx::VertexContext *ctx, const int initialWidth, const int
         initialWidth,
         initialHeight,
         SDL_WINDOW_OPENGL
+#ifdef VTX_HEADLESS
+            | SDL_WINDOW_HIDDEN
+#else
             | SDL_WINDOW_RESIZABLE 
             | SDL_WINDOW_SHOWN
+#endif
 #ifndef __EMSCRIPTEN__
             | SDL_WINDOW_ALLOW_HIGHDPI
 #endif
@@ -48,7 +57,9 @@ static bool initVideo(vtx::VertexContext *ctx, const int initialWidth, const int
 	// 1  → sync to display refresh (usually 60Hz)
 	// 0  → V-Sync OFF
 	// -1 → “late swap tearing” (adaptive vsync, if driver supports it)
+#ifndef VTX_HEADLESS
     SDL_ShowWindow(window);
+#endif
 
     if (SDL_GL_SetSwapInterval(-1) != 0) {
         std::cerr << "Warning: VSync not available: "
@@ -84,7 +95,7 @@ static bool initVideo(vtx::VertexContext *ctx, const int initialWidth, const int
         ctx->sdlContext = gl_context;
         ctx->sdlWindow = window;
         ctx->screenWidth = drawW;
-        ctx->screenHeight = drawW;
+        ctx->screenHeight = drawH;
         ctx->pixelRatio = pixelRatio;
     }
 
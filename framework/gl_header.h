@@ -75,12 +75,17 @@
 // =========================
 #elif defined(__linux__)
 
-    // Option A: Desktop GL
-    #include <GL/gl.h>
-
-    // Option B: GLES3 (Mesa EGL or ANGLE)
-    // #include <GLES3/gl3.h>
-    // #include <GLES3/gl3ext.h>
+    #if defined(FORCE_DESKTOP_OPENGL)
+        #include <GL/gl3w.h>
+        #define GLSL_VERSION "#version 330 core"
+    #else
+        // GLES3 through Mesa EGL, what boot.cpp asks SDL for
+        #include <GLES3/gl3.h>
+        #include <GLES2/gl2ext.h>
+        #include <EGL/egl.h>
+        #define GLSL_VERSION "#version 300 es"
+    #endif
+    #include <SDL.h>
 // =========================
 // Emscripten
 // =========================
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdint>
+
+#include "gl_header.h"
+
+// ****************************
+//  GL state cache
+// ****************************
+//
+// Remembers what is bound and enabled and skips calls that would not change
+// anything. Only correct while every change goes through it: after code we
+// do not own (ImGui, a new frame, resource creation with raw binds) call
+// invalidate() and the next call of each kind goes to the driver again.
+
+struct GlStateCache
+{
+    static constexpr int TEXTURE_UNITS = 4;
+    static constexpr GLuint UNKNOWN = 0xffffffff;
+
+    // Caps we toggle, as bits in `enabledCaps`
+    enum Cap : uint32_t
+    {
+        CAP_BLEND = 1 << 0,
+        CAP_DEPTH_TEST = 1 << 1,
+        CAP_CULL_FACE = 1 << 2,
+        CAP_SCISSOR_TEST = 1 << 3,
+        CAP_POLYGON_OFFSET_FILL = 1 << 4,
+        CAP_STENCIL_TEST = 1 << 5,
+        CAP_COUNT = 6,
+    };
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    GLuint textures[TEXTURE_UNITS];
+    uint32_t enabledCaps;
+    uint32_t knownCaps; // Bits of enabledCaps that are really known
+    GLuint depthMask;
+    GLenum blendSrc, blendDst;
+    GLenum depthFunc;
+
+    // Calls made and skipped since resetStateCounters, for the debug UI
+    uint32_t issued = 0;
+    uint32_t skipped = 0;
+
+    GlStateCache()
+    {
+        this->invalidate();
+    }
+
+    void invalidate()
+    {
+        this->program = UNKNOWN;
+        this->vertexArray = UNKNOWN;
+        this->activeUnit = UNKNOWN;
+        for (GLuint &t : this->textures)
+        {
+            t = UNKNOWN;
+        }
+        this->enabledCaps = 0;
+        this->knownCaps = 0;
+        this->depthMask = UNKNOWN;
+        this->blendSrc = this->blendDst = UNKNOWN;
+        this->depthFunc = UNKNOWN;
+    }
+
+    void resetStateCounters()
+    {
+        this->issued = 0;
+        this->skipped = 0;
+    }
+
+    bool changed(GLuint &current, GLuint wanted)
+    {
+        if (current == wanted)
+        {
+            this->skipped++;
+            return false;
+        }
+        current = wanted;
+        this->issued++;
+        return true;
+    }
+
+    void useProgram(GLuint id)
+    {
+        if (this->changed(this->program, id))
+            glUseProgram(id);
+    }
+
+    void bindVertexArray(GLuint vao)
+    {
+        if (this->changed(this->vertexArray, vao))
+            glBindVertexArray(vao);
+    }
+
+    // 2D textures only, that is all we have
+    void bindTexture(int unit, GLuint texture)
+    {
+        if (this->textures[unit] == texture)
+        {
+            this->skipped++;
+            return;
+        }
+        if (this->changed(this->activeUnit, GL_TEXTURE0 + unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+        this->changed(this->textures[unit], texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    // GL unbinds a deleted texture from every unit, the cache has to follow
+    // or a new texture given the same name would never get bound
+    void deleteTexture(GLuint texture)
+    {
+        for (GLuint &t : this->textures)
+        {
+            if (t == texture)
+                t = 0;
+        }
+        glDeleteTextures(1, &texture);
+    }
+
+    void setEnabled(Cap cap, bool enabled)
+    {
+        bool known = this->knownCaps & cap;
+        if (known && ((this->enabledCaps & cap) != 0) == enabled)
+        {
+            this->skipped++;
+            return;
+        }
+        this->knownCaps |= cap;
+        this->enabledCaps = enabled ? (this->enabledCaps | cap) : (this->enabledCaps & ~cap);
+        this->issued++;
+
+        GLenum glCap = cap == CAP_BLEND          ? GL_BLEND
+                       : cap == CAP_DEPTH_TEST   ? GL_DEPTH_TEST
+                       : cap == CAP_CULL_FACE    ? GL_CULL_FACE
+                       : cap == CAP_SCISSOR_TEST ? GL_SCISSOR_TEST
+                       : cap == CAP_STENCIL_TEST ? GL_STENCIL_TEST
+                                                 : GL_POLYGON_OFFSET_FILL;
+        if (enabled)
+            glEnable(glCap);
+        else
+            glDisable(glCap);
+    }
+
+    void setDepthMask(bool write)
+    {
+        if (this->changed(this->depthMask, write ? GL_TRUE : GL_FALSE))
+            glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void setDepthFunc(GLenum func)
+    {
+        if (this->changed(this->depthFunc, func))
+            glDepthFunc(func);
+    }
+
+    void setBlendFunc(GLenum src, GLenum dst)
+    {
+        if (this->blendSrc == src && this->blendDst == dst)
+        {
+            this->skipped++;
+            return;
+        }
+        this->blendSrc = src;
+        this->blendDst = dst;
+        this->issued++;
+        glBlendFunc(src, dst);
+    }
+};
+
+namespace vtx
+{
+    // One GL context, one cache
+    inline GlStateCache glState;
+}
@@ -1,6 +1,13 @@
 #pragma once
 
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
 #include "gl_header.h"
+#include "gl_state.h"
+#include "shader_cache.h"
 
 // ****************************
 //  1. OpenGL shader subsystem
@@ -34,25 +41,129 @@ static GLuint compileShader(GLenum type, const char *source)
     return shader;
 }
 
+static bool hasGlExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        if (strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void checkProgramLinked(GLuint program)
+{
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, nullptr, infoLog);
+        std::cerr << "ERROR::SHADER::LINKING_FAILED\n"
+                  << infoLog << std::endl;
+        exit(1);
+    }
+}
+
 namespace vtx
 {
+    /*
+     * Many programs at once. Everything is submitted before any status is
+     * asked for, so with KHR_parallel_shader_compile (ANGLE, Mesa) the driver
+     * compiles them all on its own threads. Without it this is just a loop.
+     * Programs come from the binary cache when they can.
+     */
+    void createShaderPrograms(
+        int count,
+        const char *const *vertexShaderSources,
+        const char *const *fragmentShaderSources,
+        GLuint *programs)
+    {
+        static int parallel = -1;
+        if (parallel < 0)
+        {
+            parallel = hasGlExtension("GL_KHR_parallel_shader_compile");
+            std::cerr << "Shaders: parallel compile " << (parallel ? "on" : "off")
+                      << ", program cache " << (shaderCacheUsable() ? shaderCacheDir() : "off") << std::endl;
+        }
+
+        bool useCache = shaderCacheUsable();
+        std::vector<std::string> cachePaths(count);
+        std::vector<bool> fromSource(count, false);
+
+        for (int i = 0; i < count; i++)
+        {
+            if (useCache)
+            {
+                cachePaths[i] = shaderCachePath(vertexShaderSources[i], fragmentShaderSources[i]);
+                programs[i] = loadCachedProgram(cachePaths[i]);
+                if (programs[i])
+                {
+                    continue;
+                }
+            }
+
+            // Kick off compile and link, no status queries here
+            GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+            glShaderSource(vertexShader, 1, &vertexShaderSources[i], nullptr);
+            glCompileShader(vertexShader);
+            GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+            glShaderSource(fragmentShader, 1, &fragmentShaderSources[i], nullptr);
+            glCompileShader(fragmentShader);
+
+            programs[i] = glCreateProgram();
+            if (useCache)
+            {
+                glProgramParameteri(programs[i], GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
+            glAttachShader(programs[i], vertexShader);
+            glAttachShader(programs[i], fragmentShader);
+            glLinkProgram(programs[i]);
+
+            // Only flagged, they go once the program lets go of them
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+            fromSource[i] = true;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            if (!fromSource[i])
+            {
+                continue;
+            }
+
+            GLint linked = GL_FALSE;
+            glGetProgramiv(programs[i], GL_LINK_STATUS, &linked);
+            if (!linked)
+            {
+                // Compile again the old way, it prints which stage failed and why
+                glDeleteProgram(programs[i]);
+                GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSources[i]);
+                GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSources[i]);
+                programs[i] = glCreateProgram();
+                glAttachShader(programs[i], vertexShader);
+                glAttachShader(programs[i], fragmentShader);
+                glLinkProgram(programs[i]);
+                checkProgramLinked(programs[i]);
+            }
+            if (useCache)
+            {
+                storeCachedProgram(cachePaths[i], programs[i]);
+            }
+        }
+    }
+
     GLuint createShaderProgram(
         const char *vertexShaderSource,
         const char *fragmentShaderSource)
     {
-        GLuint vertexShader =
-            compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-        GLuint fragmentShader =
-            compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-
-        GLuint shaderProgram = glCreateProgram();
-        glAttachShader(shaderProgram, vertexShader);
-        glAttachShader(shaderProgram, fragmentShader);
-        glLinkProgram(shaderProgram);
-
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-
+        GLuint shaderProgram;
+        createShaderPrograms(1, &vertexShaderSource, &fragmentShaderSource, &shaderProgram);
         return shaderProgram;
     }
 
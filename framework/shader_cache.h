@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "gl_header.h"
+
+// ****************************
+//  Program binary cache
+// ****************************
+//
+// Linked programs are saved with glGetProgramBinary and loaded back with
+// glProgramBinary next time, keyed by a hash of both sources and the driver.
+// A binary the driver rejects (driver update, different GPU) is deleted and
+// the program is compiled from source again.
+//
+// Lives in $VTX_SHADER_CACHE, or build/shader_cache. Not on the web,
+// WebGL has no program binaries (browsers cache shaders themselves).
+
+#if defined(__EMSCRIPTEN__)
+#define VTX_SHADER_CACHE_ENABLED 0
+#else
+#define VTX_SHADER_CACHE_ENABLED 1
+#endif
+
+#define SHADER_CACHE_MAGIC 0x48435053 // "SPCH"
+
+struct ShaderCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t format; // GLenum given by glGetProgramBinary
+    uint32_t length;
+};
+
+static uint64_t shaderCacheHash(uint64_t hash, const char *text)
+{
+    // FNV-1a
+    for (const char *c = text; *c; c++)
+    {
+        hash ^= (uint8_t)*c;
+        hash *= 0x100000001b3ull;
+    }
+    // Separator, so "ab"+"c" and "a"+"bc" differ
+    hash ^= 0xff;
+    hash *= 0x100000001b3ull;
+    return hash;
+}
+
+static const char *shaderCacheDir()
+{
+    const char *dir = getenv("VTX_SHADER_CACHE");
+    return dir ? dir : "build/shader_cache";
+}
+
+static bool shaderCacheUsable()
+{
+#if VTX_SHADER_CACHE_ENABLED
+    static int usable = -1;
+    if (usable < 0)
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        usable = formats > 0;
+        if (usable)
+        {
+            mkdir("build", 0755);
+            mkdir(shaderCacheDir(), 0755);
+        }
+    }
+    return usable;
+#else
+    return false;
+#endif
+}
+
+static std::string shaderCachePath(const char *vertexShaderSource, const char *fragmentShaderSource)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = shaderCacheHash(hash, vertexShaderSource);
+    hash = shaderCacheHash(hash, fragmentShaderSource);
+    // Binaries are only good for the exact same driver
+    hash = shaderCacheHash(hash, (const char *)glGetString(GL_VENDOR));
+    hash = shaderCacheHash(hash, (const char *)glGetString(GL_RENDERER));
+    hash = shaderCacheHash(hash, (const char *)glGetString(GL_VERSION));
+
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)hash);
+    return std::string(shaderCacheDir()) + name;
+}
+
+// Linked program from the cache, or 0 when missing or rejected
+static GLuint loadCachedProgram(const std::string &path)
+{
+#if VTX_SHADER_CACHE_ENABLED
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        return 0;
+    }
+
+    ShaderCacheFileHeader header;
+    std::vector<uint8_t> binary;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == SHADER_CACHE_MAGIC;
+    if (ok)
+    {
+        binary.resize(header.length);
+        ok = fread(binary.data(), 1, binary.size(), f) == binary.size();
+    }
+    fclose(f);
+
+    GLuint program = 0;
+    if (ok)
+    {
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    if (!program)
+    {
+        // Stale or broken, it will be written again after compiling
+        remove(path.c_str());
+        // Some drivers leave an error behind for a rejected binary
+        while (glGetError() != GL_NO_ERROR)
+        {
+        }
+    }
+    return program;
+#else
+    return 0;
+#endif
+}
+
+static void storeCachedProgram(const std::string &path, GLuint program)
+{
+#if VTX_SHADER_CACHE_ENABLED
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+
+    ShaderCacheFileHeader header;
+    std::vector<uint8_t> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+    header.magic = SHADER_CACHE_MAGIC;
+    header.format = format;
+    header.length = (uint32_t)length;
+
+    // Write then rename, so a crash never leaves half a binary behind
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f)
+    {
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(binary.data(), 1, binary.size(), f) == binary.size();
+    ok = fclose(f) == 0 && ok;
+    if (ok)
+    {
+        rename(tmp.c_str(), path.c_str());
+    }
+    else
+    {
+        remove(tmp.c_str());
+    }
+#endif
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "gl_header.h"
+
+/*
+ * Ring for data written every frame (instances, UI quads, glyphs, uniforms).
+ *
+ * One buffer split into FRAMES regions, a frame only writes its own region
+ * and fences it at the end, so by the time a region comes round again the
+ * GPU has normally finished reading it and writes need no sync. If it has
+ * not, the whole buffer is orphaned instead of waited on. A frame writing
+ * more than a region holds grows the buffer, keeping what the frame already
+ * wrote where it was, so offsets stay good until endStreamFrame(). That data
+ * straddles the bigger regions, so the next frame orphans again.
+ *
+ * Writes go through glMapBufferRange with UNSYNCHRONIZED | INVALIDATE_RANGE,
+ * glBufferSubData on WebGL, which has no mapping. The buffer name never
+ * changes, VAOs can point at it once, draws use the offset streamData returns.
+ */
+struct StreamBuffer
+{
+    static constexpr int FRAMES = 3;
+
+    GLenum target;
+    GLuint buffer = 0;
+    size_t frameCapacity = 0;
+    int frame = 0;
+    size_t regionStart = 0, regionEnd = 0; // Of this frame, in bytes from the buffer start
+    size_t cursor = 0;                     // Where the next write goes
+    GLsync fences[FRAMES] = {};
+    bool grown = false; // This frame's region is not where frameCapacity puts it
+
+    // For the debug UI
+    size_t frameBytes = 0;
+    size_t lastFrameBytes = 0;
+    uint32_t orphans = 0; // Since start, the first one is the allocation
+
+    void initStreamBuffer(GLenum target, size_t frameCapacity)
+    {
+        this->target = target;
+        this->frameCapacity = frameCapacity;
+        glGenBuffers(1, &this->buffer);
+        this->orphan();
+        this->regionEnd = frameCapacity;
+    }
+
+    // New storage from the driver, nothing written before is waited on
+    void orphan()
+    {
+        glBindBuffer(this->target, this->buffer);
+        glBufferData(this->target, FRAMES * this->frameCapacity, nullptr, GL_STREAM_DRAW);
+        for (GLsync &fence : this->fences)
+        {
+            if (fence)
+            {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        this->orphans++;
+    }
+
+    void beginStreamFrame()
+    {
+        this->frame = (this->frame + 1) % FRAMES;
+        this->regionStart = this->frame * this->frameCapacity;
+        this->regionEnd = this->regionStart + this->frameCapacity;
+        this->cursor = this->regionStart;
+        this->lastFrameBytes = this->frameBytes;
+        this->frameBytes = 0;
+
+        // The grown frame sits across other frames' regions of this storage
+        // with no fence of theirs covering it, start on fresh storage instead
+        if (this->grown)
+        {
+            this->grown = false;
+            this->orphan();
+            return;
+        }
+
+        GLsync &fence = this->fences[this->frame];
+        if (!fence)
+        {
+            return;
+        }
+        // Only asks, a zero timeout never blocks (and is all WebGL allows)
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        else
+        {
+            this->orphan();
+        }
+    }
+
+    void endStreamFrame()
+    {
+        GLsync &fence = this->fences[this->frame];
+        if (fence)
+        {
+            glDeleteSync(fence);
+        }
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // Copies `bytes` in and returns their offset in `buffer`, a multiple of
+    // `alignment` (the vertex stride lets draws start at offset / stride).
+    // Leaves `buffer` bound to `target`.
+    size_t streamData(const void *data, size_t bytes, size_t alignment)
+    {
+        if (bytes == 0)
+        {
+            return this->cursor; // Mapping nothing is an error
+        }
+        size_t offset = (this->cursor + alignment - 1) / alignment * alignment;
+        if (offset + bytes > this->regionEnd)
+        {
+            this->grow(offset + bytes - this->regionStart);
+        }
+        glBindBuffer(this->target, this->buffer);
+
+#ifdef __EMSCRIPTEN__
+        glBufferSubData(this->target, offset, bytes, data);
+#else
+        void *dst = glMapBufferRange(
+            this->target, offset, bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (dst)
+        {
+            memcpy(dst, data, bytes);
+            glUnmapBuffer(this->target);
+        }
+        else
+        {
+            glBufferSubData(this->target, offset, bytes, data);
+        }
+#endif
+
+        this->cursor = offset + bytes;
+        this->frameBytes += bytes;
+        return offset;
+    }
+
+    // Rare, so it can be slow: what this frame wrote may not be drawn yet,
+    // it goes out to a scratch buffer and back in at the same offset.
+    // This region keeps its start, from the next frame on they are all bigger
+    // and start on new storage (see beginStreamFrame).
+    void grow(size_t needed)
+    {
+        while (needed > this->frameCapacity)
+        {
+            this->frameCapacity *= 2;
+        }
+        std::cerr << "Stream buffer grown to " << this->frameCapacity << " bytes a frame" << std::endl;
+
+        size_t written = this->cursor - this->regionStart;
+        GLuint scratch = 0;
+        if (written > 0)
+        {
+            glGenBuffers(1, &scratch);
+            glBindBuffer(GL_COPY_READ_BUFFER, this->buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+            glBufferData(GL_COPY_WRITE_BUFFER, written, nullptr, GL_STREAM_COPY);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, this->regionStart, 0, written);
+        }
+
+        this->orphan();
+        this->regionEnd = this->regionStart + this->frameCapacity;
+        this->grown = true;
+
+        if (written > 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, scratch);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, this->regionStart, written);
+            glDeleteBuffers(1, &scratch);
+        }
+    }
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FRUSTUM_NEON 1
+#endif
+
+// Six planes pointing inwards, xyz normalised, w is the distance
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // Gribb & Hartmann, straight from the combined matrix
+    void fromViewProjection(const glm::mat4 &viewProjection)
+    {
+        glm::mat4 m = glm::transpose(viewProjection); // rows as columns
+        this->planes[0] = m[3] + m[0]; // left
+        this->planes[1] = m[3] - m[0]; // right
+        this->planes[2] = m[3] + m[1]; // bottom
+        this->planes[3] = m[3] - m[1]; // top
+        this->planes[4] = m[3] + m[2]; // near
+        this->planes[5] = m[3] - m[2]; // far
+        for (glm::vec4 &p : this->planes)
+        {
+            p /= glm::length(glm::vec3(p));
+        }
+    }
+};
+
+/*
+ * World space bounding spheres as structure of arrays, so one SIMD
+ * register holds the same field of 4 spheres. Arrays are padded to a
+ * multiple of 4, padding spheres are never visible.
+ */
+struct CullSpheres
+{
+    std::vector<float> x, y, z, radius;
+    std::vector<uint8_t> visible;
+    int count = 0;
+
+    void resizeCullSpheres(int n)
+    {
+        this->count = n;
+        int padded = (n + 3) & ~3;
+        this->x.assign(padded, 0.0f);
+        this->y.assign(padded, 0.0f);
+        this->z.assign(padded, 0.0f);
+        this->radius.assign(padded, -1.0f);
+        this->visible.assign(padded, 0);
+    }
+
+    void setSphere(int i, const glm::vec3 &centre, float r)
+    {
+        this->x[i] = centre.x;
+        this->y[i] = centre.y;
+        this->z[i] = centre.z;
+        this->radius[i] = r;
+    }
+
+    // Fills `visible`, 1 when the sphere touches the frustum
+    void cullSpheres(const Frustum &frustum)
+    {
+        int padded = (int)this->x.size();
+        for (int i = 0; i < padded; i += 4)
+        {
+#if FRUSTUM_SSE
+            __m128 px = _mm_loadu_ps(&this->x[i]);
+            __m128 py = _mm_loadu_ps(&this->y[i]);
+            __m128 pz = _mm_loadu_ps(&this->z[i]);
+            __m128 r = _mm_loadu_ps(&this->radius[i]);
+            __m128 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+            __m128 inside = _mm_cmpge_ps(r, _mm_setzero_ps()); // negative radius means padding
+            for (const glm::vec4 &p : frustum.planes)
+            {
+                __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(p.x)), _mm_mul_ps(py, _mm_set1_ps(p.y))),
+                    _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+                inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negR));
+            }
+            int mask = _mm_movemask_ps(inside);
+            for (int k = 0; k < 4; k++)
+            {
+                this->visible[i + k] = (mask >> k) & 1;
+            }
+#elif FRUSTUM_NEON
+            float32x4_t px = vld1q_f32(&this->x[i]);
+            float32x4_t py = vld1q_f32(&this->y[i]);
+            float32x4_t pz = vld1q_f32(&this->z[i]);
+            float32x4_t r = vld1q_f32(&this->radius[i]);
+            float32x4_t negR = vnegq_f32(r);
+            uint32x4_t inside = vcgeq_f32(r, vdupq_n_f32(0.0f)); // negative radius means padding
+            for (const glm::vec4 &p : frustum.planes)
+            {
+                float32x4_t d = vmlaq_n_f32(vdupq_n_f32(p.w), px, p.x);
+                d = vmlaq_n_f32(d, py, p.y);
+                d = vmlaq_n_f32(d, pz, p.z);
+                inside = vandq_u32(inside, vcgtq_f32(d, negR));
+            }
+            uint32_t lanes[4];
+            vst1q_u32(lanes, inside);
+            for (int k = 0; k < 4; k++)
+            {
+                this->visible[i + k] = lanes[k] != 0;
+            }
+#else
+            for (int k = i; k < i + 4; k++)
+            {
+                bool inside = this->radius[k] >= 0.0f;
+                for (const glm::vec4 &p : frustum.planes)
+                {
+                    inside &= p.x * this->x[k] + p.y * this->y[k] + p.z * this->z[k] + p.w > -this->radius[k];
+                }
+                this->visible[k] = inside;
+            }
+#endif
+        }
+    }
+};
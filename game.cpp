@@ -1,6 +1,4 @@
-#include <chrono>
 #include <iostream>
-#include <thread>
 #include <cstdint>
 
 #include <glm/gtc/quaternion.hpp>
@@ -8,20 +6,32 @@
 
 #include "framework/boot.h"
 
+#include "alley.h"
+#include "asset_pack.h"
 #include "aurora.h"
+#include "bench.h"
+#include "bot.h"
+#include "debugdraw.h"
 #include "fpscounter.h"
+#include "framepacer.h"
+#include "gputimer.h"
 #include "hooker.h"
 #include "mod_imgui.h"
 #include "mesh.h"
+#include "overdraw.h"
+#include "physics/lane.h"
 #include "physics/physics.h"
+#include "referee.h"
+#include "render_queue.h"
+#include "replay.h"
 #include "score.h"
-#include "all_assets.h"
+#include "shadow.h"
+#include "texture_streamer.h"
 #include "window.h"
 #include "ui/clayton.h"
 
-using Clock = std::chrono::high_resolution_clock;
-using TimePoint = std::chrono::time_point<Clock>;
-using Seconds = std::chrono::duration<double>;
+// Shadows are cast by a sun-like light from about where the point light sits
+static const glm::vec3 SHADOW_LIGHT_DIRECTION = glm::vec3(3.0f, 3.0f, 1.0f);
 
 struct UserContext
 {
@@ -40,18 +50,27 @@ struct UserContext
 
     bool fuckCakez = true;
     Aurora aurora;
+    DebugDraw debugDraw;
+    OverdrawView overdraw;
     FpsCounter fpsCounter;
-    uint64_t lastFrameTime = 0;
+    GpuTimer gpuTimer;
     uint64_t lastThrowTime = 0;
-    TimePoint last = Clock::now();
+    FramePacer pacer;
+    RenderBench bench;
     ModImgui imgui;
 
     float throwingTime;
     float settlingTime;
 
-    ShaderProgram mainShader;
+    ShaderPermutations mainShader;
+    FrameUniforms frameUniforms;
+    StreamBuffer vertexStream; // Instances, UI quads and glyphs, written every frame
+    ShadowMaps shadows;
+    RenderQueue renderQueue;
     Texture everythingTexture;
+    TextureStreamer textureStreamer;
 
+    AssetPack assets;
     AssetMesh ballMesh;
     AssetMesh laneMesh;
     AssetMesh pinMesh;
@@ -66,6 +85,7 @@ struct UserContext
     glm::vec3 ballStart;
 
     float launchSpeed;
+    float laneSpeed; // Down the lane, unscaled, the unit the strike table uses
     float endSpeed;
     glm::vec3 lastBallPosition;
     glm::vec2 aimFlatPos;
@@ -76,8 +96,38 @@ struct UserContext
     BowlingScoreboard board;
     int wereDead;
     Clayton clayton;
+
+    StrikeTable strikeTable;
+    BowlingBot bot;
+    bool botBowls = false;
+
+    Alley alley; // Every lane at once, the single lane game keeps going underneath
+
+    RefereeClient referee; // Online leagues, the server keeps the real score
+
+    ReplayRecorder recorder;
+    ReplayPlayer replayPlayer; // instant replay of the last throw
+    ReplayPlayer ghostPlayer;  // best throw, next to the live ball
+    bool replaying = false;
+    float replayTime = 0.0f;
 };
 
+// Again after the pack is swapped on disk, lane collision keeps the old shape
+static void sendPackMeshesToGpu(UserContext *usr)
+{
+    AssetMesh *meshes[3] = {&usr->ballMesh, &usr->laneMesh, &usr->pinMesh};
+    const char *names[3] = {"ball", "lane", "pin"};
+    for (int i = 0; i < 3; i++)
+    {
+        if (meshes[i]->meshVAO)
+        {
+            meshes[i]->releaseMeshBuffers();
+        }
+        MeshData md = usr->assets.meshFromPack(names[i]);
+        meshes[i]->sendMeshDataToGpu(&md);
+    }
+}
+
 void vtx::hang(vtx::VertexContext *ctx)
 {
     UserContext *usr = static_cast<UserContext *>(ctx->usrptr);
@@ -91,23 +141,13 @@ void vtx::load(vtx::VertexContext *ctx)
 
     usr->imgui.loadImgui(ctx);
     usr->aurora.loadAuroraShader();
-}
-
-// Convert array of Vertex to flat float array of positions
-// Vertex must have: glm::vec3 position
-static std::vector<float> extractPositions(const Vertex *verts, size_t count)
-{
-    std::vector<float> out;
-    out.reserve(count * 3);
-
-    for (size_t i = 0; i < count * 3; ++i)
-    {
-        out.push_back(verts[i].position.x);
-        out.push_back(verts[i].position.y);
-        out.push_back(verts[i].position.z);
-    }
+    usr->debugDraw.loadDebugDrawShader();
+    usr->overdraw.loadOverdrawShader();
+    usr->shadows.loadShadowShader();
+    usr->gpuTimer.loadGpuTimer();
 
-    return out;
+    // Old function pointer points into the unloaded library
+    usr->phy.stepListener = ReplayRecorder::onPhysicsStep;
 }
 
 void vtx::init(vtx::VertexContext *ctx)
@@ -131,17 +171,37 @@ void vtx::init(vtx::VertexContext *ctx)
     printShaderVersions();
     checkOpenGLError("INIT_GAME_TAG");
 
+    // Before anything that points a VAO at it
+    usr->vertexStream.initStreamBuffer(GL_ARRAY_BUFFER, 1024 * 1024);
     usr->aurora.initAurora();
+    usr->debugDraw.initDebugDraw(&usr->vertexStream);
+    usr->overdraw.initOverdrawView();
     usr->fpsCounter.initFpsCounter();
-
-    usr->mainShader.initDefaultShaderProgram();
-    usr->everythingTexture.loadTextureFromFile("assets/files/everything_tex.png");
-    MeshData ballMd = loadMeshFromBlob(ball_mesh_data, ball_mesh_data_len);
-    usr->ballMesh.sendMeshDataToGpu(&ballMd);
-    MeshData laneMd = loadMeshFromBlob(lane_mesh_data, lane_mesh_data_len);
-    usr->laneMesh.sendMeshDataToGpu(&laneMd);
-    MeshData pinMd = loadMeshFromBlob(pin_mesh_data, pin_mesh_data_len);
-    usr->pinMesh.sendMeshDataToGpu(&pinMd);
+    usr->pacer.initFramePacer(ctx);
+    usr->bench.initRenderBench();
+    usr->alley.enabled = getenv("VTX_ALLEY") != nullptr; // e.g. to bench the whole alley
+    if (usr->bench.enabled)
+    {
+        // As fast as it goes, the bot plays
+        usr->pacer.setTargetFps(FramePacer::UNCAPPED);
+        usr->botBowls = true;
+    }
+    usr->gpuTimer.initGpuTimer();
+
+    usr->frameUniforms.initFrameUniforms();
+    usr->mainShader.initShaderPermutations();
+    usr->shadows.initShadowMaps();
+    usr->textureStreamer.initTextureStreamer();
+    // Compressed is quick to upload as is, the PNG decodes in the background and is white till then
+    if (!usr->everythingTexture.loadTextureFromKtx("assets/files/everything_tex.ktx"))
+    {
+        usr->textureStreamer.requestTexture("assets/files/everything_tex.png", usr->everythingTexture);
+    }
+    if (!usr->assets.openAssetPack("assets/files/bowling.pack"))
+    {
+        exit(1);
+    }
+    sendPackMeshesToGpu(usr);
 
     {
         const glm::vec3 eye = glm::vec3(4.0f);
@@ -151,68 +211,57 @@ void vtx::init(vtx::VertexContext *ctx)
         usr->cameraMat = glm::lookAt(eye, center, up);
     }
 
-    auto lanePositions = extractPositions(laneMd.vertices, laneMd.vertexCount);
-
-    {
-        const float h = 0.35f;
-        const float ft = 0.305f;
-        const float offset = 0.87f - 3.0f * ft;
-        const float l0 = offset - 0.0 * ft * glm::cos(glm::radians(30.0f));
-        usr->initialPins[0] = glm::vec3(-0.0f, h, l0);
-
-        const float l1 = offset + 1.0 * ft * glm::cos(glm::radians(30.0f));
-        usr->initialPins[1] = glm::vec3(-0.5f * ft, h, l1);
-        usr->initialPins[2] = glm::vec3(+0.5f * ft, h, l1);
-
-        const float l2 = offset + 2.0f * ft * glm::cos(glm::radians(30.0f));
-        usr->initialPins[3] = glm::vec3(-ft, h, l2);
-        usr->initialPins[4] = glm::vec3(-0.0f * ft, h, l2);
-        usr->initialPins[5] = glm::vec3(+ft, h, l2);
-
-        const float l3 = offset + 3.0f * ft * glm::cos(glm::radians(30.0f));
-        usr->initialPins[6] = glm::vec3(-1.5f * ft, h, l3);
-        usr->initialPins[7] = glm::vec3(-0.5f * ft, h, l3);
-        usr->initialPins[8] = glm::vec3(+0.5f * ft, h, l3);
-        usr->initialPins[9] = glm::vec3(+1.5f * ft, h, l3);
-    }
+    MeshData laneMd = usr->assets.meshFromPack("lane");
+    auto lanePositions = meshPositions(laneMd);
+    auto laneIndices = meshIndices(laneMd);
 
-    usr->ballStart = glm::vec3(0.0f, 4.0f, -8.0f);
+    lane_rack_pins(usr->initialPins);
+    usr->ballStart = LANE_BALL_START;
 
     usr->phy.physics_init(
         lanePositions.data(), // number of floats
         lanePositions.size(), // number of floats
-        laneMd.indices,
-        laneMd.indexCount,
+        laneIndices.data(),
+        laneIndices.size(),
         usr->initialPins,
         usr->ballStart);
 
     usr->phase = UserContext::Phase::IDLE;
     resetScoreboard(usr->board);
 
-    usr->clayton.initClayton(ctx->screenWidth, ctx->screenHeight, 1024);
+    usr->clayton.initClayton(ctx->screenWidth, ctx->screenHeight, 1024, &usr->vertexStream);
+
+    // Made offline by strikegen, the game works without it
+    usr->strikeTable.openStrikeTable("assets/files/strike.tbl");
+    usr->bot.initBowlingBot(&usr->strikeTable, 0.8f, 12345);
+
+    usr->recorder.initReplayRecorder(512 * 1024);
+    usr->phy.stepListener = ReplayRecorder::onPhysicsStep;
+    usr->phy.stepListenerUser = &usr->recorder;
+    usr->ghostPlayer.playReplay(&usr->recorder.bestThrow);
+
+    usr->referee.initRefereeClient();
 }
 
 void vtx::loop(vtx::VertexContext *ctx)
 {
     UserContext *usr = static_cast<UserContext *>(ctx->usrptr);
 
-    volatile uint64_t currentTime = SDL_GetTicks64();
-    float deltaTime = (currentTime - usr->lastFrameTime) / 1000.0f;
+    // Waits here, so input below is as fresh as it gets
+    float deltaTime = usr->pacer.waitForNextFrame();
+    uint64_t currentTime = SDL_GetTicks64();
+    if (usr->bench.enabled)
+    {
+        deltaTime = usr->bench.benchDeltaTime();
+        currentTime = usr->bench.benchTimeMs();
+        usr->bench.beginBenchFrame();
+        usr->gpuTimer.frameTotalsMs = usr->bench.measuring() ? &usr->bench.gpuMs : nullptr;
+    }
 
-#ifndef __EMSCRIPTEN__
+    if (usr->assets.pollAssetPack(deltaTime))
     {
-        TimePoint now = Clock::now();
-        Seconds dt = now - usr->last;
-        const double targetDelta = 1.0 / 60.0;
-        if (dt.count() < targetDelta)
-        {
-            double sleepTime = targetDelta - dt.count();
-            std::this_thread::sleep_for(Seconds(sleepTime) - Seconds(0.001f));
-            return;
-        }
-        usr->last = now;
+        sendPackMeshesToGpu(usr);
     }
-#endif
 
     float screenRatio = static_cast<float>(ctx->screenWidth) / ctx->screenHeight;
 
@@ -235,6 +284,26 @@ void vtx::loop(vtx::VertexContext *ctx)
                 usr->phase = UserContext::Phase::IDLE;
                 usr->wereDead = 0;
             }
+            if (e.key.keysym.sym == SDLK_F3)
+            {
+                usr->phy.debugDrawEnabled = !usr->phy.debugDrawEnabled;
+            }
+            if (e.key.keysym.sym == SDLK_F6)
+            {
+                usr->alley.enabled = !usr->alley.enabled;
+            }
+            if (e.key.keysym.sym == SDLK_F7)
+            {
+                usr->overdraw.enabled = !usr->overdraw.enabled;
+            }
+            if (e.key.keysym.sym == SDLK_r &&
+                (usr->phase == UserContext::Phase::IDLE || usr->phase == UserContext::Phase::RESULT) &&
+                !usr->recorder.lastThrow.isEmpty())
+            {
+                usr->replaying = true;
+                usr->replayTime = 0.0f;
+                usr->replayPlayer.playReplay(&usr->recorder.lastThrow);
+            }
         }
 
         if (usr->phase == UserContext::Phase::IDLE)
@@ -256,6 +325,7 @@ void vtx::loop(vtx::VertexContext *ctx)
                 SDL_SetRelativeMouseMode(SDL_TRUE);
 
                 usr->launchSpeed = 0.0f;
+                usr->laneSpeed = 0.0f;
                 usr->endSpeed = 0.0f;
 
                 usr->spinSpeed = 0.0f;
@@ -276,6 +346,9 @@ void vtx::loop(vtx::VertexContext *ctx)
                 SDL_SetRelativeMouseMode(SDL_FALSE);
 
                 usr->phy.enable_physics_on_ball();
+                usr->referee.sendThrow(usr->phy.lastLaunch);
+                usr->recorder.markThrowStart(true);
+                usr->replaying = false;
                 usr->lastThrowTime = currentTime;
 
                 usr->throwingTime = 0.0f;
@@ -342,6 +415,25 @@ void vtx::loop(vtx::VertexContext *ctx)
         }
     }
 
+    usr->referee.pollRefereeClient();
+
+    // Bot takes the IDLE ball by itself, a table lookup instead of a hand
+    if (usr->botBowls && usr->phase == UserContext::Phase::IDLE && currentTime > usr->lastThrowTime + 1'500)
+    {
+        BotThrow bt;
+        if (usr->bot.pickThrow(&bt))
+        {
+            lane_launch(usr->phy, bt.x, bt.speed, bt.spin);
+            usr->referee.sendThrow(usr->phy.lastLaunch);
+            usr->recorder.markThrowStart(false);
+            usr->spinSpeed = bt.spin;
+            usr->lastThrowTime = currentTime;
+            usr->throwingTime = 0.0f;
+            usr->settlingTime = 0.0f;
+            usr->phase = UserContext::Phase::THROW;
+        }
+    }
+
     float TUNE = 200.0f;
 
     float yFactor = 0.0f;
@@ -439,7 +531,7 @@ void vtx::loop(vtx::VertexContext *ctx)
             }
             usr->spinSpeed = spin;
 
-            glm::vec3 start = glm::vec3(0.0f, 0.2f, -18.0f);
+            glm::vec3 start = LANE_RELEASE_POINT;
 
             glm::vec3 carriedBall = start + usr->aimCurr * 1.5f; // some forgiveness
             if (deltaTime > glm::epsilon<float>())
@@ -464,6 +556,9 @@ void vtx::loop(vtx::VertexContext *ctx)
                     // Update speed to reflect the corrected movement
                     usr->launchSpeed = maxSpeed;
                 }
+                // launchSpeed is 3D and went through the forgiveness scale,
+                // the table wants how fast the ball really heads for the pins
+                usr->laneSpeed = (carriedBall.z - usr->lastBallPosition.z) / deltaTime;
             }
 
             usr->totalSpinAngle += usr->spinSpeed; // * deltaTime;
@@ -498,6 +593,8 @@ void vtx::loop(vtx::VertexContext *ctx)
             );
             if (state != -1)
             {
+                usr->recorder.finishThrow(state - usr->wereDead);
+                usr->ghostPlayer.playReplay(&usr->recorder.bestThrow); // it may have changed
                 bool frameCompleted = addRoll(&usr->board, state - usr->wereDead);
 
                 usr->wereDead += state;
@@ -529,57 +626,169 @@ void vtx::loop(vtx::VertexContext *ctx)
 
     usr->lastBallPosition = ballModel[3];
 
+    // Replay and ghost come from the recorder only, Jolt is not touched
+    glm::mat4 pinMatrices[10];
+    for (int i = 0; i < 10; i++)
+    {
+        pinMatrices[i] = usr->phy.physics_get_pin_matrix(i);
+    }
+    if (usr->replaying)
+    {
+        usr->replayTime += deltaTime;
+        if (usr->replayTime > usr->recorder.lastThrow.duration() ||
+            !usr->replayPlayer.sampleReplay(usr->replayTime, &ballModel, pinMatrices))
+        {
+            usr->replaying = false;
+        }
+    }
+    bool showGhost = false;
+    glm::mat4 ghostModel;
+    if (usr->phase == UserContext::Phase::THROW && !usr->recorder.bestThrow.isEmpty())
+    {
+        showGhost = usr->ghostPlayer.sampleReplay(
+            usr->throwingTime + usr->settlingTime, &ghostModel, nullptr);
+    }
+
     usr->cameraMat = glm::lookAt(
         glm::vec3(0.0f, 0.8f, glm::clamp(ballModel[3].z - 3.0f, -21.0f, -2.0f)), // eye in before of the ball
         glm::vec3(0.0f, -1.0f, glm::clamp(ballModel[3].z + 4.5f, -12.0f, 2.0f)), // target after
         glm::vec3(0.0f, 1.0f, 0.0f)                                              // up
     );
+    glm::mat4 projectionMat = usr->perspectiveMat;
+
+    if (usr->alley.enabled)
+    {
+        if (!usr->alley.initialised)
+        {
+            usr->alley.initAlley(usr->assets.meshFromPack("lane"), &usr->strikeTable);
+        }
+        usr->alley.updateAlley(deltaTime);
+        usr->alley.alleyCamera(currentTime / 1000.0f, screenRatio, usr->cameraMat, projectionMat);
+    }
 
     /* 3D render zone */ {
 
+        // ImGui and the last frame were here, start from nothing known
+        vtx::glState.invalidate();
+        vtx::glState.resetStateCounters();
+        usr->gpuTimer.beginGpuFrame();
+        usr->textureStreamer.pumpUploads();
+        usr->vertexStream.beginStreamFrame();
+        usr->frameUniforms.stream.beginStreamFrame();
+
+        // Clear obeys the depth mask, UI leaves it off
+        vtx::glState.setEnabled(GlStateCache::CAP_DEPTH_TEST, true);
+        vtx::glState.setDepthMask(true);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glClearColor(0.1f, 0.2f, 0.1f, 1.0f);
+        if (usr->overdraw.enabled)
+        {
+            usr->overdraw.beginOverdrawCount();
+        }
 
-        glEnable(GL_DEPTH_TEST);
-        glDepthMask(GL_TRUE); // prevent writing to the depth buffer
-
-        usr->aurora.renderAurora(deltaTime * TUNE, glm::inverse(usr->cameraMat)); //  * projectionMatrix);
+        // Opaque meshes first, then the sky where they left nothing, then the see-through debug overlay.
+        // Frame uniforms go up right before the meshes, the shadow matrices are only known then.
+        glm::vec3 lightPos = glm::vec3(3.0f, 3.0f, glm::clamp(usr->cameraMat[3].z + 6.0f, -100.0f, -7.0f));
 
-        usr->mainShader.updateLightPos(glm::vec3(3.0f, 3.0f, glm::clamp(usr->cameraMat[3].z + 6.0f, -100.0f, -7.0f)));
-        usr->mainShader.updateDiffuseTexture(usr->everythingTexture);
-        usr->mainShader.updateTextureParamsInOneGo(
-            glm::vec3(1.0f, 1.0f, 1.0f), // Texture density
-            glm::vec2(1.0f, 1.0f),       // Size of one tile compared to full atlas
-            glm::vec2(1.0f),             // Atlas region start
-            1.0f                         // Atlas region scale compared to entire atlas
-        );
+        Frustum frustum;
+        frustum.fromViewProjection(projectionMat * usr->cameraMat);
+        GLuint texture = usr->everythingTexture.id;
 
-        for (int i = 0; i < 10; i++)
+        if (usr->alley.enabled)
         {
-            if (usr->phy.mPinDead[i])
+            usr->alley.fillAlleyInstances(
+                usr->laneMesh, usr->pinMesh, usr->ballMesh,
+                frustum, usr->cameraMat, projectionMat, (float)ctx->screenHeight,
+                usr->vertexStream);
+
+            // Shadow maps are fit to one lane, over the alley they would be a few texels a pin
+            usr->mainShader.shadowsEnabled = false;
+            usr->frameUniforms.updateFrameUniforms(
+                projectionMat, usr->cameraMat, lightPos,
+                usr->shadows.staticMap.lightSpaceMatrix, usr->shadows.dynamicMap.lightSpaceMatrix);
+            AssetMesh *meshes[] = {&usr->laneMesh, &usr->pinMesh, &usr->ballMesh};
+            for (AssetMesh *mesh : meshes)
+            {
+                usr->renderQueue.pushMesh(
+                    usr->mainShader, *mesh, texture, glm::mat4(1.0f),
+                    RENDER_OPAQUE, meshViewDepth(*mesh, glm::mat4(1.0f), usr->cameraMat));
+            }
+            usr->gpuTimer.beginPass("meshes");
+            usr->renderQueue.submitRenderQueue();
+            usr->gpuTimer.endPass();
+        }
+        else
+        {
+            // Whole deck in one draw, pose of every pin goes into its instance
+            usr->pinMesh.setInstanceCount(10);
+            for (int i = 0; i < 10; i++)
+            {
+                float halfHeight = 0.19f;
+                glm::mat4 pinModel = glm::translate(pinMatrices[i], glm::vec3(0.0f, -halfHeight, 0.0f));
+                usr->pinMesh.setInstanceTransform(i, pinModel);
+            }
+            usr->pinMesh.cullInstances(frustum, glm::mat4(1.0f));
+            usr->pinMesh.selectLods(glm::mat4(1.0f), usr->cameraMat, projectionMat, (float)ctx->screenHeight);
+            usr->pinMesh.sendInstanceDataToGpu(usr->vertexStream);
+
+            // Ghost is one more instance of the ball, tinted in the shader
+            usr->ballMesh.setInstanceCount(showGhost ? 2 : 1);
+            usr->ballMesh.setInstanceTransform(0, ballModel);
+            if (showGhost)
+            {
+                usr->ballMesh.setInstanceTransform(1, ghostModel);
+                usr->ballMesh.setInstanceGhost(1, true);
+            }
+            usr->ballMesh.cullInstances(frustum, glm::mat4(1.0f));
+            usr->ballMesh.selectLods(glm::mat4(1.0f), usr->cameraMat, projectionMat, (float)ctx->screenHeight);
+            usr->ballMesh.sendInstanceDataToGpu(usr->vertexStream);
+
+            // Lane shadow is redrawn only when the light turns, the deck every frame
+            glm::mat4 laneModel = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -.0f, .0f));
+            if (usr->laneMesh.instanced)
             {
-                // continue;
+                usr->laneMesh.resetInstances(); // Alley view left every lane in it
             }
-            glm::mat4 pinModel = usr->phy.physics_get_pin_matrix(i);
-            float halfHeight = 0.19f;
-            pinModel = glm::translate(pinModel, glm::vec3(0.0f, -halfHeight, 0.0f));
-            usr->mainShader.renderRealMesh(
-                usr->pinMesh,
-                pinModel,
-                usr->cameraMat,
-                usr->perspectiveMat);
+            usr->gpuTimer.beginPass("shadows");
+            usr->shadows.updateStaticShadowMap(usr->laneMesh, laneModel, SHADOW_LIGHT_DIRECTION);
+            AssetMesh *casters[] = {&usr->pinMesh, &usr->ballMesh};
+            usr->shadows.updateDynamicShadowMap(casters, 2);
+            usr->gpuTimer.endPass();
+            usr->mainShader.updateDepthMaps(usr->shadows.staticMap.texture, usr->shadows.dynamicMap.texture);
+            usr->frameUniforms.updateFrameUniforms(
+                projectionMat, usr->cameraMat, lightPos,
+                usr->shadows.staticMap.lightSpaceMatrix, usr->shadows.dynamicMap.lightSpaceMatrix);
+
+            usr->renderQueue.pushMesh(
+                usr->mainShader, usr->pinMesh, texture, glm::mat4(1.0f),
+                RENDER_OPAQUE, meshViewDepth(usr->pinMesh, glm::mat4(1.0f), usr->cameraMat));
+            usr->renderQueue.pushMesh(
+                usr->mainShader, usr->ballMesh, texture, glm::mat4(1.0f),
+                RENDER_OPAQUE, meshViewDepth(usr->ballMesh, glm::mat4(1.0f), usr->cameraMat));
+            usr->renderQueue.pushMesh(
+                usr->mainShader, usr->laneMesh, texture, laneModel,
+                RENDER_OPAQUE, meshViewDepth(usr->laneMesh, laneModel, usr->cameraMat));
+            usr->gpuTimer.beginPass("meshes");
+            usr->renderQueue.submitRenderQueue();
+            usr->gpuTimer.endPass();
         }
 
-        usr->mainShader.renderRealMesh(
-            usr->ballMesh,
-            ballModel,
-            usr->cameraMat,
-            usr->perspectiveMat);
-        usr->mainShader.renderRealMesh(
-            usr->laneMesh,
-            glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -.0f, .0f)),
-            usr->cameraMat,
-            usr->perspectiveMat);
+        usr->gpuTimer.beginPass("aurora");
+        usr->aurora.renderAurora(deltaTime * TUNE, glm::inverse(usr->cameraMat)); //  * projectionMatrix);
+        usr->gpuTimer.endPass();
+
+        if (!usr->alley.enabled)
+        {
+            usr->gpuTimer.beginPass("debug");
+            usr->debugDraw.renderDebugDraw(usr->phy, usr->cameraMat, projectionMat);
+            usr->gpuTimer.endPass();
+        }
+
+        // UI below is not counted, it is the 3D scene we are after
+        if (usr->overdraw.enabled)
+        {
+            usr->overdraw.renderOverdrawCount();
+        }
 
         {
             const glm::vec3 eye = glm::vec3(4.0f);
@@ -593,8 +802,9 @@ void vtx::loop(vtx::VertexContext *ctx)
     }
 
     /* Clay zone */ {
-        glDisable(GL_DEPTH_TEST);
-        glDepthMask(GL_FALSE); // prevent writing to the depth buffer
+        vtx::glState.setEnabled(GlStateCache::CAP_DEPTH_TEST, false);
+        vtx::glState.setDepthMask(false); // prevent writing to the depth buffer
+        vtx::glState.setEnabled(GlStateCache::CAP_BLEND, true);
 
         Clay_SetDebugModeEnabled(true);
         Clay_SetLayoutDimensions((Clay_Dimensions){
@@ -709,7 +919,9 @@ void vtx::loop(vtx::VertexContext *ctx)
 
         usr->clayton.renderer.screenWidth = ctx->screenWidth;
         usr->clayton.renderer.screenHeight = ctx->screenHeight;
+        usr->gpuTimer.beginPass("clay");
         usr->clayton.renderClayton(cmds);
+        usr->gpuTimer.endPass();
     }
 
     /* Imgui zone */ {
@@ -720,6 +932,20 @@ void vtx::loop(vtx::VertexContext *ctx)
                     usr->fpsCounter.fps,
                     ctx->screenWidth,
                     ctx->screenHeight);
+        {
+            static const int targets[] = {60, 120, 144, FramePacer::UNCAPPED};
+            for (int target : targets)
+            {
+                char label[16];
+                snprintf(label, sizeof(label), target ? "%d" : "uncapped", target);
+                if (ImGui::RadioButton(label, usr->pacer.targetFps == target))
+                {
+                    usr->pacer.setTargetFps(target);
+                }
+                ImGui::SameLine();
+            }
+            ImGui::Text("target");
+        }
         ImGui::Text("yFacotr: %.3f", yFactor);
         ImGui::Text("Rolling time: %.3f", usr->throwingTime);
         ImGui::Text("Settling time: %.3f", usr->settlingTime);
@@ -728,9 +954,107 @@ void vtx::loop(vtx::VertexContext *ctx)
         // ImGui::Text("Launch speed: %.3f", usr->launchSpeed);
         ImGui::Text("End speed: %.3f", usr->endSpeed);
 
+        PhysicsMemoryStats mem;
+        usr->phy.physics_get_memory_stats(&mem);
+        ImGui::Text("Physics heap: %zu KB (peak %zu KB, pool %zu KB)",
+                    mem.liveBytes[PhysicsMemoryStats::GENERAL] / 1024,
+                    mem.peakBytes[PhysicsMemoryStats::GENERAL] / 1024,
+                    mem.generalPoolBytes / 1024);
+        ImGui::Text("Physics aligned: %zu KB (peak %zu KB)",
+                    mem.liveBytes[PhysicsMemoryStats::ALIGNED] / 1024,
+                    mem.peakBytes[PhysicsMemoryStats::ALIGNED] / 1024);
+        ImGui::Text("Physics temp: %zu / %zu KB (overflows %llu)",
+                    mem.tempHighWater / 1024,
+                    mem.tempCapacity / 1024,
+                    (unsigned long long)mem.tempOverflows);
+        ImGui::Text("Lane shadow redraws: %d", usr->shadows.staticRenders);
+        ImGui::Checkbox("Whole alley (F6)", &usr->alley.enabled);
+        ImGui::Checkbox("Overdraw (F7)", &usr->overdraw.enabled);
+        if (usr->overdraw.enabled)
+        {
+            // Legend, fragments per pixel
+            for (int i = 0; i < OverdrawView::BANDS; i++)
+            {
+                const float *c = OverdrawView::BAND_COLORS[i];
+                ImGui::SameLine();
+                ImGui::TextColored(ImVec4(c[0], c[1], c[2], 1.0f), i == OverdrawView::BANDS - 1 ? "%d+" : "%d", i);
+            }
+        }
+        if (usr->alley.enabled && usr->alley.initialised)
+        {
+            ImGui::Text("Alley physics: %.2f ms, %d throws rolling, %d pins drawn",
+                        usr->alley.lastStepMs,
+                        usr->alley.throwsInFlight,
+                        usr->pinMesh.lodFirstInstance[MESH_MAX_LODS]);
+        }
+        if (usr->gpuTimer.supported)
+        {
+            for (int i = 0; i < usr->gpuTimer.passCount; i++)
+            {
+                ImGui::Text("GPU %-8s %6.3f ms (avg %6.3f)",
+                            usr->gpuTimer.passNames[i],
+                            usr->gpuTimer.passMs[i],
+                            usr->gpuTimer.passMsAverage[i]);
+            }
+        }
+        ImGui::Text("Draws queued: %d, GL state calls %u (skipped %u)",
+                    usr->renderQueue.lastItemCount,
+                    vtx::glState.issued,
+                    vtx::glState.skipped);
+        ImGui::Text("Streamed last frame: %zu KB, ring orphaned %u times",
+                    usr->vertexStream.lastFrameBytes / 1024,
+                    usr->vertexStream.orphans);
+        ImGui::Text("Textures streaming: %d, upload %.3f ms",
+                    usr->textureStreamer.pendingCount,
+                    usr->textureStreamer.lastUploadMs);
+
         if (usr->phase == UserContext::Phase::AIM)
         {
             ImGui::Text("pos left right: %.3f", usr->aimStart.x);
+
+            const StrikeCell *hint = usr->strikeTable.lookup(
+                usr->lastBallPosition.x - LANE_RELEASE_POINT.x,
+                usr->laneSpeed,
+                usr->spinSpeed);
+            if (hint)
+            {
+                ImGui::Text("Aim assist: %d%% strike, %.1f pins",
+                            hint->strikeChance * 100 / 255,
+                            hint->expectedPins / 25.0f);
+            }
+        }
+
+        if (usr->referee.enabled)
+        {
+            ImGui::Text("Referee: %s, total %d (ours %d), last roll %d pins, %d waiting",
+                        acl::refereeConnected() ? "connected" : "offline",
+                        usr->referee.total,
+                        usr->board.totalScore,
+                        usr->referee.lastPins,
+                        usr->referee.sent - usr->referee.answered);
+            if (!usr->referee.lastError.empty())
+            {
+                ImGui::Text("Referee said: %s", usr->referee.lastError.c_str());
+            }
+        }
+
+        if (!usr->recorder.lastThrow.isEmpty())
+        {
+            ImGui::Text("Last throw: %zu KB, best: %d pins (%zu KB)",
+                        usr->recorder.lastThrow.data.size() / 1024,
+                        usr->recorder.bestThrow.pinsDown,
+                        usr->recorder.bestThrow.data.size() / 1024);
+        }
+        if (usr->replaying)
+        {
+            // Dragging this seeks
+            ImGui::SliderFloat("Replay", &usr->replayTime, 0.0f, usr->recorder.lastThrow.duration());
+        }
+
+        if (usr->strikeTable.isLoaded())
+        {
+            ImGui::Checkbox("Bot bowls", &usr->botBowls);
+            ImGui::SliderFloat("Bot skill", &usr->bot.skill, 0.0f, 1.0f);
         }
         ImGui::End(); // Jerunda end
 
@@ -756,14 +1080,25 @@ void vtx::loop(vtx::VertexContext *ctx)
                 usr->phase = UserContext::Phase::IDLE;
                 std::cerr << textScoreboard(usr->board) << std::endl;
                 resetScoreboard(usr->board);
+                usr->referee.sendNewGame();
             }
             ImGui::End();
         }
 
+        usr->gpuTimer.beginPass("imgui");
         usr->imgui.endImgui();
+        usr->gpuTimer.endPass();
+        usr->gpuTimer.endGpuFrame(deltaTime);
+
+        // Regions written this frame are not touched again till the GPU is past here
+        usr->vertexStream.endStreamFrame();
+        usr->frameUniforms.stream.endStreamFrame();
     }
 
-    SDL_GL_SwapWindow(ctx->sdlWindow);
+    if (usr->bench.enabled && !usr->bench.endBenchFrame(ctx))
+    {
+        ctx->shouldContinue = false;
+    }
 
-    usr->lastFrameTime = currentTime;
+    SDL_GL_SwapWindow(ctx->sdlWindow);
 }
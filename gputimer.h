@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "framework/boot.h"
+#include "framework/gl_util.h"
+
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+/*
+ * GPU time per render pass, from TIME_ELAPSED queries.
+ *
+ * Queries of a frame are only read FRAMES_IN_FLIGHT frames later, and only
+ * when the driver says they are ready, so timing never waits on the GPU.
+ * If a slot is still busy when it comes round again that frame is simply
+ * not timed. Passes can not nest, one query is active at a time.
+ *
+ * GL_EXT_disjoint_timer_query on GLES/WebGL, GL_ARB_timer_query (core 3.3)
+ * on desktop. Without either it does nothing and `supported` is false.
+ */
+struct GpuTimer
+{
+    static constexpr int FRAMES_IN_FLIGHT = 4;
+    static constexpr int MAX_PASSES = 8;
+
+    typedef void (*GetQueryObjectui64v)(GLuint id, GLenum pname, GLuint64 *params);
+
+    struct Frame
+    {
+        GLuint queries[MAX_PASSES];
+        const char *names[MAX_PASSES];
+        int passCount = 0;
+        bool pending = false;
+    };
+
+    bool supported = false;
+    bool disjointExt = false; // GLES flavour, results can be thrown away by the driver
+    GetQueryObjectui64v getQueryObjectui64v = nullptr;
+
+    Frame frames[FRAMES_IN_FLIGHT];
+    int frameIndex = 0;
+    Frame *current = nullptr; // nullptr when this frame is not timed
+    bool passOpen = false;
+
+    // Latest and averaged results, in ms, by pass name
+    const char *passNames[MAX_PASSES];
+    float passMs[MAX_PASSES];
+    float passMsAverage[MAX_PASSES];
+    int passCount = 0;
+
+    // When set, the summed time of every collected frame goes here (see RenderBench)
+    std::vector<float> *frameTotalsMs = nullptr;
+
+    // Log like FpsCounter, every 5 s
+    float logAccumulator = 0.0f;
+    float msSum[MAX_PASSES];
+    int msSamples[MAX_PASSES];
+
+    void initGpuTimer()
+    {
+        if (hasGlExtension("GL_EXT_disjoint_timer_query") ||
+            hasGlExtension("GL_EXT_disjoint_timer_query_webgl2"))
+        {
+            this->disjointExt = true;
+            this->getQueryObjectui64v = (GetQueryObjectui64v)SDL_GL_GetProcAddress("glGetQueryObjectui64vEXT");
+        }
+        else if (hasGlExtension("GL_ARB_timer_query"))
+        {
+            this->getQueryObjectui64v = (GetQueryObjectui64v)SDL_GL_GetProcAddress("glGetQueryObjectui64v");
+        }
+        this->supported = this->getQueryObjectui64v != nullptr;
+        std::cerr << "GPU timer queries: " << (this->supported ? (this->disjointExt ? "EXT_disjoint" : "ARB") : "not available") << std::endl;
+        if (!this->supported)
+        {
+            return;
+        }
+
+        for (Frame &f : this->frames)
+        {
+            glGenQueries(MAX_PASSES, f.queries);
+        }
+        for (int i = 0; i < MAX_PASSES; i++)
+        {
+            this->passMsAverage[i] = 0.0f;
+            this->msSum[i] = 0.0f;
+            this->msSamples[i] = 0;
+        }
+        checkOpenGLError("INIT_GPU_TIMER");
+    }
+
+    // Names point into the old library after a hot reload, forget them
+    void loadGpuTimer()
+    {
+        this->passCount = 0;
+        for (Frame &f : this->frames)
+        {
+            f.pending = false;
+        }
+        for (int i = 0; i < MAX_PASSES; i++)
+        {
+            this->msSum[i] = 0.0f;
+            this->msSamples[i] = 0;
+        }
+    }
+
+    void beginGpuFrame()
+    {
+        if (!this->supported)
+        {
+            return;
+        }
+
+        // Driver lost track of time (power state, context switch), nothing in flight can be trusted
+        bool disjoint = false;
+        if (this->disjointExt)
+        {
+            GLint flag = 0;
+            glGetIntegerv(GL_GPU_DISJOINT_EXT, &flag);
+            disjoint = flag != 0;
+        }
+
+        // Oldest frame first, so results come in order
+        for (int k = 1; k <= FRAMES_IN_FLIGHT; k++)
+        {
+            Frame &f = this->frames[(this->frameIndex + k) % FRAMES_IN_FLIGHT];
+            if (f.pending)
+            {
+                this->collectFrame(f, disjoint);
+            }
+        }
+
+        this->frameIndex = (this->frameIndex + 1) % FRAMES_IN_FLIGHT;
+        Frame &f = this->frames[this->frameIndex];
+        this->current = f.pending ? nullptr : &f;
+        if (this->current)
+        {
+            this->current->passCount = 0;
+        }
+    }
+
+    void collectFrame(Frame &f, bool disjoint)
+    {
+        if (f.passCount > 0)
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(f.queries[f.passCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                return; // Later, without waiting
+            }
+        }
+        f.pending = false;
+        if (disjoint)
+        {
+            return;
+        }
+
+        float totalMs = 0.0f;
+        for (int i = 0; i < f.passCount; i++)
+        {
+            GLuint64 ns = 0;
+            this->getQueryObjectui64v(f.queries[i], GL_QUERY_RESULT, &ns);
+            this->recordPass(f.names[i], ns / 1.0e6f);
+            totalMs += ns / 1.0e6f;
+        }
+        if (this->frameTotalsMs && f.passCount > 0)
+        {
+            this->frameTotalsMs->push_back(totalMs);
+        }
+    }
+
+    void recordPass(const char *name, float ms)
+    {
+        int slot = 0;
+        while (slot < this->passCount && this->passNames[slot] != name)
+        {
+            slot++;
+        }
+        if (slot == this->passCount)
+        {
+            if (slot == MAX_PASSES)
+            {
+                return;
+            }
+            this->passNames[slot] = name;
+            this->passMsAverage[slot] = ms;
+            this->passCount++;
+        }
+        this->passMs[slot] = ms;
+        this->passMsAverage[slot] += (ms - this->passMsAverage[slot]) * 0.05f;
+        this->msSum[slot] += ms;
+        this->msSamples[slot]++;
+    }
+
+    // `name` must be a string literal, it is compared by address
+    void beginPass(const char *name)
+    {
+        if (!this->current || this->current->passCount == MAX_PASSES)
+        {
+            return;
+        }
+        Frame &f = *this->current;
+        f.names[f.passCount] = name;
+        glBeginQuery(GL_TIME_ELAPSED_EXT, f.queries[f.passCount]);
+        this->passOpen = true;
+    }
+
+    void endPass()
+    {
+        if (!this->passOpen)
+        {
+            return;
+        }
+        glEndQuery(GL_TIME_ELAPSED_EXT);
+        this->current->passCount++;
+        this->passOpen = false;
+    }
+
+    void endGpuFrame(float deltaTime)
+    {
+        if (this->current)
+        {
+            this->current->pending = this->current->passCount > 0;
+        }
+
+        this->logAccumulator += deltaTime;
+        if (this->logAccumulator < 5.0f || !this->supported)
+        {
+            return;
+        }
+        this->logAccumulator = 0.0f;
+
+        std::cout << "GPU ms:";
+        for (int i = 0; i < this->passCount; i++)
+        {
+            float ms = this->msSamples[i] ? this->msSum[i] / this->msSamples[i] : 0.0f;
+            std::cout << " " << this->passNames[i] << "=" << std::fixed << std::setprecision(3) << ms;
+            this->msSum[i] = 0.0f;
+            this->msSamples[i] = 0;
+        }
+        std::cout << std::endl;
+    }
+};
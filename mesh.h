@@ -5,11 +5,14 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include "framework/boot.h"
 #include "framework/gl_util.h"
+#include "framework/stream_buffer.h"
 
 #include "assets/api/mesh_data.h"
+#include "frustum.h"
 #include "texture.h"
 
 struct InstanceData
@@ -19,8 +22,8 @@ struct InstanceData
     glm::vec3 positionOffset;
     glm::vec3 scaleOffset;
     glm::vec2 atlasStart;
-    float _pad1; // Aliggn the structure, otherwise Emscrpten dies
-    float _pad2;
+    float ghost; // 1 tints it as the replay ghost, 0 normal
+    float _pad2; // Aliggn the structure, otherwise Emscrpten dies
     float _pad3;
     float _pad4;
     float _pad5;
@@ -28,17 +31,78 @@ struct InstanceData
 
 struct AssetMesh
 {
+    // Never draw more than this many at once, every pin of the alley fits
+    static constexpr int MAX_INSTANCES = 512;
+
     MeshData meshData;
 
-    GLuint meshVAO;
-    GLuint instanceVBO;
+    GLuint meshVAO = 0;
+    GLuint vertexVBO = 0;
+    GLuint indexEBO = 0;
+    GLuint instanceVBO = 0; // Only the default instance, streamed ones go to the ring
+    // Where the instance attributes read from, instanceVBO or this frame's part of the stream
+    GLuint instanceBuffer = 0;
+    size_t instanceOffset = 0;
     int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT when the blob says so
+
+    // Undoes the snorm16 position quantisation, see PackedVertex
+    glm::vec3 posScale = glm::vec3(1.0f);
+    glm::vec3 posOffset = glm::vec3(0.0f);
+    bool skinned = false;
+    bool instanced = false; // Set by setInstanceCount, otherwise the single default instance is ignored
+
+    // Level of detail, index ranges are in indices
+    int lodCount = 1;
+    MeshLod lods[MESH_MAX_LODS];
+    float lodPixelError = 1.0f; // Coarsest LOD that is off by less than this on screen
+
+    MeshBounds bounds;
 
     std::vector<InstanceData> instanceData;
+    // From cullInstances and selectLods, instances are drawn grouped by it
+    static constexpr uint8_t LOD_CULLED = 0xff;
+    std::vector<uint8_t> instanceLod;
+    CullSpheres cullSpheres;
+
+    // Filled by sendInstanceDataToGpu, instances of LOD i are [lodFirstInstance[i], lodFirstInstance[i + 1])
+    int lodFirstInstance[MESH_MAX_LODS + 1];
+    int boundFirstInstance = 0;
+    std::vector<InstanceData> sortedInstanceData;
 
     void sendMeshDataToGpu(MeshData *meshData);
 
-    void sendInstanceDataToGpu();
+    // Before sending another mesh into the same AssetMesh (asset pack reload)
+    void releaseMeshBuffers();
+
+    // Leaves out instances whose bounding sphere is outside the frustum.
+    // Call every frame after setting the instances, before selectLods.
+    void cullInstances(const Frustum &frustum, const glm::mat4 &modelMatrix);
+
+    // Picks a LOD for every instance from how big its error is on screen.
+    // Call every frame after setting the instances, before sendInstanceDataToGpu.
+    // When not called everything is drawn at full detail.
+    void selectLods(
+        const glm::mat4 &modelMatrix,
+        const glm::mat4 &cameraMatrix,
+        const glm::mat4 &projectionMatrix,
+        float viewportHeight);
+
+    // Every frame the mesh is drawn, the stream only keeps it for this frame
+    void sendInstanceDataToGpu(StreamBuffer &stream);
+
+    // No base instance in GLES3, so the instance attributes are pointed at the first one instead
+    void bindInstanceAttributes(int firstInstance);
+
+    // Same mesh many times in one draw call, e.g. all the pins.
+    // Transform must be rigid (translation and rotation only).
+    void setInstanceCount(int count);
+    void setInstanceTransform(int index, const glm::mat4 &transform);
+    // Until the next setInstanceCount
+    void setInstanceGhost(int index, bool ghost);
+
+    // Back to the one default instance, drawn without instancing again
+    void resetInstances();
 };
 
 void AssetMesh::sendMeshDataToGpu(MeshData *meshData)
@@ -63,81 +127,112 @@ void AssetMesh::sendMeshDataToGpu(MeshData *meshData)
     // Ok, asset imported now just create OpenGL buffers
     // Create VAO
     glGenVertexArrays(1, &this->meshVAO);
-    glBindVertexArray(this->meshVAO);
-
-    // Create VBO with vertices
-    GLuint VBO;
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(
-        GL_ARRAY_BUFFER,
-        meshData->vertexCount * sizeof(Vertex), // all vertices in bytes
-        meshData->vertices, GL_STATIC_DRAW);
+    vtx::glState.bindVertexArray(this->meshVAO);
+
+    // GPU only ever gets the packed layout, old blobs are packed here
+    const PackedVertex *packed = meshData->packedVertices;
+    const PackedSkin *skin = meshData->packedSkin;
+    std::vector<PackedVertex> packedAcc;
+    std::vector<PackedSkin> skinAcc;
+    if (packed)
+    {
+        this->posScale = glm::make_vec3(meshData->posScale);
+        this->posOffset = glm::make_vec3(meshData->posOffset);
+    }
+    else
+    {
+        float scale[3], offset[3];
+        bool hasSkin = packMeshVertices(
+            meshData->vertices, meshData->vertexCount, packedAcc, skinAcc, scale, offset);
+        packed = packedAcc.data();
+        skin = hasSkin ? skinAcc.data() : nullptr;
+        this->posScale = glm::make_vec3(scale);
+        this->posOffset = glm::make_vec3(offset);
+    }
+    this->skinned = skin != nullptr;
+
+    // Create VBO with vertices, skin stream (if any) goes after them
+    size_t vertexBytes = meshData->vertexCount * sizeof(PackedVertex);
+    size_t skinBytes = skin ? meshData->vertexCount * sizeof(PackedSkin) : 0;
+    glGenBuffers(1, &this->vertexVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, this->vertexVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexBytes + skinBytes, nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, packed);
+    if (skin)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, vertexBytes, skinBytes, skin);
+    }
 
     // Create EBO with indexes
-    GLuint EBO;
-    glGenBuffers(1, &EBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glGenBuffers(1, &this->indexEBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->indexEBO);
     glBufferData(
         GL_ELEMENT_ARRAY_BUFFER, // This is used for EBO
-        meshData->indexCount * sizeof(unsigned int), meshData->indices,
+        meshData->indexCount * (meshData->indices16 ? sizeof(uint16_t) : sizeof(uint32_t)),
+        meshData->indices16 ? (const void *)meshData->indices16 : (const void *)meshData->indices,
         GL_STATIC_DRAW);
+    this->indexType = meshData->indices16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    this->lodCount = meshData->lodCount > 0 ? meshData->lodCount : 1;
+    this->lods[0] = {0, meshData->indexCount, 0.0f};
+    for (int i = 0; i < (int)meshData->lodCount; i++)
+    {
+        this->lods[i] = meshData->lods[i];
+    }
+    this->indexCount = this->lods[0].indexCount;
+    this->bounds = meshData->bounds;
 
     // Links VBO attributes such as coordinates and colors to VAO
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, this->vertexVBO);
 
     // clang-format off
     // These are the basic
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, position));
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, color));
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, texCoords));
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, normal));
-
-    // Required for animations
-    glVertexAttribIPointer(4, 4, GL_INT,            sizeof(Vertex), (void*) offsetof(Vertex, bones));
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, weights));
-    // clang-format on
-
+    glVertexAttribPointer(0, 4, GL_SHORT,         GL_TRUE,  sizeof(PackedVertex), (void*) offsetof(PackedVertex, position));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,  sizeof(PackedVertex), (void*) offsetof(PackedVertex, color));
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT,    GL_FALSE, sizeof(PackedVertex), (void*) offsetof(PackedVertex, texCoords));
+    glVertexAttribPointer(3, 2, GL_SHORT,         GL_TRUE,  sizeof(PackedVertex), (void*) offsetof(PackedVertex, normal));
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
     glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
-    glEnableVertexAttribArray(5);
+
+    // Required for animations, the shader does not read these unless skinned
+    if (skin)
+    {
+        glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE,          sizeof(PackedSkin), (void*) (vertexBytes + offsetof(PackedSkin, bones)));
+        glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE,  sizeof(PackedSkin), (void*) (vertexBytes + offsetof(PackedSkin, weights)));
+        glEnableVertexAttribArray(4);
+        glEnableVertexAttribArray(5);
+    }
+    // clang-format on
 
     // Upload instance data:
     glGenBuffers(1, &this->instanceVBO);
     glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO);
-    glBufferData(GL_ARRAY_BUFFER, 100 * sizeof(InstanceData), instanceData.data(), GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(InstanceData), instanceData.data(), GL_STATIC_DRAW);
+    for (int i = 0; i <= MESH_MAX_LODS; i++)
+    {
+        this->lodFirstInstance[i] = i == 0 ? 0 : (int)instanceData.size();
+    }
+    this->instanceBuffer = this->instanceVBO;
+    this->instanceOffset = 0;
 
-    // Position Offset Attribute (layout = 6, updates per instance)
     glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)offsetof(InstanceData, positionOffset));
-    glVertexAttribDivisor(6, 1);
-
-    // Scale Offset Attribute (layout = 7, updates per instance)
     glEnableVertexAttribArray(7);
-    glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)offsetof(InstanceData, scaleOffset));
-    glVertexAttribDivisor(7, 1);
-
-    // Atlas Start Attribute (layout = 8, updates per instance)
     glEnableVertexAttribArray(8);
-    glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)offsetof(InstanceData, atlasStart));
-    glVertexAttribDivisor(8, 1);
-
-    // These are out of order Istorically
-    // Atlas Start Attribute (layout = 9, updates per instance)
     glEnableVertexAttribArray(9);
-    glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)offsetof(InstanceData, instRot));
-    glVertexAttribDivisor(9, 1);
-
-    // TODO this is not matching InstanceData order
     glEnableVertexAttribArray(10);
-    glVertexAttribPointer(10, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)offsetof(InstanceData, textureScale));
+    glEnableVertexAttribArray(11);
+    glVertexAttribDivisor(6, 1);
+    glVertexAttribDivisor(7, 1);
+    glVertexAttribDivisor(8, 1);
+    glVertexAttribDivisor(9, 1);
     glVertexAttribDivisor(10, 1);
+    glVertexAttribDivisor(11, 1);
+    this->bindInstanceAttributes(0);
 
     // Unbind all to prevent accidentally modifying them
-    glBindVertexArray(0);                     // VAO
+    vtx::glState.bindVertexArray(0);          // VAO
     glBindBuffer(GL_ARRAY_BUFFER, 0);         // VBO
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); // EBO
 
@@ -149,29 +244,308 @@ void AssetMesh::sendMeshDataToGpu(MeshData *meshData)
     checkOpenGLError(tag.c_str());
 }
 
-void AssetMesh::sendInstanceDataToGpu()
+void AssetMesh::releaseMeshBuffers()
 {
-    // Re-upload modified instance data
-    if (!instanceData.empty())
-    {
-        glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO);
-        glBufferSubData(
-            GL_ARRAY_BUFFER,
-            0,
-            instanceData.size() * sizeof(InstanceData),
-            instanceData.data());
+    // Names get reused, the cache must not think the new VAO is already bound
+    vtx::glState.bindVertexArray(0);
+    glDeleteVertexArrays(1, &this->meshVAO);
+    GLuint buffers[3] = {this->vertexVBO, this->indexEBO, this->instanceVBO};
+    glDeleteBuffers(3, buffers);
+    this->meshVAO = this->vertexVBO = this->indexEBO = this->instanceVBO = this->instanceBuffer = 0;
+
+    // sendMeshDataToGpu adds the default one again
+    this->instanceData.clear();
+    this->instanced = false;
+}
+
+void AssetMesh::bindInstanceAttributes(int firstInstance)
+{
+    // VAO must be bound
+    glBindBuffer(GL_ARRAY_BUFFER, this->instanceBuffer);
+    size_t base = this->instanceOffset + firstInstance * sizeof(InstanceData);
+
+    // Position Offset Attribute (layout = 6, updates per instance)
+    glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)(base + offsetof(InstanceData, positionOffset)));
+
+    // Scale Offset Attribute (layout = 7, updates per instance)
+    glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)(base + offsetof(InstanceData, scaleOffset)));
+
+    // Atlas Start Attribute (layout = 8, updates per instance)
+    glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)(base + offsetof(InstanceData, atlasStart)));
+
+    // These are out of order Istorically
+    // Atlas Start Attribute (layout = 9, updates per instance)
+    glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)(base + offsetof(InstanceData, instRot)));
+
+    // TODO this is not matching InstanceData order
+    glVertexAttribPointer(10, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)(base + offsetof(InstanceData, textureScale)));
+
+    // Ghost Attribute (layout = 11, updates per instance)
+    glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)(base + offsetof(InstanceData, ghost)));
+
+    this->boundFirstInstance = firstInstance;
+}
+
+void AssetMesh::cullInstances(const Frustum &frustum, const glm::mat4 &modelMatrix)
+{
+    int count = (int)this->instanceData.size();
+    glm::vec3 sphereCentre = glm::make_vec3(this->bounds.sphereCentre);
+    float modelScale = glm::max(
+        glm::length(glm::vec3(modelMatrix[0])),
+        glm::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+
+    // Instance and model transforms on the sphere, then all of them in one SIMD pass
+    this->cullSpheres.resizeCullSpheres(count);
+    for (int i = 0; i < count; i++)
+    {
+        const InstanceData &inst = this->instanceData[i];
+        float scale = glm::max(inst.scaleOffset.x, glm::max(inst.scaleOffset.y, inst.scaleOffset.z));
+        glm::vec3 centre = inst.positionOffset + inst.instRot * (sphereCentre * inst.scaleOffset);
+        this->cullSpheres.setSphere(
+            i,
+            glm::vec3(modelMatrix * glm::vec4(centre, 1.0f)),
+            this->bounds.sphereRadius * scale * modelScale);
+    }
+    this->cullSpheres.cullSpheres(frustum);
+
+    this->instanceLod.assign(count, 0);
+    for (int i = 0; i < count; i++)
+    {
+        if (!this->cullSpheres.visible[i])
+        {
+            this->instanceLod[i] = LOD_CULLED;
+        }
+    }
+}
+
+void AssetMesh::selectLods(
+    const glm::mat4 &modelMatrix,
+    const glm::mat4 &cameraMatrix,
+    const glm::mat4 &projectionMatrix,
+    float viewportHeight)
+{
+    if (this->instanceLod.size() != this->instanceData.size())
+    {
+        this->instanceLod.assign(this->instanceData.size(), 0);
+    }
+    if (this->lodCount < 2)
+    {
+        return;
+    }
+
+    // Pixels per unit of object space at distance 1
+    float pixelsPerUnit = 0.5f * viewportHeight * projectionMatrix[1][1];
+    glm::mat4 modelView = cameraMatrix * modelMatrix;
+    glm::vec3 sphereCentre = glm::make_vec3(this->bounds.sphereCentre);
+    float radius = this->bounds.sphereRadius;
+
+    for (size_t i = 0; i < this->instanceData.size(); i++)
+    {
+        if (this->instanceLod[i] == LOD_CULLED)
+        {
+            continue;
+        }
+        const InstanceData &inst = this->instanceData[i];
+        float scale = glm::max(inst.scaleOffset.x, glm::max(inst.scaleOffset.y, inst.scaleOffset.z));
+        glm::vec3 centre = inst.positionOffset + inst.instRot * (sphereCentre * inst.scaleOffset);
+        this->instanceLod[i] = 0;
+        float distance = -(modelView * glm::vec4(centre, 1.0f)).z - radius * scale;
+        if (distance <= 0.0f)
+        {
+            continue; // Camera is inside, full detail
+        }
+
+        int lod = 0;
+        while (lod + 1 < this->lodCount &&
+               this->lods[lod + 1].error * scale * pixelsPerUnit / distance < this->lodPixelError)
+        {
+            lod++;
+        }
+        this->instanceLod[i] = (uint8_t)lod;
+    }
+}
+
+void AssetMesh::sendInstanceDataToGpu(StreamBuffer &stream)
+{
+    if (instanceData.size() > MAX_INSTANCES)
+    {
+        std::cerr << "Too many instances " << instanceData.size() << " max is " << MAX_INSTANCES << std::endl;
+        abort();
+    }
+    // Group instances by LOD, so each LOD is one instanced draw. Culled ones are left out.
+    const InstanceData *upload = instanceData.data();
+    for (int i = 0; i <= MESH_MAX_LODS; i++)
+    {
+        this->lodFirstInstance[i] = i == 0 ? 0 : (int)instanceData.size();
+    }
+    if (instanceLod.size() == instanceData.size())
+    {
+        int counts[MESH_MAX_LODS] = {0};
+        for (uint8_t lod : instanceLod)
+        {
+            if (lod != LOD_CULLED)
+            {
+                counts[lod]++;
+            }
+        }
+        for (int i = 0; i < MESH_MAX_LODS; i++)
+        {
+            this->lodFirstInstance[i + 1] = this->lodFirstInstance[i] + counts[i];
+        }
+        int next[MESH_MAX_LODS];
+        memcpy(next, this->lodFirstInstance, sizeof(next));
+        sortedInstanceData.resize(instanceData.size());
+        for (size_t i = 0; i < instanceData.size(); i++)
+        {
+            if (instanceLod[i] != LOD_CULLED)
+            {
+                sortedInstanceData[next[instanceLod[i]]++] = instanceData[i];
+            }
+        }
+        upload = sortedInstanceData.data();
+    }
+
+    // Re-upload modified instance data, into a part of the ring the GPU is done with
+    int uploadCount = this->lodFirstInstance[MESH_MAX_LODS];
+    if (uploadCount > 0)
+    {
+        this->instanceOffset = stream.streamData(upload, uploadCount * sizeof(InstanceData), sizeof(InstanceData));
+        this->instanceBuffer = stream.buffer;
+        this->boundFirstInstance = -1; // Attributes point at last frame's data until bound again
         glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 }
 
+void AssetMesh::setInstanceCount(int count)
+{
+    InstanceData identity = {
+        glm::quat(1.0f, 0.0f, 0.0f, 0.0f), // instRot
+        glm::vec3(1.0f),                   // texture scale
+        glm::vec3(0.0f),                   // position offest
+        glm::vec3(1.0f),                   // scale offset
+        glm::vec2(0.0f),                   //  atlas region
+    };
+    this->instanceData.resize(count, identity);
+    // Transforms carry over from last frame, being a ghost has to be asked for again
+    for (InstanceData &inst : this->instanceData)
+    {
+        inst.ghost = 0.0f;
+    }
+    this->instanced = true;
+}
+
+void AssetMesh::resetInstances()
+{
+    // instanceVBO still has the identity, only the CPU copy may have moved
+    this->instanceData.resize(1);
+    this->instanceData[0].instRot = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    this->instanceData[0].positionOffset = glm::vec3(0.0f);
+    this->instanceLod.clear();
+    for (int i = 0; i <= MESH_MAX_LODS; i++)
+    {
+        this->lodFirstInstance[i] = i == 0 ? 0 : 1;
+    }
+    this->instanceBuffer = this->instanceVBO;
+    this->instanceOffset = 0;
+    this->boundFirstInstance = -1;
+    this->instanced = false;
+}
+
+void AssetMesh::setInstanceTransform(int index, const glm::mat4 &transform)
+{
+    InstanceData &inst = this->instanceData[index];
+    inst.instRot = glm::quat_cast(glm::mat3(transform));
+    inst.positionOffset = glm::vec3(transform[3]);
+}
+
+void AssetMesh::setInstanceGhost(int index, bool ghost)
+{
+    this->instanceData[index].ghost = ghost ? 1.0f : 0.0f;
+}
+
+/*
+ * Everything that is the same for every draw in a frame (camera, projection, light,
+ * shadow map matrices) lives in one std140 uniform block, uploaded once per frame and shared by all programs.
+ * Layout must match `FrameData` in the shaders.
+ */
+struct FrameUniforms
+{
+    static constexpr GLuint BINDING = 0;
+
+    struct Std140
+    {
+        glm::mat4 projection;
+        glm::mat4 worldToView;
+        glm::vec4 lightPos; // w unused
+        glm::mat4 lightSpace;        // Static shadow map, see ShadowMaps
+        glm::mat4 dynamicLightSpace; // Dynamic one
+    };
+
+    // Ring of its own, bind ranges have to start on the driver's alignment
+    StreamBuffer stream;
+    GLint offsetAlignment = 256;
+
+    void initFrameUniforms()
+    {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &this->offsetAlignment);
+        this->stream.initStreamBuffer(GL_UNIFORM_BUFFER, 4 * 1024);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        checkOpenGLError("FRAME_UNIFORMS_INIT");
+    }
+
+    void updateFrameUniforms(
+        const glm::mat4 &projectionMatrix,
+        const glm::mat4 &cameraMatrix,
+        const glm::vec3 &lightPos,
+        const glm::mat4 &lightSpaceMatrix,
+        const glm::mat4 &dynamicLightSpaceMatrix)
+    {
+        Std140 data = {projectionMatrix, cameraMatrix, glm::vec4(lightPos, 1.0f), lightSpaceMatrix, dynamicLightSpaceMatrix};
+        size_t offset = this->stream.streamData(&data, sizeof(Std140), this->offsetAlignment);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        // Someone else could have taken the binding point in the meantime
+        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, this->stream.buffer, offset, sizeof(Std140));
+    }
+};
+
+// Compile time features of the mesh shader, each combination is its own program
+enum ShaderFeature : unsigned
+{
+    SHADER_SKINNED = 1 << 0,   // Bone indices and weights
+    SHADER_SHADOWS = 1 << 1,   // Shadow map lookup
+    SHADER_INSTANCED = 1 << 2, // Per-instance TRS, atlas and texture scale
+    SHADER_FEATURE_COMBINATIONS = 1 << 3,
+};
+
 struct ShaderProgram
 {
     static const char *DEFAULT_VERTEX_SHADER;
     static const char *DEFAULT_FRAGMENT_SHADER;
     GLuint id;
+    unsigned features = SHADER_SKINNED | SHADER_SHADOWS | SHADER_INSTANCED;
 
+    // Looked up once after linking, -1 when the shader does not use it
+    struct Locations
+    {
+        GLint modelToWorld;
+        GLint bones;
+        GLint textureScale;
+        GLint tileSize;
+        GLint atlasScale;
+        GLint normalMatrix;
+        GLint posScale;
+        GLint posOffset;
+    } loc;
+
+    void resolveUniformLocations();
+
+    // Every feature on
     void initDefaultShaderProgram();
 
+    // Default shader source with only `features` compiled in
+    void initShaderProgramVariant(unsigned features);
+    static void variantSources(unsigned features, std::string &vertexSource, std::string &fragmentSource);
+
     void initShaderProgram(
         const char *vertexShaderText,
         const char *fragmentShaderText);
@@ -191,32 +565,33 @@ struct ShaderProgram
         float atlasScale
     );
 
-    void updateLightPos(glm::vec3 lightPos);
-    void updateDepthMap(GLuint depthMap, glm::mat4 lightSpaceMatrix); // #4shadows
-
+    // Camera, projection and shadow matrices come from FrameUniforms
     void renderRealMesh(
         AssetMesh &realMesh,
-        glm::mat4 modelMatrix,
-        glm::mat4 cameraMatrix,
-        glm::mat4 projectionMatrix);
+        const glm::mat4 &modelMatrix);
 };
 
+// Sources have no #version, it goes in front of the feature #defines
 const char *ShaderProgram::DEFAULT_VERTEX_SHADER =
-    GLSL_VERSION
     R"(
 	precision highp float;
 
-    layout (location = 0) in vec3  a_pos;
+    layout (location = 0) in vec3  a_pos;       // snorm16 inside the mesh bounds
     layout (location = 1) in vec4  a_color;
     layout (location = 2) in vec2  a_texCoords;
-    layout (location = 3) in vec3  a_normal;
-    layout (location = 4) in ivec4 a_joints;
+    layout (location = 3) in vec2  a_normal;    // octahedral
+#ifdef SKINNED
+    layout (location = 4) in uvec4 a_joints;
     layout (location = 5) in vec4  a_weights;
+#endif
+#ifdef INSTANCED
     layout (location = 6) in vec3  a_positionOffset;
     layout (location = 7) in vec3  a_scaleOffset;
     layout (location = 8) in vec2  a_atlasStart;
     layout (location = 9) in vec4  a_instRot;
     layout (location =10) in vec3  a_textureScale;
+    layout (location =11) in float a_ghost;
+#endif
 
     out vec3 v_crntPos;
     out vec4 v_color;
@@ -225,33 +600,53 @@ const char *ShaderProgram::DEFAULT_VERTEX_SHADER =
     out vec3 v_lightPos;
     out vec3 v_textureScale;
     out vec2 v_atlasStart;
+    out float v_ghost;
 
-    const int MAX_BONES = 47;
+    // Same for every draw in the frame, see FrameUniforms
+    layout(std140) uniform FrameData {
+        // Projection matrix: transforms view-space coordinates to clip-space coordinates.
+        // Determines how objects are projected onto the screen (perspective or orthographic).
+        mat4 u_projection;
+
+        // Converts world-space coordinates to view-space coordinates (camera space).
+        // Applied to all objects in the scene to align with the camera's position and orientation.
+        mat4 u_worldToView;
 
-    // Converts world-space coordinates to view-space coordinates (camera space).
-    // Applied to all objects in the scene to align with the camera's position and orientation.
-    uniform mat4 u_worldToView;
+        vec4 u_lightPos; // xyz
+
+        // World to the static (lane) and dynamic (deck) shadow maps, see ShadowMaps
+        mat4 u_lightSpaceMatrix;
+        mat4 u_dynamicLightSpaceMatrix;
+    };
 
     // Converts model-space coordinates to world-space coordinates.
     // This matrix transforms an object's local vertices into the global scene.
     // Applied to each model to position, scale, and rotate it within the world.
     uniform mat4 u_modelToWorld;
 
-    // Projection matrix: transforms view-space coordinates to clip-space coordinates.
-    // Determines how objects are projected onto the screen (perspective or orthographic).
-    uniform mat4 u_projection;
+    // transpose(inverse(u_modelToWorld)), worked out on the CPU once per draw
+    uniform mat3 u_normalMatrix;
+
+    // Mesh bounds, see PackedVertex
+    uniform vec3 u_posScale;
+    uniform vec3 u_posOffset;
+
+#ifdef SKINNED
+    const int MAX_BONES = 47;
 
     // Array of bone transformation matrices for skeletal animation.
     // Each matrix in u_bones adjusts the position and rotation 
     // of a specific bone in model space.
     // MAX_BONES sets the maximum number of bones per model.
     uniform mat4 u_bones[MAX_BONES];
+#endif
 
-    // #4shadows
-    uniform mat4 u_lightSpaceMatrix;
-    uniform vec3 u_lightPos;
+#ifdef SHADOWS
     out vec4 FragPosLightSpace;
+    out vec4 v_dynamicPosLightSpace;
+#endif
 
+#ifdef INSTANCED
     /* Helper function to apply rotation quat */
     vec3 rotateVecByQuat(vec3 v, vec4 q) {
         // Quaternion multiplication: q * v * q^-1
@@ -262,48 +657,62 @@ const char *ShaderProgram::DEFAULT_VERTEX_SHADER =
             + (s * s - dot(u, u)) * v
             + 2.0 * s * cross(u, v);
     }
+#endif
+
+    vec3 octDecode(vec2 e) {
+        vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+        float t = max(-n.z, 0.0);
+        n.x += n.x >= 0.0 ? -t : t;
+        n.y += n.y >= 0.0 ? -t : t;
+        return normalize(n);
+    }
 
     void main() {
+        vec3 localPos = a_pos * u_posScale + u_posOffset;
+        vec3 localNormal = octDecode(a_normal);
 
-        v_crntPos = a_pos;
-        v_lightPos = u_lightPos;
-
+        v_lightPos = u_lightPos.xyz;
         v_texCoords   = a_texCoords;
         v_color = a_color;
-        v_textureScale = a_textureScale;
-        v_atlasStart = a_atlasStart;
 
-        mat4 boneTransform = mat4(1.0);
-        if (a_joints[0] != -1) {
-            boneTransform     = u_bones[a_joints[0]] * a_weights[0];
+#ifdef SKINNED
+        if (a_joints[0] != 255u) {
+            mat4 boneTransform = u_bones[a_joints[0]] * a_weights[0];
             boneTransform     += u_bones[a_joints[1]] * a_weights[1];
             boneTransform     += u_bones[a_joints[2]] * a_weights[2];
             boneTransform     += u_bones[a_joints[3]] * a_weights[3];
+            localPos = (boneTransform * vec4(localPos, 1.0f)).xyz;
+            localNormal = (boneTransform * vec4(localNormal, 0.0f)).xyz;
         }
-        vec4 localAnimatedPos       = boneTransform * vec4(a_pos, 1.0f);          // Apply bone transform
-        vec3 scaledPosition         = localAnimatedPos.xyz * a_scaleOffset;       // Apply instance TRS on it
-        vec3 rotatedPosition        = rotateVecByQuat(scaledPosition, a_instRot);
-        vec3 localAnimatedScaledPos = rotatedPosition + a_positionOffset;
-        vec4 animatedPos = u_modelToWorld * vec4(localAnimatedScaledPos, 1.0f);   // Finaly apply model MTX
-
-        // for #4shadows out
-        // vec4 worldPos = model * vec4(aPos, 1.0);
-        FragPosLightSpace = u_lightSpaceMatrix * animatedPos;
-
-        v_crntPos = animatedPos.xyz; // Actually this is correct
-        gl_Position = u_projection * u_worldToView * animatedPos;
-
-        // Recalculate normals 
-        mat4 normalMatrix = mat4(u_modelToWorld);
-        normalMatrix = transpose(inverse(normalMatrix));
-        // Rotate the normal using the calculated normal matrix
-        vec4 animatedNormal = normalMatrix * boneTransform * vec4(a_normal, 0.0f);
-        v_normal = normalize(vec3(animatedNormal));
+#endif
+
+#ifdef INSTANCED
+        // Instance TRS on top of the bones
+        localPos = rotateVecByQuat(localPos * a_scaleOffset, a_instRot) + a_positionOffset;
+        localNormal = rotateVecByQuat(localNormal / a_scaleOffset, a_instRot);
+        v_textureScale = a_textureScale;
+        v_atlasStart = a_atlasStart;
+        v_ghost = a_ghost;
+#else
+        v_textureScale = vec3(1.0);
+        v_atlasStart = vec2(0.0);
+        v_ghost = 0.0;
+#endif
+
+        vec4 worldPos = u_modelToWorld * vec4(localPos, 1.0f); // Finaly apply model MTX
+
+#ifdef SHADOWS
+        FragPosLightSpace = u_lightSpaceMatrix * worldPos;
+        v_dynamicPosLightSpace = u_dynamicLightSpaceMatrix * worldPos;
+#endif
+
+        v_crntPos = worldPos.xyz;
+        gl_Position = u_projection * u_worldToView * worldPos;
+        v_normal = normalize(u_normalMatrix * localNormal);
 	}
 	)";
 
 const char *ShaderProgram::DEFAULT_FRAGMENT_SHADER =
-    GLSL_VERSION
     R"(
 	precision highp float;
 
@@ -314,6 +723,7 @@ const char *ShaderProgram::DEFAULT_FRAGMENT_SHADER =
     in vec3 v_lightPos;
     in vec3 v_textureScale;
     in vec2 v_atlasStart;
+    in float v_ghost;
 
 	uniform sampler2D u_diffuseTexture;
 
@@ -324,29 +734,32 @@ const char *ShaderProgram::DEFAULT_FRAGMENT_SHADER =
 
     out vec4 FragColor;
 
+#ifdef SHADOWS
     // #4shadows
     in vec4 FragPosLightSpace;
-    uniform sampler2D shadowMap;
+    in vec4 v_dynamicPosLightSpace;
+    uniform highp sampler2DShadow shadowMap;
+    uniform highp sampler2DShadow u_dynamicShadowMap;
 
     // This function is also #4shadows
-    float ShadowCalculation(vec4 fragPosLightSpace)
+    float ShadowCalculation(highp sampler2DShadow map, vec4 fragPosLightSpace)
     {
         // Perform perspective divide
         vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
         // Transform to [0,1] range
         projCoords = projCoords * 0.5 + 0.5;
 
-        // Get closest depth from shadow map
-        float closestDepth = texture(shadowMap, projCoords.xy).r;
-        // Current fragment depth in light space
-        float currentDepth = projCoords.z;
-
-        // Apply bias to reduce shadow acne
-        float bias = 0.005;
-        float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
+        // Outside the map is lit, the dynamic one only covers the deck
+        if (any(lessThan(projCoords, vec3(0.0))) || any(greaterThan(projCoords, vec3(1.0)))) {
+            return 0.0;
+        }
 
-        return shadow;
+        // Depth compare is done by the sampler, linear filter gives soft edges.
+        // Most of the bias is glPolygonOffset in the depth pass.
+        float bias = 0.0005;
+        return 1.0 - texture(map, vec3(projCoords.xy, projCoords.z - bias));
     }
+#endif
 
     void main() {
         vec2 texCoords = v_texCoords * u_atlasScale;
@@ -404,17 +817,52 @@ const char *ShaderProgram::DEFAULT_FRAGMENT_SHADER =
 
         vec3 lightColor = vec3(1.0f, 1.0f, 1.0f);
 
+#ifdef SHADOWS
         // #4shadows
-        float shadow = ShadowCalculation(FragPosLightSpace);
-        FragColor = surfaceColor * vec4(vec3(lightColor * (ambient + diffuse)) * (1.0 - shadow * 0.2), 1.0f) ;
+        float shadow = max(
+            ShadowCalculation(shadowMap, FragPosLightSpace),
+            ShadowCalculation(u_dynamicShadowMap, v_dynamicPosLightSpace));
+#else
+        float shadow = 0.0;
+#endif
+        // Shadow takes the diffuse away and a bit of the ambient
+        FragColor = surfaceColor * vec4(lightColor * (ambient * (1.0 - shadow * 0.3) + diffuse * (1.0 - shadow)), 1.0f);
+
+        // Replay ghost is washed out pale blue, so it never passes for the real ball
+        vec3 ghostColor = vec3(0.55, 0.8, 1.0) * (0.6 + diffuse);
+        FragColor.rgb = mix(FragColor.rgb, ghostColor, 0.75 * v_ghost);
     }
     )";
 
 void ShaderProgram::initDefaultShaderProgram()
 {
-    this->id = vtx::createShaderProgram(
-        ShaderProgram::DEFAULT_VERTEX_SHADER,
-        ShaderProgram::DEFAULT_FRAGMENT_SHADER);
+    this->initShaderProgramVariant(SHADER_SKINNED | SHADER_SHADOWS | SHADER_INSTANCED);
+}
+
+void ShaderProgram::variantSources(
+    unsigned features,
+    std::string &vertexSource,
+    std::string &fragmentSource)
+{
+    std::string header = std::string(GLSL_VERSION) + "\n";
+    if (features & SHADER_SKINNED)
+        header += "#define SKINNED\n";
+    if (features & SHADER_SHADOWS)
+        header += "#define SHADOWS\n";
+    if (features & SHADER_INSTANCED)
+        header += "#define INSTANCED\n";
+
+    vertexSource = header + ShaderProgram::DEFAULT_VERTEX_SHADER;
+    fragmentSource = header + ShaderProgram::DEFAULT_FRAGMENT_SHADER;
+}
+
+void ShaderProgram::initShaderProgramVariant(unsigned features)
+{
+    std::string vertexSource, fragmentSource;
+    ShaderProgram::variantSources(features, vertexSource, fragmentSource);
+    this->id = vtx::createShaderProgram(vertexSource.c_str(), fragmentSource.c_str());
+    this->features = features;
+    this->resolveUniformLocations();
 }
 
 void ShaderProgram::initShaderProgram(
@@ -423,6 +871,32 @@ void ShaderProgram::initShaderProgram(
 {
     this->id = vtx::createShaderProgram(
         vertexShaderText, fragmentShaderText);
+    this->resolveUniformLocations();
+}
+
+void ShaderProgram::resolveUniformLocations()
+{
+    this->loc.modelToWorld = glGetUniformLocation(this->id, "u_modelToWorld");
+    this->loc.bones = glGetUniformLocation(this->id, "u_bones");
+    this->loc.textureScale = glGetUniformLocation(this->id, "u_textureScale");
+    this->loc.tileSize = glGetUniformLocation(this->id, "u_tileSize");
+    this->loc.atlasScale = glGetUniformLocation(this->id, "u_atlasScale");
+    this->loc.normalMatrix = glGetUniformLocation(this->id, "u_normalMatrix");
+    this->loc.posScale = glGetUniformLocation(this->id, "u_posScale");
+    this->loc.posOffset = glGetUniformLocation(this->id, "u_posOffset");
+
+    GLuint frameBlock = glGetUniformBlockIndex(this->id, "FrameData");
+    if (frameBlock != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(this->id, frameBlock, FrameUniforms::BINDING);
+    }
+
+    // Samplers never change unit, set them once
+    vtx::glState.useProgram(this->id);
+    glUniform1i(glGetUniformLocation(this->id, "u_diffuseTexture"), 0);
+    glUniform1i(glGetUniformLocation(this->id, "shadowMap"), 1);
+    glUniform1i(glGetUniformLocation(this->id, "u_dynamicShadowMap"), 2);
+    checkOpenGLError("SHADER_PROGRAM_LOCATIONS");
 }
 
 void ShaderProgram::updateBoneTransformData(std::vector<glm::mat4> transformMatrices)
@@ -437,7 +911,7 @@ void ShaderProgram::updateBoneTransformData(std::vector<glm::mat4> transformMatr
     // TODO if index exceedds max bones then exit
     // glUseProgram(this->id);
     glUniformMatrix4fv(
-        glGetUniformLocation(this->id, "u_bones"),  // Loc
+        this->loc.bones,                            // Loc
         count,                                      // count
         GL_TRUE,                                    // transpose
         glm::value_ptr(transformMatrices.data()[0]) // put only one value in specific index
@@ -446,16 +920,8 @@ void ShaderProgram::updateBoneTransformData(std::vector<glm::mat4> transformMatr
 
 void ShaderProgram::updateDiffuseTexture(Texture &diffuseTexture)
 {
-    glUseProgram(this->id);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseTexture.id);
-
-    glUniform1i(
-        glGetUniformLocation(
-            this->id, "u_diffuseTexture"),
-        0);
-    checkOpenGLError();
+    vtx::glState.useProgram(this->id);
+    vtx::glState.bindTexture(0, diffuseTexture.id);
 }
 
 /**
@@ -466,21 +932,19 @@ void ShaderProgram::updateTextureScaling(glm::vec3 textureScaling)
 {
     // glUseProgram(this->id);
     glUniform3f(
-        glGetUniformLocation(this->id, "u_textureScale"),
+        this->loc.textureScale,
         textureScaling.x,
         textureScaling.y,
         textureScaling.z);
-    checkOpenGLError();
 }
 
 void ShaderProgram::updateTileSize(glm::vec2 tileSize)
 {
     // glUseProgram(this->id);
     glUniform2f(
-        glGetUniformLocation(this->id, "u_tileSize"),
+        this->loc.tileSize,
         tileSize.x,
         tileSize.y);
-    checkOpenGLError();
 }
 
 void ShaderProgram::updateAtlasStartAndScale(glm::vec2 atlasStart, float atlasScale)
@@ -488,9 +952,8 @@ void ShaderProgram::updateAtlasStartAndScale(glm::vec2 atlasStart, float atlasSc
     // glUseProgram(this->id);
 
     glUniform1f(
-        glGetUniformLocation(this->id, "u_atlasScale"),
+        this->loc.atlasScale,
         atlasScale);
-    checkOpenGLError();
 }
 void ShaderProgram::updateTextureParamsInOneGo(
     glm::vec3 textureScaling, //rename to density TODO
@@ -501,90 +964,154 @@ void ShaderProgram::updateTextureParamsInOneGo(
     // glUseProgram(this->id);
 
     glUniform3f(
-        glGetUniformLocation(this->id, "u_textureScale"),
+        this->loc.textureScale,
         textureScaling.x,
         textureScaling.y,
         textureScaling.z);
     glUniform2f(
-        glGetUniformLocation(this->id, "u_tileSize"),
+        this->loc.tileSize,
         tileSize.x,
         tileSize.y);
     glUniform1f(
-        glGetUniformLocation(this->id, "u_atlasScale"),
+        this->loc.atlasScale,
         atlasScale);
-
-    checkOpenGLError();
-}
-
-// NOTE: this goes hand-in-hand with the lightSpaceMatrix bellow
-void ShaderProgram::updateLightPos(glm::vec3 lightPos)
-{
-    // Does not seems to be called....
-    glUseProgram(this->id);
-    glUniform3f(
-        glGetUniformLocation(this->id, "u_lightPos"),
-        lightPos.x,
-        lightPos.y,
-        lightPos.z);
-    checkOpenGLError();
-}
-
-/**
- * Set the viewport back to the screen dimensions and render the scene as usual,
- * but pass the lightSpaceMatrix and the depth map texture as uniforms to your main shader.
- * #4shadows
- */
-void ShaderProgram::updateDepthMap(GLuint depthMap, glm::mat4 lightSpaceMatrix)
-{
-    // Does not seems to be called....
-    // glUseProgram(this->id);
-    glUniformMatrix4fv(glGetUniformLocation(this->id, "u_lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glUniform1i(glGetUniformLocation(this->id, "shadowMap"), 1);
-    checkOpenGLError();
 }
 
 void ShaderProgram::renderRealMesh(
     AssetMesh &assetMesh,
-    glm::mat4 modelMatrix,
-    glm::mat4 cameraMatrix,
-    glm::mat4 projectionMatrix)
+    const glm::mat4 &modelMatrix)
 {
     // glUseProgram(this->id);
 
     glUniformMatrix4fv(
-        glGetUniformLocation(
-            this->id, "u_projection"),   // uniform location
-        1,                               // number of matrices
-        GL_FALSE,                        // transpose
-        glm::value_ptr(projectionMatrix) // value
+        this->loc.modelToWorld,     // uniform location
+        1,                          // number of matrices
+        GL_FALSE,                   // transpose
+        glm::value_ptr(modelMatrix) // value
     );
+    glUniform3fv(this->loc.posScale, 1, glm::value_ptr(assetMesh.posScale));
+    glUniform3fv(this->loc.posOffset, 1, glm::value_ptr(assetMesh.posOffset));
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+    glUniformMatrix3fv(this->loc.normalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 
-    glUniformMatrix4fv(
-        glGetUniformLocation(this->id, "u_modelToWorld"), // uniform location
-        1,                                                // number of matrices
-        GL_FALSE,                                         // transpose
-        glm::value_ptr(modelMatrix)                       // value
-    );
+    vtx::glState.bindVertexArray(assetMesh.meshVAO);
 
-    glUniformMatrix4fv(
-        glGetUniformLocation(this->id, "u_worldToView"), // uniform location
-        1,                                               // number of matrices
-        GL_FALSE,                                        // transpose
-        glm::value_ptr(cameraMatrix)                     // value
-    );
+    size_t indexSize = assetMesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    for (int lod = 0; lod < assetMesh.lodCount; lod++)
+    {
+        int first = assetMesh.lodFirstInstance[lod];
+        int count = assetMesh.lodFirstInstance[lod + 1] - first;
+        if (count == 0)
+        {
+            continue;
+        }
+        void *indices = (void *)(assetMesh.lods[lod].indexOffset * indexSize);
 
-    glBindVertexArray(assetMesh.meshVAO);
+        // Variant without instancing ignores the instance attributes, it is one draw
+        if (!(this->features & SHADER_INSTANCED))
+        {
+            glDrawElements(GL_TRIANGLES, assetMesh.lods[lod].indexCount, assetMesh.indexType, indices);
+            continue;
+        }
 
+        if (assetMesh.boundFirstInstance != first)
+        {
+            assetMesh.bindInstanceAttributes(first);
+        }
 
-    glDrawElementsInstanced(
-        GL_TRIANGLES, // Mode
-        assetMesh.indexCount,
-        //  .indices.size(),  // Index count
-        GL_UNSIGNED_INT,                    // Data type of indices array
-        (void *)(0 * sizeof(unsigned int)), // Indices pointer
-        assetMesh.instanceData.size()       // Instance count
-    );
-    glBindVertexArray(0);
+        glDrawElementsInstanced(
+            GL_TRIANGLES,                                                 // Mode
+            assetMesh.lods[lod].indexCount,                               // Index count
+            assetMesh.indexType,                                          // Data type of indices array
+            indices,                                                      // Indices pointer
+            count                                                         // Instance count
+        );
+    }
 }
+
+/*
+ * All variants of the default shader, and which one a mesh gets:
+ * skinned only when the mesh has bones, instanced only when the mesh
+ * uses setInstanceCount, shadows only once the depth maps are given.
+ * What never changes is set on each variant once after linking, what changes
+ * every frame is in FrameUniforms, so no variant is bound just to set uniforms.
+ */
+struct ShaderPermutations
+{
+    ShaderProgram variants[SHADER_FEATURE_COMBINATIONS];
+    bool shadowsEnabled = false;
+
+    // All variants in one batch, so the driver can compile them side by side
+    void initShaderPermutations()
+    {
+        std::string vertexSources[SHADER_FEATURE_COMBINATIONS];
+        std::string fragmentSources[SHADER_FEATURE_COMBINATIONS];
+        const char *vs[SHADER_FEATURE_COMBINATIONS];
+        const char *fs[SHADER_FEATURE_COMBINATIONS];
+        GLuint ids[SHADER_FEATURE_COMBINATIONS];
+        for (unsigned features = 0; features < SHADER_FEATURE_COMBINATIONS; features++)
+        {
+            ShaderProgram::variantSources(features, vertexSources[features], fragmentSources[features]);
+            vs[features] = vertexSources[features].c_str();
+            fs[features] = fragmentSources[features].c_str();
+        }
+
+        vtx::createShaderPrograms(SHADER_FEATURE_COMBINATIONS, vs, fs, ids);
+
+        for (unsigned features = 0; features < SHADER_FEATURE_COMBINATIONS; features++)
+        {
+            this->variants[features].id = ids[features];
+            this->variants[features].features = features;
+            this->variants[features].resolveUniformLocations(); // Leaves it bound
+            // The whole atlas, one tile, all meshes use it that way
+            this->variants[features].updateTextureParamsInOneGo(
+                glm::vec3(1.0f, 1.0f, 1.0f), // Texture density
+                glm::vec2(1.0f, 1.0f),       // Size of one tile compared to full atlas
+                glm::vec2(1.0f),             // Atlas region start
+                1.0f                         // Atlas region scale compared to entire atlas
+            );
+        }
+    }
+
+    ShaderProgram &variantFor(const AssetMesh &mesh)
+    {
+        unsigned features = (mesh.skinned ? SHADER_SKINNED : 0) |
+                            (this->shadowsEnabled ? SHADER_SHADOWS : 0) |
+                            (mesh.instanced ? SHADER_INSTANCED : 0);
+        return this->variants[features];
+    }
+
+    void updateDiffuseTexture(Texture &diffuseTexture)
+    {
+        // Sampler unit is fixed at link time, so this is the same for every variant
+        vtx::glState.bindTexture(0, diffuseTexture.id);
+    }
+
+    void updateBoneTransformData(const std::vector<glm::mat4> &transformMatrices)
+    {
+        for (ShaderProgram &v : this->variants)
+        {
+            if (v.features & SHADER_SKINNED)
+            {
+                vtx::glState.useProgram(v.id);
+                v.updateBoneTransformData(transformMatrices);
+            }
+        }
+    }
+
+    // #4shadows, switches to the shadowed variants from now on.
+    // Units are fixed at link time, the matrices go in FrameUniforms.
+    void updateDepthMaps(GLuint depthMap, GLuint dynamicDepthMap)
+    {
+        this->shadowsEnabled = true;
+        vtx::glState.bindTexture(1, depthMap);
+        vtx::glState.bindTexture(2, dynamicDepthMap);
+    }
+
+    void renderRealMesh(AssetMesh &mesh, const glm::mat4 &modelMatrix)
+    {
+        ShaderProgram &v = this->variantFor(mesh);
+        vtx::glState.useProgram(v.id);
+        v.renderRealMesh(mesh, modelMatrix);
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "framework/gl_header.h"
+
+#include "glm/glm.hpp"
+
+#include "framework/boot.h"
+#include "framework/gl_util.h"
+
+/*
+ * Debug view of how many fragments each pixel of the 3D scene got.
+ * While counting, every fragment that passes the depth test bumps the
+ * stencil, whatever shader drew it. Afterwards one full screen triangle
+ * per band paints the pixels with that count, from grey for none to
+ * white for BANDS - 1 or more. Shadow maps and the aurora's small target
+ * have no stencil, so only what lands on the screen is counted.
+ */
+struct OverdrawView
+{
+    static const char *OVERDRAW_VERTEX_SHADER;
+    static const char *OVERDRAW_FRAGMENT_SHADER;
+
+    static constexpr int BANDS = 8;
+    static constexpr float BAND_COLORS[BANDS][3] = {
+        {0.2f, 0.2f, 0.2f}, // Nothing drawn
+        {0.0f, 0.0f, 0.6f}, // Once, as good as it gets
+        {0.0f, 0.6f, 0.0f},
+        {0.8f, 0.8f, 0.0f},
+        {1.0f, 0.5f, 0.0f},
+        {1.0f, 0.0f, 0.0f},
+        {1.0f, 0.0f, 1.0f},
+        {1.0f, 1.0f, 1.0f}, // This many or more
+    };
+
+    bool enabled = false;
+    GLuint shaderId = 0;
+    GLint colorLoc;
+    GLuint vao; // Empty, the triangle comes from gl_VertexID
+
+    void initOverdrawView()
+    {
+        this->loadOverdrawShader();
+        glGenVertexArrays(1, &this->vao);
+    }
+
+    void loadOverdrawShader()
+    {
+        // Reload, the new program may reuse the old name
+        vtx::glState.useProgram(0);
+        if (this->shaderId)
+        {
+            glDeleteProgram(this->shaderId);
+        }
+        this->shaderId = vtx::createShaderProgram(OVERDRAW_VERTEX_SHADER, OVERDRAW_FRAGMENT_SHADER);
+        this->colorLoc = glGetUniformLocation(this->shaderId, "uColor");
+    }
+
+    // After the clear, before the first draw to count
+    void beginOverdrawCount()
+    {
+        glStencilMask(0xff);
+        glClearStencil(0);
+        glClear(GL_STENCIL_BUFFER_BIT);
+        vtx::glState.setEnabled(GlStateCache::CAP_STENCIL_TEST, true);
+        glStencilFunc(GL_ALWAYS, 0, 0xff);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_INCR); // Depth test off counts as passed
+    }
+
+    // Replaces what was drawn since beginOverdrawCount with the counts
+    void renderOverdrawCount()
+    {
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+        vtx::glState.setEnabled(GlStateCache::CAP_DEPTH_TEST, false);
+        vtx::glState.setDepthMask(false);
+        vtx::glState.setEnabled(GlStateCache::CAP_BLEND, false);
+        vtx::glState.useProgram(this->shaderId);
+        vtx::glState.bindVertexArray(this->vao);
+        for (int i = 0; i < BANDS; i++)
+        {
+            // Last band takes everything from there up, LEQUAL is ref <= stencil
+            glStencilFunc(i == BANDS - 1 ? GL_LEQUAL : GL_EQUAL, i, 0xff);
+            glUniform3fv(this->colorLoc, 1, BAND_COLORS[i]);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        vtx::glState.setEnabled(GlStateCache::CAP_STENCIL_TEST, false);
+        vtx::glState.setEnabled(GlStateCache::CAP_DEPTH_TEST, true);
+        vtx::glState.setDepthMask(true);
+    }
+};
+
+const char *OverdrawView::OVERDRAW_VERTEX_SHADER =
+    GLSL_VERSION
+    R"(
+    precision highp float;
+
+    void main() {
+        // One triangle over the whole screen
+        vec2 p = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+        gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+    }
+    )";
+
+const char *OverdrawView::OVERDRAW_FRAGMENT_SHADER =
+    GLSL_VERSION
+    R"(
+    precision mediump float;
+
+    uniform vec3 uColor;
+
+    out vec4 FragColor;
+
+    void main() {
+        FragColor = vec4(uColor, 1.0);
+    }
+    )";
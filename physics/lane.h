@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "physics.h"
+
+// Where things stand on the lane, shared by the game and the offline tools
+
+// Ball parks here (above the lane) between throws
+static const glm::vec3 LANE_BALL_START = glm::vec3(0.0f, 4.0f, -8.0f);
+
+// Where the player holds the ball before aiming
+static const glm::vec3 LANE_RELEASE_POINT = glm::vec3(0.0f, 0.2f, -18.0f);
+
+// Standard triangle rack, pin 1 in front
+inline void lane_rack_pins(glm::vec3 *pins)
+{
+    const float h = 0.35f;
+    const float ft = 0.305f;
+    const float offset = 0.87f - 3.0f * ft;
+    const float l0 = offset - 0.0 * ft * glm::cos(glm::radians(30.0f));
+    pins[0] = glm::vec3(-0.0f, h, l0);
+
+    const float l1 = offset + 1.0 * ft * glm::cos(glm::radians(30.0f));
+    pins[1] = glm::vec3(-0.5f * ft, h, l1);
+    pins[2] = glm::vec3(+0.5f * ft, h, l1);
+
+    const float l2 = offset + 2.0f * ft * glm::cos(glm::radians(30.0f));
+    pins[3] = glm::vec3(-ft, h, l2);
+    pins[4] = glm::vec3(-0.0f * ft, h, l2);
+    pins[5] = glm::vec3(+ft, h, l2);
+
+    const float l3 = offset + 3.0f * ft * glm::cos(glm::radians(30.0f));
+    pins[6] = glm::vec3(-1.5f * ft, h, l3);
+    pins[7] = glm::vec3(-0.5f * ft, h, l3);
+    pins[8] = glm::vec3(+0.5f * ft, h, l3);
+    pins[9] = glm::vec3(+1.5f * ft, h, l3);
+}
+
+// Throw without a hand: released at `x` across the lane, rolling
+// straight down the lane at `speed`, with `spin` per frame (60Hz)
+// the same way the aim phase spins the ball
+inline void lane_launch(Physics &phy, float x, float speed, float spin)
+{
+    glm::vec3 pos = LANE_RELEASE_POINT + glm::vec3(x, 0.0f, 0.0f);
+    phy.set_spin_speed(spin);
+    phy.launch_ball(pos,
+                    glm::vec3(0.0f, 0.0f, speed),
+                    glm::vec3(0.0f, spin * 60.0f, 0.0f));
+}
+
+// Same throw again, e.g. on the server from what a client sent
+inline void lane_relaunch(Physics &phy, const PhysicsLaunch &launch)
+{
+    phy.set_spin_speed(launch.spinSpeed);
+    phy.launch_ball(launch.position, launch.velocity, launch.angularVelocity);
+}
+
+// Steps until the throw is judged, same rules as the THROW phase in game.
+// Returns how many pins are down.
+inline int lane_simulate_until_settled(Physics &phy, float dt)
+{
+    float throwingTime = 0.0f;
+    float settlingTime = 0.0f;
+    while (true)
+    {
+        phy.physics_step(dt);
+
+        if (phy.is_settling_started())
+        {
+            settlingTime += dt;
+        }
+        else
+        {
+            throwingTime += dt;
+        }
+
+        bool waitToSettle = settlingTime < 3.0f && throwingTime < 10.0f;
+        int state = phy.checkThrowComplete(waitToSettle ? 0.1f : 100.0f, -0.1f);
+        if (state != -1)
+        {
+            return state;
+        }
+    }
+}
@@ -24,13 +24,18 @@
 #include <Jolt/Physics/Collision/Shape/SphereShape.h>
 #include <Jolt/Physics/Body/BodyCreationSettings.h>
 #include <Jolt/Physics/Body/BodyActivationListener.h>
+#ifdef JPH_DEBUG_RENDERER
+#include <Jolt/Renderer/DebugRendererSimple.h>
+#endif
 
 // STL includes
 #include <iostream>
 #include <cstdarg>
 #include <thread>
+#include <vector>
 
 #include "physics.h"
+#include "physics_memory.h"
 
 namespace Layers
 {
@@ -120,6 +125,64 @@ glm::mat4 ToGlm(const JPH::RMat44 &m)
     return out;
 }
 
+#ifdef JPH_DEBUG_RENDERER
+// Flattens everything Jolt wants to draw into two vertex arrays,
+// the game uploads them into one streaming buffer.
+class PhysicsDebugRenderer : public JPH::DebugRendererSimple
+{
+public:
+    std::vector<PhysicsDebugVertex> lines;
+    std::vector<PhysicsDebugVertex> triangles;
+
+    void clear()
+    {
+        lines.clear();
+        triangles.clear();
+    }
+
+    virtual void DrawLine(JPH::RVec3Arg inFrom, JPH::RVec3Arg inTo, JPH::ColorArg inColor) override
+    {
+        push(lines, inFrom, inColor);
+        push(lines, inTo, inColor);
+    }
+
+    virtual void DrawTriangle(JPH::RVec3Arg inV1, JPH::RVec3Arg inV2, JPH::RVec3Arg inV3,
+                              JPH::ColorArg inColor, ECastShadow inCastShadow) override
+    {
+        push(triangles, inV1, inColor);
+        push(triangles, inV2, inColor);
+        push(triangles, inV3, inColor);
+    }
+
+    virtual void DrawText3D(JPH::RVec3Arg inPosition, const JPH::string_view &inString,
+                            JPH::ColorArg inColor, float inHeight) override
+    {
+        // No text in the overlay
+    }
+
+private:
+    static void push(std::vector<PhysicsDebugVertex> &out, JPH::RVec3Arg p, JPH::ColorArg c)
+    {
+        out.push_back({float(p.GetX()), float(p.GetY()), float(p.GetZ()), c.GetUInt32()});
+    }
+};
+
+// Contacts are only known inside Update, so the listener parks them here
+struct DebugContact
+{
+    JPH::RVec3 point;
+    JPH::Vec3 normal;
+};
+#endif
+
+struct PendingSpinKick
+{
+    JPH::BodyID pin;
+    JPH::Vec3 impulse;
+    JPH::Vec3 angularImpulse;
+};
+
+// Everything of one world, each Physics has its own so lanes don't touch
 struct JoltPhysicsInternal
 {
     inline static constexpr float FIXED_STEP = 0.005f; // 5 ms
@@ -127,9 +190,11 @@ struct JoltPhysicsInternal
     BPLayerInterfaceImpl bpLayerInterface;
     ObjectVsBPLayerFilter objVsBpFilter;
     ObjectLayerPairFilter objPairFilter;
-    JPH::TempAllocatorImpl *mTempAllocator;
+    PhysicsTempArena *mTempAllocator;
     JPH::JobSystemSingleThreaded *mJobSystem;
     JPH::PhysicsSystem *mPhysicsSystem;
+    JPH::ContactListener *mContactListener;
+    std::vector<PendingSpinKick> pendingKicks; // From the contact listener, applied after the step
     JPH::BodyID mBallID;
     JPH::BodyID mPinID[10];
     bool ballPhysicsActive;
@@ -144,32 +209,30 @@ struct JoltPhysicsInternal
     float lastDeltaTime;
     glm::quat lastDeltaQuat;
     glm::quat lastManualRot;
-    Physics pub;
     float spinSpeed;
 
     bool settlingStarted;
-};
 
-static JoltPhysicsInternal g_JoltPhysicsInternal;
-
-struct PendingSpinKick
-{
-    JPH::BodyID pin;
-    JPH::Vec3 impulse;
-    JPH::Vec3 angularImpulse;
+#ifdef JPH_DEBUG_RENDERER
+    bool debugDrawEnabled = false;
+    PhysicsDebugRenderer *mDebugRenderer = nullptr;
+    std::vector<DebugContact> debugContacts;
+#endif
 };
 
-std::vector<PendingSpinKick> gPendingKicks;
-
 class SpinContactListener : public JPH::ContactListener
 {
 public:
+    explicit SpinContactListener(JoltPhysicsInternal *world) : world(world) {}
+
     virtual void OnContactAdded(const JPH::Body &body1,
                                 const JPH::Body &body2,
-                                const JPH::ContactManifold &,
+                                const JPH::ContactManifold &manifold,
                                 JPH::ContactSettings &) override
     {
-        JPH::BodyID ball = g_JoltPhysicsInternal.mBallID;
+        recordDebugContacts(manifold);
+
+        JPH::BodyID ball = world->mBallID;
 
         JPH::BodyID a = body1.GetID();
         JPH::BodyID b = body2.GetID();
@@ -200,7 +263,7 @@ public:
         bool isPinReallyAPin = false;
         for (int i = 0; i < 10; i++)
         {
-            if (pin == g_JoltPhysicsInternal.mPinID[i])
+            if (pin == world->mPinID[i])
             {
                 isPinReallyAPin = true;
             }
@@ -210,9 +273,9 @@ public:
             return;
         }
 
-        g_JoltPhysicsInternal.settlingStarted = true;
+        world->settlingStarted = true;
 
-        float spin = 2.0f * g_JoltPhysicsInternal.spinSpeed;
+        float spin = 2.0f * world->spinSpeed;
         if (fabs(spin) < 0.01f)
             return;
 
@@ -229,11 +292,36 @@ public:
         JPH::Vec3 angularKick = 1.5f * (1.0f + wobble) * spin * approxNormal.Cross(JPH::Vec3::sAxisY());
 
         // Store for later safe application
-        gPendingKicks.push_back({pin, lateralKick, angularKick});
+        world->pendingKicks.push_back({pin, lateralKick, angularKick});
     }
-};
 
-static SpinContactListener gContactListener;
+    virtual void OnContactPersisted(const JPH::Body &,
+                                    const JPH::Body &,
+                                    const JPH::ContactManifold &manifold,
+                                    JPH::ContactSettings &) override
+    {
+        recordDebugContacts(manifold);
+    }
+
+private:
+    JoltPhysicsInternal *world;
+
+    void recordDebugContacts(const JPH::ContactManifold &manifold)
+    {
+#ifdef JPH_DEBUG_RENDERER
+        if (!world->debugDrawEnabled)
+            return;
+
+        for (JPH::uint i = 0; i < manifold.mRelativeContactPointsOn1.size(); i++)
+        {
+            world->debugContacts.push_back({
+                manifold.GetWorldSpaceContactPointOn1(i),
+                manifold.mWorldSpaceNormal,
+            });
+        }
+#endif
+    }
+};
 
 // Jolt includes (minimal set)
 #ifdef JPH_ENABLE_ASSERTS
@@ -281,30 +369,37 @@ void Physics::physics_init(
     glm::vec3 *pinStart,
     glm::vec3 ballStart)
 {
-    JPH::RegisterDefaultAllocator();
-    JPH::Trace = TraceImpl;
-    JPH_IF_ENABLE_ASSERTS(JPH::AssertFailed = AssertFailedImpl;)
-    JPH::Factory::sInstance = new JPH::Factory();
-    JPH::RegisterTypes();
+    // Process wide, only for the first world
+    if (!JPH::Factory::sInstance)
+    {
+        PhysicsMemory::install();
+        JPH::Trace = TraceImpl;
+        JPH_IF_ENABLE_ASSERTS(JPH::AssertFailed = AssertFailedImpl;)
+        JPH::Factory::sInstance = new JPH::Factory();
+        JPH::RegisterTypes();
+    }
+
+    this->internal = new JoltPhysicsInternal();
+    JoltPhysicsInternal &jolt = *this->internal;
 
     // Allocators
-    JPH::TempAllocatorImpl tempAllocator(1024 * 1024); // 1 MB (stack-like, reused per step)
-    JPH::JobSystemSingleThreaded jobSystem(JPH::cMaxPhysicsJobs);
+    jolt.mTempAllocator = new PhysicsTempArena(this->tempArenaBytes); // stack-like, reused per step
+    jolt.mJobSystem = new JPH::JobSystemSingleThreaded(JPH::cMaxPhysicsJobs);
 
     // Physics system
-    g_JoltPhysicsInternal.mPhysicsSystem = new JPH::PhysicsSystem();
-    g_JoltPhysicsInternal.mPhysicsSystem->Init(
+    jolt.mPhysicsSystem = new JPH::PhysicsSystem();
+    jolt.mPhysicsSystem->Init(
         1024, // max bodies
         0,    // body mutexes (0 = single-threaded)
         1024, // max body pairs
         1024, // max contact constraints
-        g_JoltPhysicsInternal.bpLayerInterface,
-        g_JoltPhysicsInternal.objVsBpFilter,
-        g_JoltPhysicsInternal.objPairFilter);
+        jolt.bpLayerInterface,
+        jolt.objVsBpFilter,
+        jolt.objPairFilter);
 
-    g_JoltPhysicsInternal.ballPhysicsActive = true; // start with physics enabled
+    jolt.ballPhysicsActive = true; // start with physics enabled
 
-    JPH::BodyInterface &bodyIface = g_JoltPhysicsInternal.mPhysicsSystem->GetBodyInterface();
+    JPH::BodyInterface &bodyIface = jolt.mPhysicsSystem->GetBodyInterface();
 
     // === Static lane mesh ===
     JPH::Array<JPH::Float3> verts;
@@ -353,12 +448,10 @@ void Physics::physics_init(
     ballBody.mMassPropertiesOverride.mMass = 7.25f; // Middle of legal range 6 - 7.26
     ballBody.mInertiaMultiplier = 1.0f;             // Realistic rolling
 
-    g_JoltPhysicsInternal.mBallID = bodyIface.CreateAndAddBody(ballBody, JPH::EActivation::Activate);
+    jolt.mBallID = bodyIface.CreateAndAddBody(ballBody, JPH::EActivation::Activate);
 
     // === Pin (cylinder) ===
     // https://www.dimensions.com/element/ten-pin-bowling-piI
-    g_JoltPhysicsInternal.mTempAllocator = new JPH::TempAllocatorImpl(1024 * 1024);
-    g_JoltPhysicsInternal.mJobSystem = new JPH::JobSystemSingleThreaded(JPH::cMaxPhysicsJobs);
     for (int i = 0; i < 10; i++)
     {
         this->mPinDead[i] = false;
@@ -376,33 +469,40 @@ void Physics::physics_init(
         pinBody.mOverrideMassProperties = JPH::EOverrideMassProperties::CalculateMassAndInertia;
         pinBody.mMassPropertiesOverride.mMass = 1.53f; // Standard pin mass
         pinBody.mInertiaMultiplier = 1.0f;
-        g_JoltPhysicsInternal.mPinID[i] = bodyIface.CreateAndAddBody(pinBody, JPH::EActivation::Activate);
+        jolt.mPinID[i] = bodyIface.CreateAndAddBody(pinBody, JPH::EActivation::Activate);
     }
 
-    g_JoltPhysicsInternal.lastManualPos = glm::vec3(0.0f);
-    g_JoltPhysicsInternal.lastManualRot = glm::quat(1.0f, 0, 0, 0);
-    g_JoltPhysicsInternal.lastDeltaQuat = glm::quat(1.0f, 0, 0, 0);
-    g_JoltPhysicsInternal.lastDeltaTime = 0.0f;
+    jolt.lastManualPos = glm::vec3(0.0f);
+    jolt.lastManualRot = glm::quat(1.0f, 0, 0, 0);
+    jolt.lastDeltaQuat = glm::quat(1.0f, 0, 0, 0);
+    jolt.lastDeltaTime = 0.0f;
 
-    g_JoltPhysicsInternal.filteredVelocity = glm::vec3(0.0f);
-    g_JoltPhysicsInternal.hasFilteredVelocity = false;
-    g_JoltPhysicsInternal.mPosDtLoan = 0.0f;
+    jolt.filteredVelocity = glm::vec3(0.0f);
+    jolt.hasFilteredVelocity = false;
+    jolt.mPosDtLoan = 0.0f;
 
-    g_JoltPhysicsInternal.mPhysicsSystem->SetContactListener(&gContactListener);
+    jolt.mContactListener = new SpinContactListener(&jolt);
+    jolt.mPhysicsSystem->SetContactListener(jolt.mContactListener);
 }
 
 void Physics::physics_step(float deltaSeconds)
 {
-    g_JoltPhysicsInternal.mAccumulator += deltaSeconds;
+    JoltPhysicsInternal &jolt = *this->internal;
+#ifdef JPH_DEBUG_RENDERER
+    jolt.debugDrawEnabled = this->debugDrawEnabled;
+    jolt.debugContacts.clear();
+#endif
+
+    jolt.mAccumulator += deltaSeconds;
 
     // Run as many fixed 10ms physics steps as needed
-    while (g_JoltPhysicsInternal.mAccumulator >= g_JoltPhysicsInternal.FIXED_STEP)
+    while (jolt.mAccumulator >= jolt.FIXED_STEP)
     {
-        g_JoltPhysicsInternal.mPhysicsSystem->Update(
-            g_JoltPhysicsInternal.FIXED_STEP,
+        jolt.mPhysicsSystem->Update(
+            jolt.FIXED_STEP,
             1, // still *1*; this is not number of steps!
-            g_JoltPhysicsInternal.mTempAllocator,
-            g_JoltPhysicsInternal.mJobSystem);
+            jolt.mTempAllocator,
+            jolt.mJobSystem);
 
         this->apply_lane_pushback(
             -6.0f, // Operational peak
@@ -410,25 +510,89 @@ void Physics::physics_step(float deltaSeconds)
             15.0f  // max strength in Newtons
         );
 
-        g_JoltPhysicsInternal.mAccumulator -= g_JoltPhysicsInternal.FIXED_STEP;
-        if (g_JoltPhysicsInternal.mAccumulator > 2.0f)
+        jolt.mAccumulator -= jolt.FIXED_STEP;
+        if (jolt.mAccumulator > 2.0f)
         {
-            std::cerr << "Warning physics left far behind " << g_JoltPhysicsInternal.mAccumulator << std::endl;
-            g_JoltPhysicsInternal.mAccumulator = 2.0f; // Avoids hyper buffering, drain it until manageable 2s buffer
+            std::cerr << "Warning physics left far behind " << jolt.mAccumulator << std::endl;
+            jolt.mAccumulator = 2.0f; // Avoids hyper buffering, drain it until manageable 2s buffer
         }
 
         apply_spin_curve();
 
         apply_pending_spin_kicks();
+
+        if (this->stepListener)
+        {
+            this->notify_step_listener();
+        }
     }
 
-    JPH::BodyInterface &bodyIface = g_JoltPhysicsInternal.mPhysicsSystem->GetBodyInterface();
-    this->mBallMatrix = ToGlm(bodyIface.GetWorldTransform(g_JoltPhysicsInternal.mBallID));
+    JPH::BodyInterface &bodyIface = jolt.mPhysicsSystem->GetBodyInterface();
+    this->mBallMatrix = ToGlm(bodyIface.GetWorldTransform(jolt.mBallID));
 
     for (int i = 0; i < 10; i++)
     {
-        this->mPinMatrix[i] = ToGlm(bodyIface.GetWorldTransform(g_JoltPhysicsInternal.mPinID[i]));
+        this->mPinMatrix[i] = ToGlm(bodyIface.GetWorldTransform(jolt.mPinID[i]));
+    }
+
+    this->collect_debug_draw();
+}
+
+void Physics::notify_step_listener()
+{
+    JoltPhysicsInternal &jolt = *this->internal;
+    JPH::BodyInterface &bodyIface = jolt.mPhysicsSystem->GetBodyInterface();
+
+    PhysicsStepPoses poses;
+    poses.stepSeconds = jolt.FIXED_STEP;
+    for (int i = 0; i < PhysicsStepPoses::BODY_COUNT; i++)
+    {
+        JPH::BodyID id = i == 0 ? jolt.mBallID : jolt.mPinID[i - 1];
+        JPH::RVec3 p;
+        JPH::Quat q;
+        bodyIface.GetPositionAndRotation(id, p, q);
+        poses.position[i] = glm::vec3(p.GetX(), p.GetY(), p.GetZ());
+        poses.rotation[i] = glm::quat(q.GetW(), q.GetX(), q.GetY(), q.GetZ());
+    }
+
+    this->stepListener(this->stepListenerUser, poses);
+}
+
+void Physics::collect_debug_draw()
+{
+    this->debugLineVertexCount = 0;
+    this->debugTriangleVertexCount = 0;
+
+#ifdef JPH_DEBUG_RENDERER
+    if (!this->debugDrawEnabled)
+        return;
+
+    JoltPhysicsInternal &jolt = *this->internal;
+
+    if (!jolt.mDebugRenderer)
+    {
+        jolt.mDebugRenderer = new PhysicsDebugRenderer();
+    }
+    PhysicsDebugRenderer *renderer = jolt.mDebugRenderer;
+    renderer->clear();
+
+    JPH::BodyManager::DrawSettings settings;
+    settings.mDrawShape = true;
+    settings.mDrawShapeWireframe = true;
+    settings.mDrawBoundingBox = true; // the bounds the broad phase sorts on
+    jolt.mPhysicsSystem->DrawBodies(settings, renderer);
+
+    for (const DebugContact &contact : jolt.debugContacts)
+    {
+        renderer->DrawMarker(contact.point, JPH::Color::sYellow, 0.03f);
+        renderer->DrawArrow(contact.point, contact.point + 0.15f * contact.normal, JPH::Color::sRed, 0.02f);
     }
+
+    this->debugLineVertices = renderer->lines.data();
+    this->debugLineVertexCount = (int)renderer->lines.size();
+    this->debugTriangleVertices = renderer->triangles.data();
+    this->debugTriangleVertexCount = (int)renderer->triangles.size();
+#endif
 }
 
 const glm::mat4 &Physics::physics_get_ball_matrix()
@@ -443,13 +607,14 @@ const glm::mat4 &Physics::physics_get_pin_matrix(int i)
 
 void Physics::physics_reset(glm::vec3 *newPinPos, glm::vec3 newBallPos, bool reviveAll)
 {
-    JPH::BodyInterface &bodyIface = g_JoltPhysicsInternal.mPhysicsSystem->GetBodyInterface();
+    JoltPhysicsInternal &jolt = *this->internal;
+    JPH::BodyInterface &bodyIface = jolt.mPhysicsSystem->GetBodyInterface();
 
-    bodyIface.SetPositionAndRotation(g_JoltPhysicsInternal.mBallID, ToJolt(newBallPos), JPH::Quat::sIdentity(), JPH::EActivation::Activate);
+    bodyIface.SetPositionAndRotation(jolt.mBallID, ToJolt(newBallPos), JPH::Quat::sIdentity(), JPH::EActivation::Activate);
 
-    bodyIface.SetLinearVelocity(g_JoltPhysicsInternal.mBallID, JPH::Vec3::sZero());
-    bodyIface.SetAngularVelocity(g_JoltPhysicsInternal.mBallID, JPH::Vec3::sZero());
-    this->mBallMatrix = ToGlm(bodyIface.GetWorldTransform(g_JoltPhysicsInternal.mBallID));
+    bodyIface.SetLinearVelocity(jolt.mBallID, JPH::Vec3::sZero());
+    bodyIface.SetAngularVelocity(jolt.mBallID, JPH::Vec3::sZero());
+    this->mBallMatrix = ToGlm(bodyIface.GetWorldTransform(jolt.mBallID));
 
     for (int i = 0; i < 10; i++)
     {
@@ -463,93 +628,99 @@ void Physics::physics_reset(glm::vec3 *newPinPos, glm::vec3 newBallPos, bool rev
             pos.y += -1.0f;
             pos.z += 1.5f;
         }
-        bodyIface.SetPositionAndRotation(g_JoltPhysicsInternal.mPinID[i], ToJolt(pos), JPH::Quat::sIdentity(), JPH::EActivation::Activate);
-        bodyIface.SetLinearVelocity(g_JoltPhysicsInternal.mPinID[i], JPH::Vec3::sZero());
-        bodyIface.SetAngularVelocity(g_JoltPhysicsInternal.mPinID[i], JPH::Vec3::sZero());
-        this->mPinMatrix[i] = ToGlm(bodyIface.GetWorldTransform(g_JoltPhysicsInternal.mPinID[i]));
+        bodyIface.SetPositionAndRotation(jolt.mPinID[i], ToJolt(pos), JPH::Quat::sIdentity(), JPH::EActivation::Activate);
+        bodyIface.SetLinearVelocity(jolt.mPinID[i], JPH::Vec3::sZero());
+        bodyIface.SetAngularVelocity(jolt.mPinID[i], JPH::Vec3::sZero());
+        this->mPinMatrix[i] = ToGlm(bodyIface.GetWorldTransform(jolt.mPinID[i]));
     }
+
+    // Nothing from the last throw should leak into the next one,
+    // the offline tools rely on a reset world behaving the same every time
+    jolt.mAccumulator = 0.0f;
+    jolt.pendingKicks.clear();
 }
 
 void Physics::set_manual_ball_position(const glm::vec3 &pos,
                                        const glm::quat &rot,
                                        float dt)
 {
+    JoltPhysicsInternal &jolt = *this->internal;
     using glm::epsilon;
     const float EPS = glm::epsilon<float>();
 
-    g_JoltPhysicsInternal.ballPhysicsActive = false;
+    jolt.ballPhysicsActive = false;
 
     // If position unchanged, accumulate loaned dt and bail out early.
-    if (glm::length(pos - g_JoltPhysicsInternal.lastManualPos) <= EPS)
+    if (glm::length(pos - jolt.lastManualPos) <= EPS)
     {
-        g_JoltPhysicsInternal.mPosDtLoan += dt;
+        jolt.mPosDtLoan += dt;
         // still update rotation delta if rotation changed and dt available
-        if (dt > EPS && glm::length(rot - g_JoltPhysicsInternal.lastManualRot) > EPS)
+        if (dt > EPS && glm::length(rot - jolt.lastManualRot) > EPS)
         {
-            g_JoltPhysicsInternal.lastDeltaQuat = rot * glm::inverse(g_JoltPhysicsInternal.lastManualRot);
-            g_JoltPhysicsInternal.lastDeltaTime = dt;
-            g_JoltPhysicsInternal.lastManualRot = rot;
+            jolt.lastDeltaQuat = rot * glm::inverse(jolt.lastManualRot);
+            jolt.lastDeltaTime = dt;
+            jolt.lastManualRot = rot;
         }
         return;
     }
 
     // Accumulate loaned dt and use total dt
-    float dt_total = dt + g_JoltPhysicsInternal.mPosDtLoan;
-    g_JoltPhysicsInternal.mPosDtLoan = 0.0f;
+    float dt_total = dt + jolt.mPosDtLoan;
+    jolt.mPosDtLoan = 0.0f;
 
     // Protect against very small dt_total
     if (dt_total <= EPS)
     {
         // treat velocity as zero (can't compute reliable velocity)
-        g_JoltPhysicsInternal.filteredVelocity = glm::vec3(0.0f);
+        jolt.filteredVelocity = glm::vec3(0.0f);
     }
     else
     {
         // instantaneous velocity
-        glm::vec3 v = (pos - g_JoltPhysicsInternal.lastManualPos) / dt_total;
+        glm::vec3 v = (pos - jolt.lastManualPos) / dt_total;
 
         // exponential smoothing (newer input dominates)
         const float weight = 0.15f;
-        if (!g_JoltPhysicsInternal.hasFilteredVelocity)
+        if (!jolt.hasFilteredVelocity)
         {
-            g_JoltPhysicsInternal.filteredVelocity = v;
-            g_JoltPhysicsInternal.hasFilteredVelocity = true;
+            jolt.filteredVelocity = v;
+            jolt.hasFilteredVelocity = true;
         }
         else
         {
-            g_JoltPhysicsInternal.filteredVelocity =
-                glm::mix(g_JoltPhysicsInternal.filteredVelocity, v, weight);
+            jolt.filteredVelocity =
+                glm::mix(jolt.filteredVelocity, v, weight);
         }
     }
 
     // Save delta rotation (if dt is sane)
     if (dt > EPS)
     {
-        g_JoltPhysicsInternal.lastDeltaQuat = rot * glm::inverse(g_JoltPhysicsInternal.lastManualRot);
-        g_JoltPhysicsInternal.lastDeltaTime = dt;
+        jolt.lastDeltaQuat = rot * glm::inverse(jolt.lastManualRot);
+        jolt.lastDeltaTime = dt;
     }
     else
     {
         // zero rotation delta
-        g_JoltPhysicsInternal.lastDeltaQuat = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
-        g_JoltPhysicsInternal.lastDeltaTime = 0.0f;
+        jolt.lastDeltaQuat = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        jolt.lastDeltaTime = 0.0f;
     }
 
     // update stored manual pos/rot for next frame
-    g_JoltPhysicsInternal.lastManualPos = pos;
-    g_JoltPhysicsInternal.lastManualRot = rot;
+    jolt.lastManualPos = pos;
+    jolt.lastManualRot = rot;
 
     // Update Jolt body safely
-    JPH::BodyInterface &bodyIface = g_JoltPhysicsInternal.mPhysicsSystem->GetBodyInterface();
+    JPH::BodyInterface &bodyIface = jolt.mPhysicsSystem->GetBodyInterface();
 
-    bodyIface.SetMotionType(g_JoltPhysicsInternal.mBallID,
+    bodyIface.SetMotionType(jolt.mBallID,
                             JPH::EMotionType::Kinematic,
                             JPH::EActivation::DontActivate);
 
-    bodyIface.SetLinearVelocity(g_JoltPhysicsInternal.mBallID, JPH::Vec3::sZero());
-    bodyIface.SetAngularVelocity(g_JoltPhysicsInternal.mBallID, JPH::Vec3::sZero());
+    bodyIface.SetLinearVelocity(jolt.mBallID, JPH::Vec3::sZero());
+    bodyIface.SetAngularVelocity(jolt.mBallID, JPH::Vec3::sZero());
 
-    bodyIface.SetPositionAndRotation(g_JoltPhysicsInternal.mBallID,
+    bodyIface.SetPositionAndRotation(jolt.mBallID,
                                      ToJolt(pos),
                                      ToJolt(rot),
                                      JPH::EActivation::DontActivate);
@@ -559,23 +730,24 @@ void Physics::set_manual_ball_position(const glm::vec3 &pos,
 
 void Physics::enable_physics_on_ball()
 {
-    g_JoltPhysicsInternal.settlingStarted = false;
+    JoltPhysicsInternal &jolt = *this->internal;
+    jolt.settlingStarted = false;
 
-    g_JoltPhysicsInternal.ballPhysicsActive = true;
+    jolt.ballPhysicsActive = true;
 
-    JPH::BodyInterface &bodyIface = g_JoltPhysicsInternal.mPhysicsSystem->GetBodyInterface();
+    JPH::BodyInterface &bodyIface = jolt.mPhysicsSystem->GetBodyInterface();
 
     // Re-enable normal physics
-    bodyIface.SetMotionType(g_JoltPhysicsInternal.mBallID,
+    bodyIface.SetMotionType(jolt.mBallID,
                             JPH::EMotionType::Dynamic,
                             JPH::EActivation::Activate);
 
     // Apply linear velocity
-    bodyIface.SetLinearVelocity(g_JoltPhysicsInternal.mBallID, ToJolt(g_JoltPhysicsInternal.filteredVelocity));
+    bodyIface.SetLinearVelocity(jolt.mBallID, ToJolt(jolt.filteredVelocity));
 
     // --- Compute angular velocity safely ---
-    glm::quat deltaRot = g_JoltPhysicsInternal.lastDeltaQuat;
-    float dt = g_JoltPhysicsInternal.lastDeltaTime;
+    glm::quat deltaRot = jolt.lastDeltaQuat;
+    float dt = jolt.lastDeltaTime;
 
     JPH::Vec3 angularVel = JPH::Vec3::sZero();
 
@@ -596,28 +768,60 @@ void Physics::enable_physics_on_ball()
     }
     // Else: angularVel remains zero (no rotation or invalid dt)
 
-    bodyIface.SetAngularVelocity(g_JoltPhysicsInternal.mBallID, angularVel);
+    bodyIface.SetAngularVelocity(jolt.mBallID, angularVel);
+
+    this->lastLaunch.position = jolt.lastManualPos;
+    this->lastLaunch.velocity = jolt.filteredVelocity;
+    this->lastLaunch.angularVelocity = glm::vec3(angularVel.GetX(), angularVel.GetY(), angularVel.GetZ());
+    this->lastLaunch.spinSpeed = jolt.spinSpeed;
 
     // Wake it up
-    bodyIface.ActivateBody(g_JoltPhysicsInternal.mBallID);
+    bodyIface.ActivateBody(jolt.mBallID);
+}
+
+void Physics::launch_ball(const glm::vec3 &pos,
+                          const glm::vec3 &velocity,
+                          const glm::vec3 &angularVelocity)
+{
+    JoltPhysicsInternal &jolt = *this->internal;
+    jolt.settlingStarted = false;
+    jolt.ballPhysicsActive = true;
+
+    JPH::BodyInterface &bodyIface = jolt.mPhysicsSystem->GetBodyInterface();
+    JPH::BodyID ball = jolt.mBallID;
+
+    bodyIface.SetMotionType(ball, JPH::EMotionType::Dynamic, JPH::EActivation::Activate);
+    bodyIface.SetPositionAndRotation(ball, ToJolt(pos), JPH::Quat::sIdentity(), JPH::EActivation::Activate);
+    bodyIface.SetLinearVelocity(ball, ToJolt(velocity));
+    bodyIface.SetAngularVelocity(ball, ToJolt(angularVelocity));
+
+    this->mBallMatrix = ToGlm(bodyIface.GetWorldTransform(ball));
+
+    this->lastLaunch.position = pos;
+    this->lastLaunch.velocity = velocity;
+    this->lastLaunch.angularVelocity = angularVelocity;
+    this->lastLaunch.spinSpeed = jolt.spinSpeed;
 }
 
 bool Physics::is_settling_started() const
 {
-    return g_JoltPhysicsInternal.settlingStarted;
+    const JoltPhysicsInternal &jolt = *this->internal;
+    return jolt.settlingStarted;
 }
 
 bool Physics::is_ball_physics_active() const
 {
-    return g_JoltPhysicsInternal.ballPhysicsActive;
+    const JoltPhysicsInternal &jolt = *this->internal;
+    return jolt.ballPhysicsActive;
 }
 
 void Physics::apply_lane_pushback(float peakZ, float halfWidth, float maxStrength)
 {
-    auto &iface = g_JoltPhysicsInternal.mPhysicsSystem->GetBodyInterface();
+    JoltPhysicsInternal &jolt = *this->internal;
+    auto &iface = jolt.mPhysicsSystem->GetBodyInterface();
 
-    JPH::RVec3 pos = iface.GetPosition(g_JoltPhysicsInternal.mBallID);
-    JPH::Vec3 vel = iface.GetLinearVelocity(g_JoltPhysicsInternal.mBallID);
+    JPH::RVec3 pos = iface.GetPosition(jolt.mBallID);
+    JPH::Vec3 vel = iface.GetLinearVelocity(jolt.mBallID);
 
     float x = pos.GetX();
     float z = pos.GetZ();
@@ -656,14 +860,15 @@ void Physics::apply_lane_pushback(float peakZ, float halfWidth, float maxStrengt
     float strength = maxStrength * laneFactor * edgeFactor;
     float forceX = -glm::sign(x) * strength;
 
-    iface.AddForce(g_JoltPhysicsInternal.mBallID, JPH::Vec3(forceX, 0.0f, 0.0f));
+    iface.AddForce(jolt.mBallID, JPH::Vec3(forceX, 0.0f, 0.0f));
 }
 
 void Physics::apply_spin_curve()
 {
-    auto &iface = g_JoltPhysicsInternal.mPhysicsSystem->GetBodyInterface();
+    JoltPhysicsInternal &jolt = *this->internal;
+    auto &iface = jolt.mPhysicsSystem->GetBodyInterface();
 
-    JPH::BodyID ballID = g_JoltPhysicsInternal.mBallID;
+    JPH::BodyID ballID = jolt.mBallID;
 
     // Get current position and velocity
     JPH::RVec3 pos = iface.GetPosition(ballID);
@@ -694,14 +899,16 @@ void Physics::apply_spin_curve()
 
 void Physics::set_spin_speed(float spinSpeed)
 {
-    g_JoltPhysicsInternal.spinSpeed = spinSpeed;
+    JoltPhysicsInternal &jolt = *this->internal;
+    jolt.spinSpeed = spinSpeed;
 }
 void Physics::apply_pending_spin_kicks()
 {
-    auto &iface = g_JoltPhysicsInternal.mPhysicsSystem->GetBodyInterface();
+    JoltPhysicsInternal &jolt = *this->internal;
+    auto &iface = jolt.mPhysicsSystem->GetBodyInterface();
 
     int i = 0;
-    for (auto &kick : gPendingKicks)
+    for (auto &kick : jolt.pendingKicks)
     {
         i += 1;
         float sign = i % 2 == 0 ? 1.0f : -1.0f;
@@ -709,20 +916,21 @@ void Physics::apply_pending_spin_kicks()
         iface.AddAngularImpulse(kick.pin, kick.angularImpulse);
     }
 
-    gPendingKicks.clear();
+    jolt.pendingKicks.clear();
 }
 
 int Physics::checkThrowComplete(float stillThreshold, float floorY)
 {
+    JoltPhysicsInternal &jolt = *this->internal;
     JPH::BodyInterface &iface =
-        g_JoltPhysicsInternal.mPhysicsSystem->GetBodyInterfaceNoLock();
+        jolt.mPhysicsSystem->GetBodyInterfaceNoLock();
 
     bool anyMoving = false;
     int fallenCount = 0;
 
     // --- Check ball ---
     {
-        JPH::BodyID ball = g_JoltPhysicsInternal.mBallID;
+        JPH::BodyID ball = jolt.mBallID;
 
         JPH::Vec3 v = iface.GetLinearVelocity(ball);
         JPH::Vec3 av = iface.GetAngularVelocity(ball);
@@ -748,7 +956,7 @@ int Physics::checkThrowComplete(float stillThreshold, float floorY)
         {
             continue;
         }
-        JPH::BodyID pin = g_JoltPhysicsInternal.mPinID[i];
+        JPH::BodyID pin = jolt.mPinID[i];
 
         JPH::Vec3 v = iface.GetLinearVelocity(pin);
         JPH::Vec3 av = iface.GetAngularVelocity(pin);
@@ -777,7 +985,7 @@ int Physics::checkThrowComplete(float stillThreshold, float floorY)
         for (int i = 0; i < 10; i++)
         {
             // Orientation test
-            JPH::BodyID pin = g_JoltPhysicsInternal.mPinID[i];
+            JPH::BodyID pin = jolt.mPinID[i];
             if (this->mPinDead[i])
             {
                 fallenCount++; // maybe dead because of the position
@@ -799,3 +1007,22 @@ int Physics::checkThrowComplete(float stillThreshold, float floorY)
 
     return fallenCount;
 }
+
+void Physics::physics_get_memory_stats(PhysicsMemoryStats *out) const
+{
+    for (int c = 0; c < PhysicsMemoryStats::NUM_CATEGORIES; c++)
+    {
+        const PhysicsMemory::Counters &counters = PhysicsMemory::g_counters[c];
+        out->liveBytes[c] = counters.live.load(std::memory_order_relaxed);
+        out->peakBytes[c] = counters.peak.load(std::memory_order_relaxed);
+        out->allocCount[c] = counters.allocs.load(std::memory_order_relaxed);
+        out->freeCount[c] = counters.frees.load(std::memory_order_relaxed);
+    }
+    out->generalPoolBytes = PhysicsMemory::g_pool.chunkBytes.load(std::memory_order_relaxed);
+
+    // Counters above are for all worlds, the arena is this one's
+    const PhysicsTempArena *arena = this->internal ? this->internal->mTempAllocator : nullptr;
+    out->tempCapacity = arena ? arena->mCapacity : 0;
+    out->tempHighWater = arena ? arena->mHighWater : 0;
+    out->tempOverflows = arena ? arena->mOverflowCount : 0;
+}
@@ -2,8 +2,64 @@
 
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
+// How much memory Jolt holds, per category of allocation hook
+struct PhysicsMemoryStats
+{
+    enum Category
+    {
+        GENERAL = 0, // JPH::Allocate / Reallocate / Free
+        ALIGNED,     // JPH::AlignedAllocate / AlignedFree
+        TEMP,        // Per-step temp arena given to PhysicsSystem::Update
+        NUM_CATEGORIES
+    };
+
+    size_t liveBytes[NUM_CATEGORIES];
+    size_t peakBytes[NUM_CATEGORIES];
+    uint64_t allocCount[NUM_CATEGORIES];
+    uint64_t freeCount[NUM_CATEGORIES];
+
+    size_t tempCapacity;     // Size of the temp arena
+    size_t tempHighWater;    // Most of the arena ever used at once
+    uint64_t tempOverflows;  // Allocations that did not fit and went to malloc
+
+    size_t generalPoolBytes; // Chunks of the small block pool, free blocks included
+};
+
+// One vertex of the physics debug overlay, colour is packed RGBA8
+struct PhysicsDebugVertex
+{
+    float x, y, z;
+    uint32_t rgba;
+};
+
+// Pose of every moving body after one fixed step, ball first, then the pins.
+// Position is the body origin, same as the render matrices.
+struct PhysicsStepPoses
+{
+    static constexpr int BODY_COUNT = 11;
+    float stepSeconds;
+    glm::vec3 position[BODY_COUNT];
+    glm::quat rotation[BODY_COUNT];
+};
+
+// What the ball was launched with, enough to simulate the throw again elsewhere
+struct PhysicsLaunch
+{
+    glm::vec3 position;
+    glm::vec3 velocity;
+    glm::vec3 angularVelocity;
+    float spinSpeed;
+};
+
+typedef void (*PhysicsStepListener)(void *user, const PhysicsStepPoses &poses);
+
+struct JoltPhysicsInternal;
+
 struct Physics
 {
     glm::mat4 mBallMatrix;
@@ -11,6 +67,12 @@ struct Physics
     bool mPinDead[10];
     float previousDelta = 0.0f;
 
+    // Size of the per-step temp arena, set before physics_init
+    size_t tempArenaBytes = 1024 * 1024;
+
+    // Own Jolt world, made by physics_init. Many can live side by side, one per lane.
+    JoltPhysicsInternal *internal = nullptr;
+
     // Initialise Jolt and create world + bodies
     void physics_init(
         const float *laneVerts,
@@ -38,6 +100,15 @@ struct Physics
     // Switch ball to physics control (start THROW phase)
     void enable_physics_on_ball();
 
+    // Same as above, but with velocities given instead of taken from
+    // the manual moves. For bots and offline tools.
+    void launch_ball(const glm::vec3 &pos,
+                     const glm::vec3 &velocity,
+                     const glm::vec3 &angularVelocity);
+
+    // Filled by both of the above
+    PhysicsLaunch lastLaunch;
+
     // Optional: store whether physics is active
     bool is_ball_physics_active() const;
 
@@ -52,4 +123,22 @@ struct Physics
     void apply_pending_spin_kicks();
 
     int checkThrowComplete(float stillThreshold, float floorY);
+
+    // Debug overlay of body shapes, contacts and broad-phase bounds.
+    // When disabled nothing is collected, so it costs nothing.
+    bool debugDrawEnabled = false;
+    const PhysicsDebugVertex *debugLineVertices = nullptr; // pairs, GL_LINES
+    int debugLineVertexCount = 0;
+    const PhysicsDebugVertex *debugTriangleVertices = nullptr; // triples, GL_TRIANGLES
+    int debugTriangleVertexCount = 0;
+    void collect_debug_draw();
+
+    // Called after every fixed step (not every frame), e.g. for the replay recorder.
+    // Function pointer into the game, so set it again after a hot reload.
+    PhysicsStepListener stepListener = nullptr;
+    void *stepListenerUser = nullptr;
+    void notify_step_listener();
+
+    // Snapshot of the allocator counters
+    void physics_get_memory_stats(PhysicsMemoryStats *out) const;
 };
\ No newline at end of file
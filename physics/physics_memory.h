@@ -0,0 +1,294 @@
+#pragma once
+
+// Our own backing for Jolt's allocation hooks.
+// Only physics.cpp includes this, it is not part of the public API.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/TempAllocator.h>
+
+#include "physics.h"
+
+namespace PhysicsMemory
+{
+    struct Counters
+    {
+        std::atomic<size_t> live{0};
+        std::atomic<size_t> peak{0};
+        std::atomic<uint64_t> allocs{0};
+        std::atomic<uint64_t> frees{0};
+    };
+
+    static Counters g_counters[PhysicsMemoryStats::NUM_CATEGORIES];
+
+    static void countAlloc(int category, size_t size)
+    {
+        Counters &c = g_counters[category];
+        size_t live = c.live.fetch_add(size, std::memory_order_relaxed) + size;
+        size_t peak = c.peak.load(std::memory_order_relaxed);
+        while (live > peak && !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        {
+        }
+        c.allocs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void countFree(int category, size_t size)
+    {
+        Counters &c = g_counters[category];
+        c.live.fetch_sub(size, std::memory_order_relaxed);
+        c.frees.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Every general block is prefixed with its size so Free can account for it.
+    // 16 bytes keeps the returned pointer as aligned as malloc made it.
+    static constexpr size_t GENERAL_HEADER = 16;
+
+    /*
+     * Small general blocks (shapes, bodies, constraints, broadphase nodes)
+     * come from free lists, one per power of two size class, carved out of
+     * 64 KB chunks. Chunks are never given back, a freed block goes on its
+     * list for the next one of that size, so a lane that has warmed up
+     * stops calling malloc. Blocks bigger than the last class go to malloc.
+     * Locked, Jolt may allocate from job threads.
+     */
+    static constexpr int POOL_CLASSES = 5;
+    static constexpr size_t POOL_SMALLEST = 32; // Header included, blocks stay 16-aligned
+    static constexpr size_t POOL_CHUNK = 64 * 1024;
+
+    struct GeneralPool
+    {
+        std::mutex mutex;
+        void *freeLists[POOL_CLASSES] = {};
+        std::atomic<size_t> chunkBytes{0};
+    };
+
+    static GeneralPool g_pool;
+
+    // -1 when it is too big for the pool
+    static int poolClass(size_t withHeader)
+    {
+        size_t blockSize = POOL_SMALLEST;
+        for (int c = 0; c < POOL_CLASSES; c++, blockSize *= 2)
+        {
+            if (withHeader <= blockSize)
+                return c;
+        }
+        return -1;
+    }
+
+    static void *poolAllocate(int c)
+    {
+        std::lock_guard<std::mutex> lock(g_pool.mutex);
+        void *&head = g_pool.freeLists[c];
+        if (!head)
+        {
+            size_t blockSize = POOL_SMALLEST << c;
+            uint8_t *chunk = static_cast<uint8_t *>(std::malloc(POOL_CHUNK));
+            if (!chunk)
+                return nullptr;
+            for (size_t offset = 0; offset + blockSize <= POOL_CHUNK; offset += blockSize)
+            {
+                *reinterpret_cast<void **>(chunk + offset) = head;
+                head = chunk + offset;
+            }
+            g_pool.chunkBytes.fetch_add(POOL_CHUNK, std::memory_order_relaxed);
+        }
+        void *block = head;
+        head = *static_cast<void **>(block);
+        return block;
+    }
+
+    static void poolFree(int c, void *block)
+    {
+        std::lock_guard<std::mutex> lock(g_pool.mutex);
+        *static_cast<void **>(block) = g_pool.freeLists[c];
+        g_pool.freeLists[c] = block;
+    }
+
+    static void *generalAllocate(size_t inSize)
+    {
+        int c = poolClass(inSize + GENERAL_HEADER);
+        void *block = c >= 0 ? poolAllocate(c) : std::malloc(inSize + GENERAL_HEADER);
+        uint8_t *raw = static_cast<uint8_t *>(block);
+        if (!raw)
+            return nullptr;
+        *reinterpret_cast<size_t *>(raw) = inSize;
+        countAlloc(PhysicsMemoryStats::GENERAL, inSize);
+        return raw + GENERAL_HEADER;
+    }
+
+    static void generalFree(void *inBlock)
+    {
+        if (!inBlock)
+            return;
+        uint8_t *raw = static_cast<uint8_t *>(inBlock) - GENERAL_HEADER;
+        size_t size = *reinterpret_cast<size_t *>(raw);
+        countFree(PhysicsMemoryStats::GENERAL, size);
+        int c = poolClass(size + GENERAL_HEADER);
+        if (c >= 0)
+        {
+            poolFree(c, raw);
+        }
+        else
+        {
+            std::free(raw);
+        }
+    }
+
+    static void *generalReallocate(void *inBlock, size_t inOldSize, size_t inNewSize)
+    {
+        // Still fits its pool block, only the size changes
+        int c = poolClass(inNewSize + GENERAL_HEADER);
+        if (inBlock && c >= 0 && c == poolClass(inOldSize + GENERAL_HEADER))
+        {
+            countFree(PhysicsMemoryStats::GENERAL, inOldSize);
+            countAlloc(PhysicsMemoryStats::GENERAL, inNewSize);
+            *reinterpret_cast<size_t *>(static_cast<uint8_t *>(inBlock) - GENERAL_HEADER) = inNewSize;
+            return inBlock;
+        }
+        void *block = generalAllocate(inNewSize);
+        if (block && inBlock)
+        {
+            std::memcpy(block, inBlock, inOldSize < inNewSize ? inOldSize : inNewSize);
+        }
+        generalFree(inBlock);
+        return block;
+    }
+
+    // Aligned blocks keep the raw malloc pointer and size right in front of them
+    struct AlignedHeader
+    {
+        void *raw;
+        size_t size;
+    };
+
+    static void *alignedAllocateAs(int category, size_t inSize, size_t inAlignment)
+    {
+        size_t total = inSize + inAlignment + sizeof(AlignedHeader);
+        uint8_t *raw = static_cast<uint8_t *>(std::malloc(total));
+        if (!raw)
+            return nullptr;
+
+        uintptr_t start = reinterpret_cast<uintptr_t>(raw) + sizeof(AlignedHeader);
+        uintptr_t aligned = (start + inAlignment - 1) & ~(uintptr_t(inAlignment) - 1);
+
+        AlignedHeader *header = reinterpret_cast<AlignedHeader *>(aligned) - 1;
+        header->raw = raw;
+        header->size = inSize;
+
+        countAlloc(category, inSize);
+        return reinterpret_cast<void *>(aligned);
+    }
+
+    static void alignedFreeAs(int category, void *inBlock)
+    {
+        if (!inBlock)
+            return;
+        AlignedHeader *header = static_cast<AlignedHeader *>(inBlock) - 1;
+        countFree(category, header->size);
+        std::free(header->raw);
+    }
+
+    static void *alignedAllocate(size_t inSize, size_t inAlignment)
+    {
+        return alignedAllocateAs(PhysicsMemoryStats::ALIGNED, inSize, inAlignment);
+    }
+
+    static void alignedFree(void *inBlock)
+    {
+        alignedFreeAs(PhysicsMemoryStats::ALIGNED, inBlock);
+    }
+
+    // Replaces JPH::RegisterDefaultAllocator(), must run before Jolt allocates anything
+    static void install()
+    {
+        JPH::Allocate = generalAllocate;
+        JPH::Reallocate = generalReallocate;
+        JPH::Free = generalFree;
+        JPH::AlignedAllocate = alignedAllocate;
+        JPH::AlignedFree = alignedFree;
+    }
+}
+
+/*
+ * Stack arena handed to PhysicsSystem::Update().
+ * Jolt allocates and frees in strict LIFO order within a step,
+ * so a bump pointer is enough. The high-water mark tells us how big
+ * the arena really needs to be. If it ever runs out, we fall back
+ * to malloc and count it, rather than crashing mid-step.
+ */
+class PhysicsTempArena : public JPH::TempAllocator
+{
+public:
+    explicit PhysicsTempArena(size_t capacity)
+        : mCapacity(capacity)
+    {
+        mRaw = static_cast<uint8_t *>(std::malloc(capacity + JPH_RVECTOR_ALIGNMENT));
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(mRaw) + JPH_RVECTOR_ALIGNMENT - 1) & ~uintptr_t(JPH_RVECTOR_ALIGNMENT - 1);
+        mBase = reinterpret_cast<uint8_t *>(aligned);
+    }
+
+    virtual ~PhysicsTempArena() override
+    {
+        std::free(mRaw);
+    }
+
+    virtual void *Allocate(JPH::uint inSize) override
+    {
+        if (inSize == 0)
+            return nullptr;
+
+        size_t size = JPH::AlignUp(inSize, JPH_RVECTOR_ALIGNMENT);
+
+        if (mTop + size > mCapacity)
+        {
+            if (mOverflowCount++ == 0)
+            {
+                std::cerr << "Physics temp arena of " << mCapacity
+                          << " bytes exhausted, falling back to malloc" << std::endl;
+            }
+            return PhysicsMemory::alignedAllocateAs(PhysicsMemoryStats::TEMP, size, JPH_RVECTOR_ALIGNMENT);
+        }
+
+        PhysicsMemory::countAlloc(PhysicsMemoryStats::TEMP, size);
+        void *block = mBase + mTop;
+        mTop += size;
+        if (mTop > mHighWater)
+            mHighWater = mTop;
+        return block;
+    }
+
+    virtual void Free(void *inAddress, JPH::uint inSize) override
+    {
+        if (!inAddress)
+            return;
+
+        uint8_t *p = static_cast<uint8_t *>(inAddress);
+        if (p < mBase || p >= mBase + mCapacity)
+        {
+            PhysicsMemory::alignedFreeAs(PhysicsMemoryStats::TEMP, inAddress);
+            return;
+        }
+
+        size_t size = JPH::AlignUp(inSize, JPH_RVECTOR_ALIGNMENT);
+        PhysicsMemory::countFree(PhysicsMemoryStats::TEMP, size);
+
+        // LIFO, so freed block is always on top
+        mTop -= size;
+    }
+
+    size_t mCapacity;
+    size_t mTop = 0;
+    size_t mHighWater = 0;
+    uint64_t mOverflowCount = 0;
+
+private:
+    uint8_t *mRaw;
+    uint8_t *mBase;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "physics/physics.h"
+#include "sidecar.h"
+
+/*
+ * Game side of server/server.cpp. With VTX_REFEREE=ws://host:8008 set
+ * (and a VTX_REFEREE build), every throw that goes on the scoreboard is
+ * sent the way it was launched. The server simulates it again on its own
+ * board and answers with its pins and total, shown next to ours in the
+ * debug window. Different numbers mean the throw did not replay the same.
+ */
+struct RefereeClient
+{
+    bool enabled = false;
+    bool newGamePending = false; // Sent once the connection is up
+    int sent = 0;
+    int answered = 0;
+    int lastPins = -1;
+    int total = 0;
+    std::string lastError;
+
+    void initRefereeClient()
+    {
+        const char *url = getenv("VTX_REFEREE");
+        this->enabled = url && acl::refereeConnect(url);
+        this->newGamePending = this->enabled;
+    }
+
+    // Right after the launch, from Physics::lastLaunch
+    void sendThrow(const PhysicsLaunch &l)
+    {
+        if (!this->enabled)
+            return;
+        this->flushNewGame();
+
+        char text[512];
+        snprintf(text, sizeof(text),
+                 "{\"type\":\"throw\","
+                 "\"position\":[%.9g,%.9g,%.9g],"
+                 "\"velocity\":[%.9g,%.9g,%.9g],"
+                 "\"angularVelocity\":[%.9g,%.9g,%.9g],"
+                 "\"spinSpeed\":%.9g}",
+                 l.position.x, l.position.y, l.position.z,
+                 l.velocity.x, l.velocity.y, l.velocity.z,
+                 l.angularVelocity.x, l.angularVelocity.y, l.angularVelocity.z,
+                 l.spinSpeed);
+        if (acl::refereeSend(text))
+        {
+            this->sent++;
+        }
+        else
+        {
+            this->lastError = "not connected, a throw went unrefereed";
+        }
+    }
+
+    // When our scoreboard starts over
+    void sendNewGame()
+    {
+        this->newGamePending = this->enabled;
+        this->flushNewGame();
+    }
+
+    void flushNewGame()
+    {
+        if (!this->newGamePending || !acl::refereeSend("{\"type\":\"new_game\"}"))
+            return;
+        this->newGamePending = false;
+        this->sent++;
+        this->lastPins = -1;
+        this->total = 0;
+        this->lastError.clear();
+    }
+
+    // Every frame, the answers come whenever the server is done
+    void pollRefereeClient()
+    {
+        if (!this->enabled)
+            return;
+        this->flushNewGame();
+
+        std::string msg;
+        while (acl::refereeReceive(msg))
+        {
+            this->answered++;
+            // The server writes it with nlohmann::json, no spaces
+            if (strstr(msg.c_str(), "\"type\":\"error\""))
+            {
+                const char *message = strstr(msg.c_str(), "\"message\":\"");
+                this->lastError = message ? std::string(message + 11, strcspn(message + 11, "\"")) : msg;
+                continue;
+            }
+            const char *pins = strstr(msg.c_str(), "\"pins\":");
+            const char *total = strstr(msg.c_str(), "\"total\":");
+            if (pins && total)
+            {
+                this->lastPins = atoi(pins + 7);
+                this->total = atoi(total + 8);
+            }
+        }
+    }
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "framework/gl_state.h"
+#include "mesh.h"
+
+// Fixed function state a draw needs, part of the sort key
+enum RenderState : uint8_t
+{
+    RENDER_DEPTH_TEST = 1 << 0,
+    RENDER_DEPTH_WRITE = 1 << 1,
+    RENDER_BLEND = 1 << 2,
+    RENDER_OPAQUE = RENDER_DEPTH_TEST | RENDER_DEPTH_WRITE,
+};
+
+struct RenderItem
+{
+    uint64_t key;
+    ShaderProgram *program;
+    AssetMesh *mesh;
+    GLuint texture;
+    uint8_t state;
+    glm::mat4 modelMatrix;
+};
+
+// How far in front of the camera the mesh centre is, the nearest visible
+// instance for instanced meshes (from the last cullInstances). For the sort
+// key, a centre is less fooled by a floor under the camera than a near edge.
+inline float meshViewDepth(const AssetMesh &mesh, const glm::mat4 &modelMatrix, const glm::mat4 &cameraMatrix)
+{
+    const CullSpheres &spheres = mesh.cullSpheres;
+    if (mesh.instanced && spheres.count > 0)
+    {
+        float nearest = 1e30f;
+        for (int i = 0; i < spheres.count; i++)
+        {
+            if (spheres.visible[i])
+            {
+                glm::vec4 p = cameraMatrix * glm::vec4(spheres.x[i], spheres.y[i], spheres.z[i], 1.0f);
+                nearest = glm::min(nearest, -p.z);
+            }
+        }
+        return nearest;
+    }
+    glm::vec4 p = cameraMatrix * modelMatrix * glm::vec4(glm::make_vec3(mesh.bounds.sphereCentre), 1.0f);
+    return -p.z;
+}
+
+/*
+ * Mesh draws are recorded during the frame and submitted in one go, sorted
+ * so draws sharing a program, texture and VAO are next to each other and
+ * the state cache can skip most of the binds.
+ *
+ * Key, high bits first:
+ *   opaque:  [0][state:3][depth, near first:4][program:16][texture:16][vao:16][order:8]
+ *   blended: [1][depth, far first:32][program:16][order:15]
+ * Opaque goes first, roughly front to back so the depth test rejects what
+ * is behind before it is shaded, blended after it back to front. Opaque
+ * depth is a log2 bucket, close draws still group by program inside one.
+ */
+struct RenderQueue
+{
+    std::vector<RenderItem> items;
+
+    // For the debug UI
+    int lastItemCount = 0;
+
+    void pushMesh(
+        ShaderPermutations &shader,
+        AssetMesh &mesh,
+        GLuint texture,
+        const glm::mat4 &modelMatrix,
+        uint8_t state = RENDER_OPAQUE,
+        float viewDepth = 0.0f)
+    {
+        ShaderProgram &program = shader.variantFor(mesh);
+        uint64_t order = this->items.size();
+        uint64_t key;
+        if (state & RENDER_BLEND)
+        {
+            uint32_t depthBits;
+            float depth = glm::max(viewDepth, 0.0f);
+            memcpy(&depthBits, &depth, sizeof(depthBits)); // Positive floats sort like their bits
+            key = (1ull << 63) |
+                  ((uint64_t)(~depthBits) << 31) |
+                  ((uint64_t)(program.id & 0xffff) << 15) |
+                  (order & 0x7fff);
+        }
+        else
+        {
+            uint64_t depthBucket = (uint64_t)glm::clamp(2.0f * glm::log2(1.0f + glm::max(viewDepth, 0.0f)), 0.0f, 15.0f);
+            key = ((uint64_t)(state & 0x7) << 60) |
+                  (depthBucket << 56) |
+                  ((uint64_t)(program.id & 0xffff) << 40) |
+                  ((uint64_t)(texture & 0xffff) << 24) |
+                  ((uint64_t)(mesh.meshVAO & 0xffff) << 8) |
+                  (order & 0xff);
+        }
+        this->items.push_back({key, &program, &mesh, texture, state, modelMatrix});
+    }
+
+    void submitRenderQueue()
+    {
+        std::sort(
+            this->items.begin(), this->items.end(),
+            [](const RenderItem &a, const RenderItem &b)
+            { return a.key < b.key; });
+
+        GlStateCache &gl = vtx::glState;
+        for (RenderItem &item : this->items)
+        {
+            gl.setEnabled(GlStateCache::CAP_DEPTH_TEST, item.state & RENDER_DEPTH_TEST);
+            gl.setDepthMask(item.state & RENDER_DEPTH_WRITE);
+            gl.setEnabled(GlStateCache::CAP_BLEND, item.state & RENDER_BLEND);
+            gl.useProgram(item.program->id);
+            gl.bindTexture(0, item.texture);
+            item.program->renderRealMesh(*item.mesh, item.modelMatrix);
+        }
+
+        this->lastItemCount = (int)this->items.size();
+        this->items.clear();
+    }
+};
@@ -0,0 +1,542 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "physics/physics.h"
+
+/*
+ * Records ball and pin poses every few physics steps, replays them without
+ * Jolt, interpolating in between.
+ *
+ * Stream of frames, one frame per REPLAY_STEP_DECIMATION fixed steps:
+ *   keyframe:  u16 mask (KEYFRAME bit) + every body [i16 x,y,z][u32 rot]
+ *   delta:     u16 mask (bit per body off its prediction) + for each of them
+ *              u8 mode + pos (3×i8 residual or 3×i16)
+ *                      + rot (3×i8 residual or u32, if not as predicted)
+ *
+ * Positions are millimetres in int16, rotations are smallest-three packed
+ * into 32 bits. Each body is predicted to keep going the way it went over
+ * the last two frames, only the miss is stored. Resting or coasting bodies
+ * cost nothing, a tumbling pin about 7 bytes. At 50 frames a second even
+ * 11 bodies missing completely every frame (123 bytes) keep a 10 s throw
+ * under 62 KB, a real one is well below.
+ * A keyframe every REPLAY_KEYFRAME_INTERVAL frames makes it seekable.
+ */
+
+#define REPLAY_BODIES PhysicsStepPoses::BODY_COUNT
+#define REPLAY_KEYFRAME_INTERVAL 32
+#define REPLAY_STEP_DECIMATION 4 // 5 ms steps, a frame every 20 ms
+
+namespace ReplayCodec
+{
+    static constexpr float POS_SCALE = 1000.0f; // 1 mm
+    static constexpr uint16_t KEYFRAME = 0x8000;
+
+    enum PosMode : uint8_t
+    {
+        POS_SAME = 0,
+        POS_DELTA = 1,
+        POS_FULL = 2,
+    };
+    static constexpr uint8_t ROT_CHANGED = 0x4; // Full u32
+    static constexpr uint8_t ROT_DELTA = 0x8;   // 3×i8 on the predicted components
+    static constexpr float SQRT2 = 1.41421356f;
+
+    struct QuantPose
+    {
+        int16_t pos[REPLAY_BODIES][3];
+        uint32_t rot[REPLAY_BODIES];
+    };
+
+    inline int16_t quantPos(float v)
+    {
+        float q = std::round(v * POS_SCALE);
+        return (int16_t)glm::clamp(q, -32767.0f, 32767.0f);
+    }
+
+    // Smallest three: drop the largest component (sign flipped so it is
+    // positive), keep 2 bits for which one it was and 10 bits for the rest
+    inline uint32_t packQuat(glm::quat q)
+    {
+        float c[4] = {q.x, q.y, q.z, q.w};
+        int largest = 0;
+        for (int i = 1; i < 4; i++)
+        {
+            if (std::fabs(c[i]) > std::fabs(c[largest]))
+                largest = i;
+        }
+        float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+        uint32_t packed = uint32_t(largest) << 30;
+        int shift = 20;
+        for (int i = 0; i < 4; i++)
+        {
+            if (i == largest)
+                continue;
+            float v = c[i] * sign * SQRT2; // -1..1
+            uint32_t u = (uint32_t)std::lround((glm::clamp(v, -1.0f, 1.0f) * 0.5f + 0.5f) * 1023.0f);
+            packed |= u << shift;
+            shift -= 10;
+        }
+        return packed;
+    }
+
+    inline glm::quat unpackQuat(uint32_t packed)
+    {
+        int largest = int(packed >> 30);
+        float c[4];
+        float sum = 0.0f;
+        int shift = 20;
+        for (int i = 0; i < 4; i++)
+        {
+            if (i == largest)
+                continue;
+            float u = float((packed >> shift) & 1023u) / 1023.0f;
+            c[i] = (u * 2.0f - 1.0f) / SQRT2;
+            sum += c[i] * c[i];
+            shift -= 10;
+        }
+        c[largest] = std::sqrt(glm::max(0.0f, 1.0f - sum));
+        return glm::normalize(glm::quat(c[3], c[0], c[1], c[2]));
+    }
+
+    // The three kept components, 0..1023, and which one was dropped
+    inline int unpackComponents(uint32_t packed, int c[3])
+    {
+        c[0] = int((packed >> 20) & 1023u);
+        c[1] = int((packed >> 10) & 1023u);
+        c[2] = int(packed & 1023u);
+        return int(packed >> 30);
+    }
+
+    inline uint32_t packComponents(int largest, const int c[3])
+    {
+        return uint32_t(largest) << 30 | uint32_t(c[0]) << 20 | uint32_t(c[1]) << 10 | uint32_t(c[2]);
+    }
+
+    // Same velocity as from before to last. Encoder and decoder both call
+    // these on the same quantised values, so they always agree.
+    inline int16_t predictPos(int16_t last, int16_t before)
+    {
+        return (int16_t)glm::clamp(2 * int(last) - int(before), -32767, 32767);
+    }
+
+    // Same for the packed components, as long as the dropped one stays the same
+    inline uint32_t predictRot(uint32_t last, uint32_t before)
+    {
+        int l[3], b[3], p[3];
+        int largest = unpackComponents(last, l);
+        if (unpackComponents(before, b) != largest)
+            return last;
+        for (int k = 0; k < 3; k++)
+        {
+            p[k] = 2 * l[k] - b[k];
+            if (p[k] < 0 || p[k] > 1023)
+                return last;
+        }
+        return packComponents(largest, p);
+    }
+
+    inline glm::mat4 toMatrix(const QuantPose &a, const QuantPose &b, float t, int body)
+    {
+        glm::vec3 pa(a.pos[body][0], a.pos[body][1], a.pos[body][2]);
+        glm::vec3 pb(b.pos[body][0], b.pos[body][1], b.pos[body][2]);
+        glm::vec3 pos = glm::mix(pa, pb, t) / POS_SCALE;
+        glm::quat rot = glm::slerp(unpackQuat(a.rot[body]), unpackQuat(b.rot[body]), t);
+        return glm::translate(glm::mat4(1.0f), pos) * glm::mat4_cast(rot);
+    }
+}
+
+// One throw, self contained, starts with a keyframe
+struct ReplayClip
+{
+    std::vector<uint8_t> data;
+    std::vector<uint32_t> keyframeOffsets; // frame i * REPLAY_KEYFRAME_INTERVAL
+    uint32_t frameCount = 0;
+    float stepSeconds = 0.02f;
+    int pinsDown = -1;
+
+    bool isEmpty() const
+    {
+        return this->frameCount == 0;
+    }
+
+    float duration() const
+    {
+        return this->frameCount * this->stepSeconds;
+    }
+};
+
+/*
+ * Records all the time into a byte ring, so memory never grows during play.
+ * markThrowStart() / finishThrow() cut the throw out into lastThrow,
+ * and into bestThrow if the player threw it and it took down the most
+ * pins so far. The bot's throws are not the player's best to race.
+ */
+struct ReplayRecorder
+{
+    std::vector<uint8_t> ring;
+    uint64_t written = 0; // total bytes ever written, ring position is modulo
+
+    ReplayCodec::QuantPose last;
+    ReplayCodec::QuantPose before; // frame before last, for the prediction
+    uint32_t framesSinceKeyframe = REPLAY_KEYFRAME_INTERVAL; // first frame is a keyframe
+    uint32_t stepsSkipped = 0;
+    float stepSeconds = 0.02f; // of a frame, not a physics step
+
+    bool throwActive = false;
+    bool throwByPlayer = false;
+    uint64_t throwStart = 0;
+    uint32_t throwFrames = 0;
+    std::vector<uint32_t> throwKeyframes; // relative to throwStart
+
+    ReplayClip lastThrow;
+    ReplayClip bestThrow;
+
+    void initReplayRecorder(size_t ringBytes)
+    {
+        this->ring.assign(ringBytes, 0);
+        this->throwKeyframes.reserve(1024);
+        this->lastThrow.data.reserve(64 * 1024);
+        this->bestThrow.data.reserve(64 * 1024);
+    }
+
+    static void onPhysicsStep(void *user, const PhysicsStepPoses &poses)
+    {
+        static_cast<ReplayRecorder *>(user)->recordStep(poses);
+    }
+
+    void markThrowStart(bool byPlayer)
+    {
+        this->throwByPlayer = byPlayer;
+        this->framesSinceKeyframe = REPLAY_KEYFRAME_INTERVAL;
+        this->stepsSkipped = REPLAY_STEP_DECIMATION - 1; // the next step starts it
+        this->throwActive = true;
+        this->throwStart = this->written;
+        this->throwFrames = 0;
+        this->throwKeyframes.clear();
+    }
+
+    void finishThrow(int pinsDown)
+    {
+        if (!this->throwActive)
+            return;
+        this->throwActive = false;
+
+        uint64_t bytes = this->written - this->throwStart;
+        if (this->throwFrames == 0 || bytes > this->ring.size())
+        {
+            // Longer than the ring, the start is gone
+            return;
+        }
+
+        ReplayClip &clip = this->lastThrow;
+        clip.data.resize(bytes);
+        readRing(this->throwStart, clip.data.data(), bytes);
+        clip.keyframeOffsets = this->throwKeyframes;
+        clip.frameCount = this->throwFrames;
+        clip.stepSeconds = this->stepSeconds;
+        clip.pinsDown = pinsDown;
+
+        if (this->throwByPlayer && pinsDown >= this->bestThrow.pinsDown)
+        {
+            this->bestThrow = clip;
+        }
+    }
+
+    void recordStep(const PhysicsStepPoses &poses)
+    {
+        using namespace ReplayCodec;
+
+        if (this->ring.empty())
+            return;
+        if (++this->stepsSkipped < REPLAY_STEP_DECIMATION)
+            return;
+        this->stepsSkipped = 0;
+        this->stepSeconds = poses.stepSeconds * REPLAY_STEP_DECIMATION;
+
+        QuantPose now;
+        for (int i = 0; i < REPLAY_BODIES; i++)
+        {
+            now.pos[i][0] = quantPos(poses.position[i].x);
+            now.pos[i][1] = quantPos(poses.position[i].y);
+            now.pos[i][2] = quantPos(poses.position[i].z);
+            now.rot[i] = packQuat(poses.rotation[i]);
+        }
+
+        // A frame is at most 2 + 11 * 11 bytes
+        uint8_t frame[2 + REPLAY_BODIES * 11];
+        size_t n = 0;
+
+        if (this->framesSinceKeyframe >= REPLAY_KEYFRAME_INTERVAL)
+        {
+            this->framesSinceKeyframe = 0;
+            if (this->throwActive)
+            {
+                this->throwKeyframes.push_back(uint32_t(this->written - this->throwStart));
+            }
+
+            put16(frame, n, KEYFRAME);
+            for (int i = 0; i < REPLAY_BODIES; i++)
+            {
+                for (int a = 0; a < 3; a++)
+                    put16(frame, n, uint16_t(now.pos[i][a]));
+                put32(frame, n, now.rot[i]);
+            }
+            // Seeking lands here with nothing before it, predict no motion
+            this->before = now;
+        }
+        else
+        {
+            uint16_t mask = 0;
+            size_t maskAt = n;
+            put16(frame, n, 0);
+
+            for (int i = 0; i < REPLAY_BODIES; i++)
+            {
+                int d[3];
+                bool posSame = true;
+                bool fitsDelta = true;
+                for (int a = 0; a < 3; a++)
+                {
+                    d[a] = int(now.pos[i][a]) - int(predictPos(this->last.pos[i][a], this->before.pos[i][a]));
+                    posSame = posSame && d[a] == 0;
+                    fitsDelta = fitsDelta && d[a] >= -127 && d[a] <= 127;
+                }
+                uint32_t predicted = predictRot(this->last.rot[i], this->before.rot[i]);
+                bool rotSame = now.rot[i] == predicted;
+                if (posSame && rotSame)
+                    continue;
+
+                int r[3];
+                bool rotFitsDelta = false;
+                if (!rotSame)
+                {
+                    int c[3], p[3];
+                    rotFitsDelta = unpackComponents(now.rot[i], c) == unpackComponents(predicted, p);
+                    for (int k = 0; k < 3; k++)
+                    {
+                        r[k] = c[k] - p[k];
+                        rotFitsDelta = rotFitsDelta && r[k] >= -127 && r[k] <= 127;
+                    }
+                }
+
+                mask |= uint16_t(1u << i);
+                uint8_t mode = posSame ? POS_SAME : (fitsDelta ? POS_DELTA : POS_FULL);
+                if (!rotSame)
+                    mode |= rotFitsDelta ? ROT_DELTA : ROT_CHANGED;
+                frame[n++] = mode;
+
+                if ((mode & 3) == POS_DELTA)
+                {
+                    for (int a = 0; a < 3; a++)
+                        frame[n++] = uint8_t(int8_t(d[a]));
+                }
+                else if ((mode & 3) == POS_FULL)
+                {
+                    for (int a = 0; a < 3; a++)
+                        put16(frame, n, uint16_t(now.pos[i][a]));
+                }
+                if (mode & ROT_DELTA)
+                {
+                    for (int k = 0; k < 3; k++)
+                        frame[n++] = uint8_t(int8_t(r[k]));
+                }
+                else if (mode & ROT_CHANGED)
+                {
+                    put32(frame, n, now.rot[i]);
+                }
+            }
+            frame[maskAt] = uint8_t(mask);
+            frame[maskAt + 1] = uint8_t(mask >> 8);
+            this->before = this->last;
+        }
+
+        writeRing(frame, n);
+        this->last = now;
+        this->framesSinceKeyframe++;
+        if (this->throwActive)
+        {
+            this->throwFrames++;
+        }
+    }
+
+private:
+    static void put16(uint8_t *out, size_t &n, uint16_t v)
+    {
+        out[n++] = uint8_t(v);
+        out[n++] = uint8_t(v >> 8);
+    }
+
+    static void put32(uint8_t *out, size_t &n, uint32_t v)
+    {
+        put16(out, n, uint16_t(v));
+        put16(out, n, uint16_t(v >> 16));
+    }
+
+    void writeRing(const uint8_t *src, size_t n)
+    {
+        size_t size = this->ring.size();
+        size_t at = size_t(this->written % size);
+        size_t first = glm::min(n, size - at);
+        memcpy(&this->ring[at], src, first);
+        memcpy(&this->ring[0], src + first, n - first);
+        this->written += n;
+    }
+
+    void readRing(uint64_t from, uint8_t *dst, size_t n) const
+    {
+        size_t size = this->ring.size();
+        size_t at = size_t(from % size);
+        size_t first = glm::min(n, size - at);
+        memcpy(dst, &this->ring[at], first);
+        memcpy(dst + first, &this->ring[0], n - first);
+    }
+};
+
+/*
+ * Plays a clip back, seek anywhere. Decodes forward from the nearest
+ * keyframe, and keeps going from where it was when time only moves ahead.
+ */
+struct ReplayPlayer
+{
+    const ReplayClip *clip = nullptr;
+
+    ReplayCodec::QuantPose prev;
+    ReplayCodec::QuantPose curr;
+    ReplayCodec::QuantPose before; // predicts the next frame with curr, as in the recorder
+    int decodedFrame = -1; // frame held in curr
+    size_t offset = 0;     // next frame in clip->data
+
+    void playReplay(const ReplayClip *clip)
+    {
+        this->clip = clip;
+        this->decodedFrame = -1;
+        this->offset = 0;
+    }
+
+    // Ball matrix and pin matrices at `seconds` into the clip.
+    // Returns false when there is nothing to show.
+    bool sampleReplay(float seconds, glm::mat4 *ballMatrix, glm::mat4 *pinMatrices)
+    {
+        if (!this->clip || this->clip->isEmpty())
+            return false;
+
+        int lastFrame = int(this->clip->frameCount) - 1;
+        float f = glm::max(0.0f, seconds / this->clip->stepSeconds);
+        int frame = glm::min(int(f), lastFrame);
+        int next = glm::min(frame + 1, lastFrame);
+        float t = next == frame ? 0.0f : f - float(frame);
+
+        decodeTo(next);
+        const ReplayCodec::QuantPose &a = next == frame ? this->curr : this->prev;
+        const ReplayCodec::QuantPose &b = this->curr;
+
+        if (ballMatrix)
+        {
+            *ballMatrix = ReplayCodec::toMatrix(a, b, t, 0);
+        }
+        if (pinMatrices)
+        {
+            for (int i = 0; i < 10; i++)
+                pinMatrices[i] = ReplayCodec::toMatrix(a, b, t, i + 1);
+        }
+        return true;
+    }
+
+private:
+    void decodeTo(int frame)
+    {
+        if (frame < this->decodedFrame || frame - this->decodedFrame > REPLAY_KEYFRAME_INTERVAL)
+        {
+            // Start one frame early so prev is valid too
+            int key = glm::max(frame - 1, 0) / REPLAY_KEYFRAME_INTERVAL;
+            key = glm::min(key, int(this->clip->keyframeOffsets.size()) - 1);
+            this->offset = this->clip->keyframeOffsets[key];
+            this->decodedFrame = key * REPLAY_KEYFRAME_INTERVAL - 1;
+        }
+        while (this->decodedFrame < frame)
+        {
+            this->prev = this->curr;
+            decodeFrame();
+            this->decodedFrame++;
+        }
+    }
+
+    uint16_t get16()
+    {
+        const uint8_t *d = this->clip->data.data();
+        uint16_t v = uint16_t(d[this->offset] | (d[this->offset + 1] << 8));
+        this->offset += 2;
+        return v;
+    }
+
+    uint32_t get32()
+    {
+        uint32_t lo = get16();
+        uint32_t hi = get16();
+        return lo | (hi << 16);
+    }
+
+    void decodeFrame()
+    {
+        using namespace ReplayCodec;
+        const uint8_t *d = this->clip->data.data();
+
+        uint16_t mask = get16();
+        if (mask & KEYFRAME)
+        {
+            for (int i = 0; i < REPLAY_BODIES; i++)
+            {
+                for (int a = 0; a < 3; a++)
+                    this->curr.pos[i][a] = int16_t(get16());
+                this->curr.rot[i] = get32();
+            }
+            this->before = this->curr;
+            return;
+        }
+
+        QuantPose next;
+        for (int i = 0; i < REPLAY_BODIES; i++)
+        {
+            for (int a = 0; a < 3; a++)
+                next.pos[i][a] = predictPos(this->curr.pos[i][a], this->before.pos[i][a]);
+            next.rot[i] = predictRot(this->curr.rot[i], this->before.rot[i]);
+            if (!(mask & (1u << i)))
+                continue;
+
+            uint8_t mode = d[this->offset++];
+            if ((mode & 3) == POS_DELTA)
+            {
+                for (int a = 0; a < 3; a++)
+                    next.pos[i][a] = int16_t(next.pos[i][a] + int8_t(d[this->offset++]));
+            }
+            else if ((mode & 3) == POS_FULL)
+            {
+                for (int a = 0; a < 3; a++)
+                    next.pos[i][a] = int16_t(get16());
+            }
+            if (mode & ROT_DELTA)
+            {
+                int c[3];
+                int largest = unpackComponents(next.rot[i], c);
+                for (int k = 0; k < 3; k++)
+                    c[k] += int8_t(d[this->offset++]);
+                next.rot[i] = packComponents(largest, c);
+            }
+            else if (mode & ROT_CHANGED)
+            {
+                next.rot[i] = get32();
+            }
+        }
+        this->before = this->curr;
+        this->curr = next;
+    }
+};
@@ -0,0 +1,434 @@
+// Headless referee for online play.
+// Clients send what they launched the ball with, we simulate the throw
+// again with the same physics and keep the real scoreboard.
+//
+//   server [-p 8008] [-h 127.0.0.1] [-j <cores>]
+//
+// Protocol is JSON over WebSocket:
+//   → {"type":"throw","position":[x,y,z],"velocity":[x,y,z],"angularVelocity":[x,y,z],"spinSpeed":s}
+//   → {"type":"new_game"}
+//   ← {"type":"result","pins":n,"total":t,"frameCompleted":b,"gameOver":b}
+//   ← {"type":"error","message":"..."}
+//
+// Simulations run in forked worker processes (one per core), each with
+// its own Physics world. Sessions are just a scoreboard and pin
+// state, they cost nothing while the worker pool does the heavy lifting.
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cerrno>
+#include <csignal>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <ixwebsocket/IXNetSystem.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <nlohmann/json.hpp>
+
+#include "asset_pack.h"
+#include "physics/lane.h"
+#include "physics/physics.h"
+#include "score.h"
+
+using json = nlohmann::json;
+
+struct SimRequest
+{
+    PhysicsLaunch launch;
+    bool pinDead[10];
+};
+
+struct SimResult
+{
+    int32_t down; // -1 when the worker failed
+    bool pinDead[10];
+};
+
+static bool readAll(int fd, void *dst, size_t n)
+{
+    uint8_t *p = static_cast<uint8_t *>(dst);
+    while (n > 0)
+    {
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        p += r;
+        n -= r;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void *src, size_t n)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(src);
+    while (n > 0)
+    {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false; // EPIPE when the reader is gone, SIGPIPE is ignored
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+// Runs in the child, never returns
+static void runWorker(int in, int out)
+{
+    AssetPack assets;
+    if (!assets.openAssetPack("assets/files/bowling.pack"))
+        exit(1);
+    MeshData laneMd = assets.meshFromPack("lane");
+    std::vector<float> lanePositions = meshPositions(laneMd);
+    std::vector<uint32_t> laneIndices = meshIndices(laneMd);
+
+    glm::vec3 pins[10];
+    lane_rack_pins(pins);
+
+    Physics phy;
+    phy.physics_init(
+        lanePositions.data(),
+        lanePositions.size(),
+        laneIndices.data(),
+        laneIndices.size(),
+        pins,
+        LANE_BALL_START);
+
+    SimRequest req;
+    while (readAll(in, &req, sizeof(req)))
+    {
+        for (int i = 0; i < 10; i++)
+            phy.mPinDead[i] = req.pinDead[i];
+        phy.physics_reset(pins, LANE_BALL_START, false);
+
+        lane_relaunch(phy, req.launch);
+
+        SimResult res;
+        res.down = lane_simulate_until_settled(phy, 1.0f / 60.0f);
+        for (int i = 0; i < 10; i++)
+            res.pinDead[i] = phy.mPinDead[i];
+
+        if (!writeAll(out, &res, sizeof(res)))
+            break;
+    }
+    _exit(0);
+}
+
+/*
+ * Fixed set of worker processes. A connection thread borrows an idle one,
+ * blocks on the pipe while it simulates, and gives it back. A worker that
+ * dies is reaped and never comes back, when none are left every throw
+ * gets an error instead of waiting.
+ */
+struct SimPool
+{
+    struct Worker
+    {
+        pid_t pid;
+        int toWorker;
+        int fromWorker;
+    };
+
+    std::vector<Worker> workers;
+    std::vector<int> idle;
+    int alive = 0;
+    std::mutex mutex;
+    std::condition_variable available;
+
+    bool startSimPool(int count)
+    {
+        for (int w = 0; w < count; w++)
+        {
+            int down[2], up[2];
+            if (pipe(down) != 0 || pipe(up) != 0)
+            {
+                perror("pipe");
+                return false;
+            }
+            pid_t pid = fork();
+            if (pid < 0)
+            {
+                perror("fork");
+                return false;
+            }
+            if (pid == 0)
+            {
+                // Parent ends of the earlier workers' pipes came along with the fork,
+                // holding them would keep those workers from seeing EOF at shutdown
+                for (const Worker &other : this->workers)
+                {
+                    close(other.toWorker);
+                    close(other.fromWorker);
+                }
+                close(down[1]);
+                close(up[0]);
+                runWorker(down[0], up[1]);
+            }
+            close(down[0]);
+            close(up[1]);
+            this->workers.push_back({pid, down[1], up[0]});
+            this->idle.push_back(w);
+            this->alive++;
+        }
+        return true;
+    }
+
+    SimResult simulate(const SimRequest &req)
+    {
+        int w;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->available.wait(lock, [this] { return !this->idle.empty() || this->alive == 0; });
+            if (this->alive == 0)
+            {
+                SimResult res;
+                res.down = -1;
+                return res;
+            }
+            w = this->idle.back();
+            this->idle.pop_back();
+        }
+
+        SimResult res;
+        Worker &worker = this->workers[w];
+        if (!writeAll(worker.toWorker, &req, sizeof(req)) ||
+            !readAll(worker.fromWorker, &res, sizeof(res)))
+        {
+            // Dead worker stays out of the pool, nobody else holds its index
+            std::cerr << "Simulation worker " << worker.pid << " is gone" << std::endl;
+            this->stopWorker(worker);
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->alive--;
+                if (this->alive == 0)
+                    std::cerr << "No simulation workers left" << std::endl;
+            }
+            this->available.notify_all(); // Waiters must see alive == 0
+            res.down = -1;
+            return res;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->idle.push_back(w);
+        }
+        this->available.notify_one();
+        return res;
+    }
+
+    // EOF on its pipe ends the worker's loop, then it is reaped
+    static void stopWorker(Worker &worker)
+    {
+        if (worker.pid < 0)
+            return;
+        close(worker.toWorker);
+        close(worker.fromWorker);
+        waitpid(worker.pid, nullptr, 0);
+        worker.pid = -1;
+    }
+
+    // After the server stopped, no connection thread is in simulate()
+    void stopSimPool()
+    {
+        for (Worker &w : this->workers)
+        {
+            stopWorker(w);
+        }
+    }
+};
+
+// One per connection. ix calls back on the connection's own thread,
+// so a session is never touched by two threads at once.
+class BowlingSession : public ix::ConnectionState
+{
+public:
+    BowlingScoreboard board;
+    bool pinDead[10] = {false};
+    int wereDead = 0;
+
+    BowlingSession()
+    {
+        resetScoreboard(this->board);
+    }
+};
+
+static bool readVec3(const json &j, const char *key, glm::vec3 *out)
+{
+    auto it = j.find(key);
+    if (it == j.end() || !it->is_array() || it->size() != 3)
+        return false;
+    for (int i = 0; i < 3; i++)
+    {
+        if (!(*it)[i].is_number())
+            return false;
+        float v = (*it)[i].get<float>();
+        if (!std::isfinite(v))
+            return false;
+        (*out)[i] = v;
+    }
+    return true;
+}
+
+// Anything the aim phase can not produce is a tampered throw
+static bool isPlausibleLaunch(const PhysicsLaunch &l)
+{
+    glm::vec3 fromRelease = l.position - LANE_RELEASE_POINT;
+    return std::fabs(fromRelease.x) < 1.0f &&
+           l.position.y > 0.0f && l.position.y < 2.0f &&
+           std::fabs(fromRelease.z) < 4.0f &&
+           glm::length(l.velocity) < 30.0f &&
+           glm::length(l.angularVelocity) < 300.0f &&
+           std::isfinite(l.spinSpeed) && std::fabs(l.spinSpeed) < 0.5f;
+}
+
+static std::string errorMessage(const std::string &message)
+{
+    return json{{"type", "error"}, {"message", message}}.dump();
+}
+
+static std::string handleThrow(BowlingSession &s, SimPool &pool, const json &msg)
+{
+    if (isGameFinished(&s.board))
+        return errorMessage("game is over, send new_game");
+
+    SimRequest req;
+    if (!readVec3(msg, "position", &req.launch.position) ||
+        !readVec3(msg, "velocity", &req.launch.velocity) ||
+        !readVec3(msg, "angularVelocity", &req.launch.angularVelocity) ||
+        !msg.contains("spinSpeed") || !msg["spinSpeed"].is_number())
+    {
+        return errorMessage("malformed throw");
+    }
+    req.launch.spinSpeed = msg["spinSpeed"].get<float>();
+    if (!isPlausibleLaunch(req.launch))
+        return errorMessage("throw out of range");
+
+    for (int i = 0; i < 10; i++)
+        req.pinDead[i] = s.pinDead[i];
+
+    SimResult res = pool.simulate(req);
+    if (res.down < 0)
+        return errorMessage("simulation failed, throw not counted");
+
+    // Same bookkeeping as the THROW phase in game.cpp
+    int pins = res.down - s.wereDead;
+    bool frameCompleted = addRoll(&s.board, pins);
+    s.wereDead += res.down;
+    for (int i = 0; i < 10; i++)
+        s.pinDead[i] = res.pinDead[i];
+    if (frameCompleted)
+    {
+        s.wereDead = 0;
+        for (int i = 0; i < 10; i++)
+            s.pinDead[i] = false;
+    }
+
+    return json{
+        {"type", "result"},
+        {"pins", pins},
+        {"total", s.board.totalScore},
+        {"frameCompleted", frameCompleted},
+        {"gameOver", isGameFinished(&s.board)},
+    }
+        .dump();
+}
+
+int main(int argc, char **argv)
+{
+    std::unordered_map<std::string, std::string> options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        options[argv[i]] = argv[i + 1];
+    }
+    auto opt = [&](const char *key, const std::string &fallback) {
+        auto it = options.find(key);
+        return it == options.end() ? fallback : it->second;
+    };
+
+    int port = std::stoi(opt("-p", "8008"));
+    std::string host = opt("-h", "127.0.0.1");
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    int workers = std::stoi(opt("-j", std::to_string(cores)));
+
+    // A worker dying mid-write must be an EPIPE, not the end of the server.
+    // Set before forking, so workers writing to a gone server get EPIPE too.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Fork before any thread exists
+    SimPool pool;
+    if (!pool.startSimPool(workers))
+        return 1;
+
+    ix::initNetSystem();
+
+    ix::WebSocketServer server(port, host);
+    server.setConnectionStateFactory([]() {
+        return std::make_shared<BowlingSession>();
+    });
+    server.setOnClientMessageCallback(
+        [&pool](std::shared_ptr<ix::ConnectionState> state,
+                ix::WebSocket &ws,
+                const ix::WebSocketMessagePtr &msg) {
+            if (msg->type != ix::WebSocketMessageType::Message)
+                return;
+
+            BowlingSession &session = *std::static_pointer_cast<BowlingSession>(state);
+
+            json request = json::parse(msg->str, nullptr, false);
+            if (request.is_discarded() || !request.is_object() || !request.contains("type"))
+            {
+                ws.send(errorMessage("not json"));
+                return;
+            }
+
+            std::string type = request["type"].is_string() ? request["type"].get<std::string>() : "";
+            if (type == "throw")
+            {
+                ws.send(handleThrow(session, pool, request));
+            }
+            else if (type == "new_game")
+            {
+                resetScoreboard(session.board);
+                session.wereDead = 0;
+                for (int i = 0; i < 10; i++)
+                    session.pinDead[i] = false;
+                ws.send(json{{"type", "result"}, {"pins", 0}, {"total", 0},
+                             {"frameCompleted", false}, {"gameOver", false}}
+                            .dump());
+            }
+            else
+            {
+                ws.send(errorMessage("unknown type: " + type));
+            }
+        });
+
+    auto res = server.listen();
+    if (!res.first)
+    {
+        std::cerr << "Cannot listen on " << host << ":" << port << ": " << res.second << std::endl;
+        return 1;
+    }
+    server.disablePerMessageDeflate();
+    server.start();
+    std::cout << "Listening on ws://" << host << ":" << port
+              << " with " << workers << " simulation workers" << std::endl;
+    server.wait();
+
+    pool.stopSimPool();
+    ix::uninitNetSystem();
+    return 0;
+}
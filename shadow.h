@@ -0,0 +1,314 @@
+#pragma once
+
+#include "framework/gl_header.h"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include <iostream>
+
+#include "framework/boot.h"
+#include "framework/gl_util.h"
+#include "mesh.h"
+
+/*
+ * #4shadows, two depth maps from one directional light:
+ *
+ * - static: the lane, big, only redrawn when the light direction changes
+ *   (or after a hot reload), so it costs nothing in a normal frame
+ * - dynamic: pins and balls, small, redrawn every frame but fitted tightly
+ *   around the deck so its few texels all land where the shadows are
+ *
+ * The main shader looks up both and keeps the darker one.
+ */
+struct ShadowMaps
+{
+    static const char *DEPTH_VERTEX_SHADER;
+    static const char *DEPTH_FRAGMENT_SHADER;
+
+    static constexpr int STATIC_SIZE = 2048;
+    static constexpr int DYNAMIC_SIZE = 512;
+
+    struct DepthMap
+    {
+        GLuint fbo;
+        GLuint texture;
+        int size;
+        glm::mat4 lightSpaceMatrix = glm::mat4(1.0f); // Goes in FrameUniforms before the first shadow pass too
+    };
+    DepthMap staticMap;
+    DepthMap dynamicMap;
+
+    // Depth only program, one without and one with instancing.
+    // No skinned variant, bones are ignored: nothing that casts is skinned.
+    GLuint depthShaderIds[2] = {0, 0};
+    GLint lightSpaceMatrixLocs[2], modelToWorldLocs[2], posScaleLocs[2], posOffsetLocs[2];
+
+    glm::vec3 lightDirection = glm::vec3(0.0f); // Towards the light
+    glm::mat4 lightView;
+    float lightNear, lightFar; // Depth range of the lane in light view, shared by both maps
+    bool staticDirty = true;
+    int staticRenders = 0; // For the debug UI, stays low when caching works
+
+    void initShadowMaps()
+    {
+        this->initDepthMap(this->staticMap, STATIC_SIZE);
+        this->initDepthMap(this->dynamicMap, DYNAMIC_SIZE);
+        this->loadShadowShader();
+        checkOpenGLError("INIT_SHADOW_MAPS");
+    }
+
+    void initDepthMap(DepthMap &map, int size)
+    {
+        map.size = size;
+        glGenTextures(1, &map.texture);
+        vtx::glState.bindTexture(0, map.texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, size, size);
+        // Hardware compare with linear filter, 2x2 PCF for free
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+        GLint previousFbo;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+        glGenFramebuffers(1, &map.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, map.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, map.texture, 0);
+        GLenum none = GL_NONE;
+        glDrawBuffers(1, &none);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "Shadow map framebuffer is not complete" << std::endl;
+            exit(1);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+    }
+
+    // At init and again on every hot reload
+    void loadShadowShader()
+    {
+        // Unbound first, a new program can get the old name and the cache would skip binding it
+        vtx::glState.useProgram(0);
+        for (GLuint &id : this->depthShaderIds)
+        {
+            if (id)
+            {
+                glDeleteProgram(id);
+                id = 0;
+            }
+        }
+
+        std::string vertexSources[2], fragmentSources[2];
+        const char *vs[2], *fs[2];
+        for (int instanced = 0; instanced < 2; instanced++)
+        {
+            std::string header = std::string(GLSL_VERSION) + "\n" + (instanced ? "#define INSTANCED\n" : "");
+            vertexSources[instanced] = header + DEPTH_VERTEX_SHADER;
+            fragmentSources[instanced] = header + DEPTH_FRAGMENT_SHADER;
+            vs[instanced] = vertexSources[instanced].c_str();
+            fs[instanced] = fragmentSources[instanced].c_str();
+        }
+        vtx::createShaderPrograms(2, vs, fs, this->depthShaderIds);
+
+        for (int i = 0; i < 2; i++)
+        {
+            this->lightSpaceMatrixLocs[i] = glGetUniformLocation(this->depthShaderIds[i], "u_lightSpaceMatrix");
+            this->modelToWorldLocs[i] = glGetUniformLocation(this->depthShaderIds[i], "u_modelToWorld");
+            this->posScaleLocs[i] = glGetUniformLocation(this->depthShaderIds[i], "u_posScale");
+            this->posOffsetLocs[i] = glGetUniformLocation(this->depthShaderIds[i], "u_posOffset");
+        }
+
+        // New code may draw a different lane
+        this->staticDirty = true;
+    }
+
+    /*
+     * Light view and the static map cover the whole lane, `laneModel` places it in the world.
+     * Cheap when nothing changed, so it can be called every frame.
+     */
+    void updateStaticShadowMap(
+        AssetMesh &laneMesh,
+        const glm::mat4 &laneModel,
+        const glm::vec3 &towardsLight)
+    {
+        glm::vec3 direction = glm::normalize(towardsLight);
+        if (!this->staticDirty && glm::all(glm::lessThan(glm::abs(direction - this->lightDirection), glm::vec3(1e-4f))))
+        {
+            return;
+        }
+        this->lightDirection = direction;
+        this->staticDirty = false;
+        this->staticRenders++;
+
+        // Lane box corners in world space
+        glm::vec3 boxMin = glm::make_vec3(laneMesh.bounds.aabbMin);
+        glm::vec3 boxMax = glm::make_vec3(laneMesh.bounds.aabbMax);
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec3 c((i & 1) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 4) ? boxMax.z : boxMin.z);
+            corners[i] = glm::vec3(laneModel * glm::vec4(c, 1.0f));
+        }
+        glm::vec3 centre = 0.5f * (corners[0] + corners[7]);
+        glm::vec3 up = glm::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        this->lightView = glm::lookAt(centre + direction, centre, up);
+
+        glm::vec3 lightMin(1e30f), lightMax(-1e30f);
+        for (const glm::vec3 &c : corners)
+        {
+            glm::vec3 p = glm::vec3(this->lightView * glm::vec4(c, 1.0f));
+            lightMin = glm::min(lightMin, p);
+            lightMax = glm::max(lightMax, p);
+        }
+        // Looking down -z, a bit of slack so nothing touches the planes
+        this->lightNear = -lightMax.z - 0.5f;
+        this->lightFar = -lightMin.z + 0.5f;
+
+        this->staticMap.lightSpaceMatrix =
+            glm::ortho(lightMin.x, lightMax.x, lightMin.y, lightMax.y, this->lightNear, this->lightFar) * this->lightView;
+
+        this->beginDepthPass(this->staticMap);
+        this->renderDepth(laneMesh, laneModel, this->staticMap.lightSpaceMatrix);
+        this->endDepthPass();
+    }
+
+    /*
+     * Every frame, after the instances were sent to the GPU. Only what is
+     * visible on camera casts, anything the frustum culled is left out.
+     */
+    void updateDynamicShadowMap(AssetMesh **casters, int casterCount)
+    {
+        // Fit around the caster spheres as seen from the light
+        glm::vec2 lightMin(1e30f), lightMax(-1e30f);
+        for (int m = 0; m < casterCount; m++)
+        {
+            const CullSpheres &spheres = casters[m]->cullSpheres;
+            for (int i = 0; i < spheres.count; i++)
+            {
+                if (!spheres.visible[i])
+                {
+                    continue;
+                }
+                glm::vec3 p = glm::vec3(this->lightView * glm::vec4(spheres.x[i], spheres.y[i], spheres.z[i], 1.0f));
+                lightMin = glm::min(lightMin, glm::vec2(p) - spheres.radius[i]);
+                lightMax = glm::max(lightMax, glm::vec2(p) + spheres.radius[i]);
+            }
+        }
+        if (lightMin.x > lightMax.x)
+        {
+            // Nothing to cast, a box nobody is in
+            lightMin = glm::vec2(1e6f);
+            lightMax = lightMin + 1.0f;
+        }
+
+        this->dynamicMap.lightSpaceMatrix =
+            glm::ortho(lightMin.x, lightMax.x, lightMin.y, lightMax.y, this->lightNear, this->lightFar) * this->lightView;
+
+        this->beginDepthPass(this->dynamicMap);
+        for (int m = 0; m < casterCount; m++)
+        {
+            this->renderDepth(*casters[m], glm::mat4(1.0f), this->dynamicMap.lightSpaceMatrix);
+        }
+        this->endDepthPass();
+    }
+
+    GLint previousFbo;
+    GLint previousViewport[4];
+
+    void beginDepthPass(DepthMap &map)
+    {
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &this->previousFbo);
+        glGetIntegerv(GL_VIEWPORT, this->previousViewport);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, map.fbo);
+        glViewport(0, 0, map.size, map.size);
+        vtx::glState.setDepthMask(true);
+        vtx::glState.setEnabled(GlStateCache::CAP_DEPTH_TEST, true);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        // Pushes depth away from the light instead of a big bias in the shader
+        vtx::glState.setEnabled(GlStateCache::CAP_POLYGON_OFFSET_FILL, true);
+        glPolygonOffset(2.0f, 4.0f);
+    }
+
+    void endDepthPass()
+    {
+        vtx::glState.setEnabled(GlStateCache::CAP_POLYGON_OFFSET_FILL, false);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->previousFbo);
+        glViewport(this->previousViewport[0], this->previousViewport[1], this->previousViewport[2], this->previousViewport[3]);
+    }
+
+    // Coarsest LOD for everything, nobody can tell in a shadow
+    void renderDepth(AssetMesh &mesh, const glm::mat4 &modelMatrix, const glm::mat4 &lightSpaceMatrix)
+    {
+        int v = mesh.instanced ? 1 : 0;
+        vtx::glState.useProgram(this->depthShaderIds[v]);
+        glUniformMatrix4fv(this->lightSpaceMatrixLocs[v], 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+        glUniformMatrix4fv(this->modelToWorldLocs[v], 1, GL_FALSE, glm::value_ptr(modelMatrix));
+        glUniform3fv(this->posScaleLocs[v], 1, glm::value_ptr(mesh.posScale));
+        glUniform3fv(this->posOffsetLocs[v], 1, glm::value_ptr(mesh.posOffset));
+
+        const MeshLod &lod = mesh.lods[mesh.lodCount - 1];
+        size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        void *indices = (void *)(lod.indexOffset * indexSize);
+
+        vtx::glState.bindVertexArray(mesh.meshVAO);
+        if (mesh.instanced)
+        {
+            int count = mesh.lodFirstInstance[MESH_MAX_LODS];
+            if (count > 0)
+            {
+                if (mesh.boundFirstInstance != 0)
+                {
+                    mesh.bindInstanceAttributes(0);
+                }
+                glDrawElementsInstanced(GL_TRIANGLES, lod.indexCount, mesh.indexType, indices, count);
+            }
+        }
+        else
+        {
+            glDrawElements(GL_TRIANGLES, lod.indexCount, mesh.indexType, indices);
+        }
+    }
+};
+
+const char *ShadowMaps::DEPTH_VERTEX_SHADER =
+    R"(
+    precision highp float;
+
+    layout (location = 0) in vec3 a_pos;
+#ifdef INSTANCED
+    layout (location = 6) in vec3 a_positionOffset;
+    layout (location = 7) in vec3 a_scaleOffset;
+    layout (location = 9) in vec4 a_instRot;
+#endif
+
+    uniform mat4 u_lightSpaceMatrix;
+    uniform mat4 u_modelToWorld;
+    uniform vec3 u_posScale;
+    uniform vec3 u_posOffset;
+
+    void main() {
+        vec3 localPos = a_pos * u_posScale + u_posOffset;
+#ifdef INSTANCED
+        // Same as the main shader, see rotateVecByQuat there
+        vec3 v = localPos * a_scaleOffset;
+        vec3 u = a_instRot.xyz;
+        float s = a_instRot.w;
+        localPos = 2.0 * dot(u, v) * u + (s * s - dot(u, u)) * v + 2.0 * s * cross(u, v) + a_positionOffset;
+#endif
+        gl_Position = u_lightSpaceMatrix * u_modelToWorld * vec4(localPos, 1.0);
+    }
+    )";
+
+const char *ShadowMaps::DEPTH_FRAGMENT_SHADER =
+    R"(
+    precision highp float;
+
+    void main() {
+    }
+    )";
@@ -1,4 +1,12 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "sidecar.h"
 
@@ -6,14 +14,51 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#ifdef VTX_REFEREE
+#ifdef __EMSCRIPTEN__
+#include <emscripten/websocket.h>
+#else
+#include <ixwebsocket/IXNetSystem.h>
+#include <ixwebsocket/IXWebSocket.h>
+#endif
+#endif
+
 namespace acl
 {
-    struct LoadedImageInternal
+    // stb's flip flag is global, flip here so workers do not race on it
+    static bool decodeImage(const char* path, bool flip, LoadedImage& out)
     {
-        LoadedImage pub; // what plugin sees
-    };
+        int w = 0;
+        int h = 0;
+        int c = 0;
 
-    static LoadedImageInternal g_imageSlot; // one slot (can be expanded later)
+        unsigned char* data = stbi_load(path, &w, &h, &c, 0);
+        if (!data)
+        {
+            out = LoadedImage{};
+            return false;
+        }
+
+        if (flip)
+        {
+            size_t stride = (size_t)w * c;
+            std::vector<unsigned char> row(stride);
+            for (int y = 0; y < h / 2; y++)
+            {
+                unsigned char* a = data + y * stride;
+                unsigned char* b = data + (h - 1 - y) * stride;
+                memcpy(row.data(), a, stride);
+                memcpy(a, b, stride);
+                memcpy(b, row.data(), stride);
+            }
+        }
+
+        out.data = data;
+        out.width = w;
+        out.height = h;
+        out.channels = c;
+        return true;
+    }
 
     const LoadedImage* loadImage(const char* path, bool flip)
     {
@@ -21,43 +66,334 @@ namespace acl
         if (!path)
             return nullptr;
 
-        stbi_set_flip_vertically_on_load(flip ? 1 : 0);
+        LoadedImage* img = new LoadedImage{};
+        if (!decodeImage(path, flip, *img))
+        {
+            delete img;
+            return nullptr;
+        }
+        return img;
+    }
 
-        int w = 0;
-        int h = 0;
-        int c = 0;
+    void freeImage(const LoadedImage* img)
+    {
+        if (!img)
+            return;
 
-        unsigned char* data = stbi_load(path, &w, &h, &c, 0);
-        if (!data)
+        stbi_image_free((void*)img->data);
+        delete img;
+    }
+
+    // ---- Asynchronous loading ----
+
+    static const int MAX_IMAGES = 64;
+
+    struct ImageSlot
+    {
+        uint16_t generation = 0;
+        ImageState state = IMAGE_INVALID;
+        bool released = false; // Handle dropped while a worker still had it
+        bool flip = false;
+        std::string path;
+        LoadedImage image = {};
+    };
+
+    struct ImageLoader
+    {
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<int> queue;
+        std::vector<std::thread> workers;
+        ImageSlot slots[MAX_IMAGES];
+        bool stopping = false;
+
+        ~ImageLoader()
         {
-            // Failed
-            g_imageSlot.pub.data = nullptr;
-            g_imageSlot.pub.width = 0;
-            g_imageSlot.pub.height = 0;
-            g_imageSlot.pub.channels = 0;
-            return nullptr;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stopping = true;
+            }
+            this->wake.notify_all();
+            for (std::thread& t : this->workers)
+            {
+                t.join();
+            }
+            for (ImageSlot& slot : this->slots)
+            {
+                stbi_image_free(slot.image.data);
+            }
+        }
+
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            for (;;)
+            {
+                this->wake.wait(lock, [this] { return this->stopping || !this->queue.empty(); });
+                if (this->stopping)
+                    return;
+
+                int index = this->queue.front();
+                this->queue.pop_front();
+                std::string path = this->slots[index].path;
+                bool flip = this->slots[index].flip;
+
+                lock.unlock();
+                LoadedImage image;
+                bool ok = decodeImage(path.c_str(), flip, image);
+                lock.lock();
+
+                this->finish(index, ok, image);
+            }
+        }
+
+        // Under the lock
+        void finish(int index, bool ok, const LoadedImage& image)
+        {
+            ImageSlot& slot = this->slots[index];
+            if (slot.released)
+            {
+                stbi_image_free(image.data);
+                slot.released = false;
+                slot.state = IMAGE_INVALID;
+                return;
+            }
+            if (!ok)
+                std::cerr << "Failed to decode image " << slot.path << std::endl;
+            slot.image = image;
+            slot.state = ok ? IMAGE_READY : IMAGE_FAILED;
+        }
+
+        // Under the lock, nullptr for stale handles
+        ImageSlot* lookup(ImageHandle handle)
+        {
+            int index = (int)(handle & 0xffff) - 1;
+            if (index < 0 || index >= MAX_IMAGES)
+                return nullptr;
+            ImageSlot& slot = this->slots[index];
+            if (slot.generation != (handle >> 16) || slot.state == IMAGE_INVALID || slot.released)
+                return nullptr;
+            return &slot;
+        }
+    };
+
+    static ImageLoader g_loader;
+
+    ImageHandle requestImage(const char* path, bool flip)
+    {
+        if (!path)
+            return 0;
+
+        std::unique_lock<std::mutex> lock(g_loader.mutex);
+
+#ifndef __EMSCRIPTEN__
+        if (g_loader.workers.empty())
+        {
+            // Leave a core for the game and one for the driver
+            int count = std::clamp((int)std::thread::hardware_concurrency() - 2, 1, 4);
+            for (int i = 0; i < count; i++)
+                g_loader.workers.emplace_back([] { g_loader.work(); });
+            std::cerr << "Image loader: " << count << " decode threads" << std::endl;
+        }
+#endif
+
+        int index = 0;
+        while (index < MAX_IMAGES && g_loader.slots[index].state != IMAGE_INVALID)
+            index++;
+        if (index == MAX_IMAGES)
+        {
+            std::cerr << "Image loader is full, not loading " << path << std::endl;
+            return 0;
         }
 
-        g_imageSlot.pub.data = data;
-        g_imageSlot.pub.width = w;
-        g_imageSlot.pub.height = h;
-        g_imageSlot.pub.channels = c;
+        ImageSlot& slot = g_loader.slots[index];
+        slot.generation++;
+        if (slot.generation == 0)
+            slot.generation = 1;
+        slot.state = IMAGE_PENDING;
+        slot.released = false;
+        slot.flip = flip;
+        slot.path = path;
+        slot.image = LoadedImage{};
 
-        return &g_imageSlot.pub;
+#ifdef __EMSCRIPTEN__
+        // No threads on the web, the files are preloaded into memory anyway
+        LoadedImage image;
+        bool ok = decodeImage(path, flip, image);
+        g_loader.finish(index, ok, image);
+#else
+        g_loader.queue.push_back(index);
+        lock.unlock();
+        g_loader.wake.notify_one();
+#endif
+
+        return ((ImageHandle)slot.generation << 16) | (ImageHandle)(index + 1);
     }
 
-    void freeImage(const LoadedImage* img)
+    ImageState imageState(ImageHandle handle)
     {
-        if (!img || !img->data)
+        std::lock_guard<std::mutex> lock(g_loader.mutex);
+        ImageSlot* slot = g_loader.lookup(handle);
+        return slot ? slot->state : IMAGE_INVALID;
+    }
+
+    const LoadedImage* imageData(ImageHandle handle)
+    {
+        std::lock_guard<std::mutex> lock(g_loader.mutex);
+        ImageSlot* slot = g_loader.lookup(handle);
+        // Ready slots are not touched by workers, safe to hand out
+        return slot && slot->state == IMAGE_READY ? &slot->image : nullptr;
+    }
+
+    void releaseImage(ImageHandle handle)
+    {
+        std::lock_guard<std::mutex> lock(g_loader.mutex);
+        ImageSlot* slot = g_loader.lookup(handle);
+        if (!slot)
             return;
 
-        // cast back to internal container
-        stbi_image_free((void*)img->data);
+        if (slot->state == IMAGE_PENDING)
+        {
+            // The worker frees it when it lands
+            slot->released = true;
+            return;
+        }
+        stbi_image_free(slot->image.data);
+        slot->image = LoadedImage{};
+        slot->state = IMAGE_INVALID;
+    }
+
+    // ---- Referee connection ----
+
+#ifdef VTX_REFEREE
+    struct RefereeSocket
+    {
+        std::mutex mutex; // ix calls back on its own thread
+        std::deque<std::string> inbox;
+#ifdef __EMSCRIPTEN__
+        EMSCRIPTEN_WEBSOCKET_T socket = 0;
+        bool open = false;
+#else
+        ix::WebSocket* socket = nullptr;
+#endif
+    };
+
+    static RefereeSocket g_referee;
 
-        // reset slot
-        g_imageSlot.pub.data = nullptr;
-        g_imageSlot.pub.width = 0;
-        g_imageSlot.pub.height = 0;
-        g_imageSlot.pub.channels = 0;
+    static void refereeDeliver(std::string text)
+    {
+        std::lock_guard<std::mutex> lock(g_referee.mutex);
+        g_referee.inbox.push_back(std::move(text));
+    }
+
+#ifdef __EMSCRIPTEN__
+    static EM_BOOL onRefereeOpen(int, const EmscriptenWebSocketOpenEvent*, void*)
+    {
+        g_referee.open = true;
+        return EM_TRUE;
+    }
+
+    static EM_BOOL onRefereeClose(int, const EmscriptenWebSocketCloseEvent*, void*)
+    {
+        // The browser does not reconnect, a reload does
+        g_referee.open = false;
+        std::cerr << "Referee connection closed" << std::endl;
+        return EM_TRUE;
+    }
+
+    static EM_BOOL onRefereeMessage(int, const EmscriptenWebSocketMessageEvent* e, void*)
+    {
+        if (e->isText)
+            refereeDeliver(std::string((const char*)e->data));
+        return EM_TRUE;
+    }
+#endif
+
+    bool refereeConnect(const char* url)
+    {
+#ifdef __EMSCRIPTEN__
+        if (g_referee.socket > 0)
+            return true;
+        EmscriptenWebSocketCreateAttributes attributes;
+        emscripten_websocket_init_create_attributes(&attributes);
+        attributes.url = url;
+        g_referee.socket = emscripten_websocket_new(&attributes);
+        if (g_referee.socket <= 0)
+        {
+            std::cerr << "Cannot open a WebSocket to " << url << std::endl;
+            g_referee.socket = 0;
+            return false;
+        }
+        emscripten_websocket_set_onopen_callback(g_referee.socket, nullptr, onRefereeOpen);
+        emscripten_websocket_set_onclose_callback(g_referee.socket, nullptr, onRefereeClose);
+        emscripten_websocket_set_onmessage_callback(g_referee.socket, nullptr, onRefereeMessage);
+#else
+        if (g_referee.socket)
+            return true;
+        ix::initNetSystem();
+        g_referee.socket = new ix::WebSocket();
+        g_referee.socket->setUrl(url);
+        g_referee.socket->setOnMessageCallback([](const ix::WebSocketMessagePtr& msg) {
+            if (msg->type == ix::WebSocketMessageType::Message)
+                refereeDeliver(msg->str);
+            else if (msg->type == ix::WebSocketMessageType::Error)
+                std::cerr << "Referee connection: " << msg->errorInfo.reason << std::endl;
+        });
+        g_referee.socket->start();
+#endif
+        std::cerr << "Referee at " << url << std::endl;
+        return true;
+    }
+
+    bool refereeConnected()
+    {
+#ifdef __EMSCRIPTEN__
+        return g_referee.open;
+#else
+        return g_referee.socket && g_referee.socket->getReadyState() == ix::ReadyState::Open;
+#endif
+    }
+
+    bool refereeSend(const char* text)
+    {
+        if (!refereeConnected())
+            return false;
+#ifdef __EMSCRIPTEN__
+        return emscripten_websocket_send_utf8_text(g_referee.socket, text) == EMSCRIPTEN_RESULT_SUCCESS;
+#else
+        return g_referee.socket->sendText(text).success;
+#endif
+    }
+
+    bool refereeReceive(std::string& out)
+    {
+        std::lock_guard<std::mutex> lock(g_referee.mutex);
+        if (g_referee.inbox.empty())
+            return false;
+        out = std::move(g_referee.inbox.front());
+        g_referee.inbox.pop_front();
+        return true;
+    }
+#else
+    bool refereeConnect(const char* url)
+    {
+        std::cerr << "Built without VTX_REFEREE, not connecting to " << url << std::endl;
+        return false;
+    }
+
+    bool refereeConnected()
+    {
+        return false;
+    }
+
+    bool refereeSend(const char*)
+    {
+        return false;
+    }
+
+    bool refereeReceive(std::string&)
+    {
+        return false;
     }
-}
\ No newline at end of file
+#endif
+}
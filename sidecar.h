@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include <string>
 
 namespace acl
 {
@@ -12,9 +13,51 @@ namespace acl
         // host keeps ownership; plugin must *not* free this
     };
 
-    // Returns nullptr if failed
+    // Returns nullptr if failed, decodes on the calling thread
     const LoadedImage* loadImage(const char* path, bool flip);
 
     // Free image (host frees it, plugin just calls)
     void freeImage(const LoadedImage* img);
-}
\ No newline at end of file
+
+    // ---- Asynchronous loading ----
+    // Decoding happens on the host's worker threads (inline on the web,
+    // no threads there). Poll with imageState, read with imageData once
+    // ready, and always releaseImage the handle, also when it failed.
+
+    typedef uint32_t ImageHandle; // 0 is never a valid handle
+
+    enum ImageState
+    {
+        IMAGE_INVALID, // Unknown or released handle
+        IMAGE_PENDING,
+        IMAGE_READY,
+        IMAGE_FAILED,
+    };
+
+    // 0 when the handle table is full
+    ImageHandle requestImage(const char* path, bool flip);
+
+    ImageState imageState(ImageHandle handle);
+
+    // nullptr unless IMAGE_READY, valid until releaseImage
+    const LoadedImage* imageData(ImageHandle handle);
+
+    // Frees the pixels, a still pending decode is thrown away when it lands
+    void releaseImage(ImageHandle handle);
+
+    // ---- Referee connection ----
+    // One WebSocket to server/server.cpp, kept by the host so it outlives
+    // a hot reload. Text in and out, the JSON is the game's business.
+    // Reconnects by itself. Builds without VTX_REFEREE never connect.
+
+    // False when this build has no referee
+    bool refereeConnect(const char* url);
+
+    bool refereeConnected();
+
+    // False when not connected, the message is dropped
+    bool refereeSend(const char* text);
+
+    // Oldest message not taken yet, false when there is none
+    bool refereeReceive(std::string& out);
+}
@@ -0,0 +1,258 @@
+// Offline sweep of throws through the physics.
+// Writes a table the game mmaps for the bot and the aim assist.
+//
+//   strikegen -o assets/files/strike.tbl [-x 21] [-v 12] [-s 13] [-k 4] [-j <cores>]
+//
+// The physics is one global world per process, so instead of threads
+// every worker is a forked process. They pull cells from a shared counter
+// and write straight into a shared mapping of the output file layout.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "asset_pack.h"
+#include "assets/api/strike_table.h"
+#include "physics/lane.h"
+#include "physics/physics.h"
+
+struct SweepShared
+{
+    std::atomic<uint32_t> nextCell;
+    std::atomic<uint32_t> doneCells;
+};
+
+// Spread the samples over the cell instead of hitting its centre every time.
+// Physics is deterministic, so this is what makes the histogram worth having.
+static float sampleOffset(uint32_t k, uint32_t samples, float phase)
+{
+    float u = std::fmod((float(k) + 0.5f) / float(samples) + phase, 1.0f);
+    return u - 0.5f;
+}
+
+static float cellStep(float lo, float hi, uint32_t count)
+{
+    return count < 2 ? 0.0f : (hi - lo) / float(count - 1);
+}
+
+static void runWorker(const StrikeTableHeader *h, StrikeCell *cells, SweepShared *shared)
+{
+    AssetPack assets;
+    if (!assets.openAssetPack("assets/files/bowling.pack"))
+        exit(1);
+    MeshData laneMd = assets.meshFromPack("lane");
+    std::vector<float> lanePositions = meshPositions(laneMd);
+    std::vector<uint32_t> laneIndices = meshIndices(laneMd);
+
+    glm::vec3 pins[10];
+    lane_rack_pins(pins);
+
+    Physics phy;
+    phy.physics_init(
+        lanePositions.data(),
+        lanePositions.size(),
+        laneIndices.data(),
+        laneIndices.size(),
+        pins,
+        LANE_BALL_START);
+
+    const float stepX = cellStep(h->minX, h->maxX, h->countX);
+    const float stepSpeed = cellStep(h->minSpeed, h->maxSpeed, h->countSpeed);
+    const float stepSpin = cellStep(h->minSpin, h->maxSpin, h->countSpin);
+    const uint32_t total = strikeTableCellCount(h);
+
+    while (true)
+    {
+        uint32_t index = shared->nextCell.fetch_add(1);
+        if (index >= total)
+            break;
+
+        float x, speed, spin;
+        strikeTableCellParams(h, index, &x, &speed, &spin);
+
+        uint32_t counts[11] = {0};
+        for (uint32_t k = 0; k < h->samplesPerCell; k++)
+        {
+            float sx = x + stepX * sampleOffset(k, h->samplesPerCell, 0.0f);
+            float sv = speed + stepSpeed * sampleOffset(k, h->samplesPerCell, 0.618f);
+            float ss = spin + stepSpin * sampleOffset(k, h->samplesPerCell, 0.382f);
+
+            phy.physics_reset(pins, LANE_BALL_START, true);
+            lane_launch(phy, sx, sv, ss);
+            int down = lane_simulate_until_settled(phy, 1.0f / 60.0f);
+            counts[glm::clamp(down, 0, 10)]++;
+        }
+
+        StrikeCell &cell = cells[index];
+        float expected = 0.0f;
+        for (int n = 0; n <= 10; n++)
+        {
+            float p = float(counts[n]) / float(h->samplesPerCell);
+            cell.histogram[n] = uint8_t(std::lround(p * 255.0f));
+            expected += p * float(n);
+        }
+        cell.expectedPins = uint8_t(std::lround(expected * 25.0f));
+        cell.strikeChance = cell.histogram[10];
+
+        shared->doneCells.fetch_add(1);
+    }
+}
+
+// Rest of the sweep is worthless once one worker is gone, don't leave them running
+static void stopWorkers(const std::vector<pid_t> &children)
+{
+    for (pid_t pid : children)
+    {
+        kill(pid, SIGTERM);
+    }
+    for (pid_t pid : children)
+    {
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::unordered_map<std::string, std::string> options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        options[argv[i]] = argv[i + 1];
+    }
+    auto opt = [&](const char *key, const std::string &fallback) {
+        auto it = options.find(key);
+        return it == options.end() ? fallback : it->second;
+    };
+
+    std::string output = opt("-o", "");
+    if (output.empty())
+    {
+        std::cerr << "Usage: strikegen -o <output> [-x 21] [-v 12] [-s 13] [-k 4] [-j cores]\n";
+        return 1;
+    }
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    int workers = std::stoi(opt("-j", std::to_string(cores)));
+
+    StrikeTableHeader header = {};
+    header.magic = STRIKE_TABLE_MAGIC;
+    header.version = STRIKE_TABLE_VERSION;
+    header.countX = std::stoul(opt("-x", "21"));
+    header.countSpeed = std::stoul(opt("-v", "12"));
+    header.countSpin = std::stoul(opt("-s", "13"));
+    header.samplesPerCell = std::stoul(opt("-k", "4"));
+    // Same ranges the aim phase can produce
+    header.minX = -0.45f;
+    header.maxX = 0.45f;
+    header.minSpeed = 4.0f;
+    header.maxSpeed = 17.0f;
+    header.minSpin = -0.1f;
+    header.maxSpin = 0.1f;
+
+    const uint32_t total = strikeTableCellCount(&header);
+    if (total == 0 || header.samplesPerCell == 0)
+    {
+        std::cerr << "Empty grid" << std::endl;
+        return 1;
+    }
+    header.cellsOffset = sizeof(StrikeTableHeader);
+    header.rankedOffset = header.cellsOffset + total * sizeof(StrikeCell);
+    header.rankedCount = total;
+
+    size_t cellsBytes = total * sizeof(StrikeCell);
+    void *mapping = mmap(nullptr, sizeof(SweepShared) + cellsBytes,
+                         PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    SweepShared *shared = new (mapping) SweepShared();
+    StrikeCell *cells = reinterpret_cast<StrikeCell *>(static_cast<uint8_t *>(mapping) + sizeof(SweepShared));
+
+    std::cout << "→ sweeping " << total << " cells × " << header.samplesPerCell
+              << " throws on " << workers << " workers\n";
+
+    std::vector<pid_t> children;
+    for (int w = 0; w < workers; w++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            break;
+        }
+        if (pid == 0)
+        {
+            runWorker(&header, cells, shared);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+
+    while (!children.empty())
+    {
+        int status;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0)
+        {
+            children.erase(std::find(children.begin(), children.end(), pid));
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                std::cerr << "Worker " << pid << " died" << std::endl;
+                stopWorkers(children);
+                return 1;
+            }
+            continue;
+        }
+        std::cout << "\r   " << shared->doneCells.load() << " / " << total << std::flush;
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    std::cout << "\r   " << shared->doneCells.load() << " / " << total << "\n";
+
+    if (shared->doneCells.load() != total)
+    {
+        std::cerr << "Not every cell was simulated" << std::endl;
+        return 1;
+    }
+
+    // Best first: strikes, then pins down
+    std::vector<uint32_t> ranked(total);
+    for (uint32_t i = 0; i < total; i++)
+        ranked[i] = i;
+    std::stable_sort(ranked.begin(), ranked.end(), [&](uint32_t a, uint32_t b) {
+        if (cells[a].strikeChance != cells[b].strikeChance)
+            return cells[a].strikeChance > cells[b].strikeChance;
+        return cells[a].expectedPins > cells[b].expectedPins;
+    });
+
+    FILE *f = fopen(output.c_str(), "wb");
+    if (!f)
+    {
+        perror(output.c_str());
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(cells, sizeof(StrikeCell), total, f);
+    fwrite(ranked.data(), sizeof(uint32_t), total, f);
+    fclose(f);
+
+    const StrikeCell &best = cells[ranked[0]];
+    std::cout << "   best cell: " << best.strikeChance * 100 / 255 << "% strikes, "
+              << best.expectedPins / 25.0f << " pins\n";
+    std::cout << "   output: " << output << "\n";
+
+    return 0;
+}
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cstdio>
 #include <iostream>
+#include <vector>
 
 #include "framework/gl_header.h"
+#include "framework/gl_state.h"
 
+#include "assets/api/texture_data.h"
 #include "sidecar.h"
 
 struct Texture
@@ -18,13 +22,35 @@ struct Texture
         const unsigned char *my_image, size_t size, const bool flip = false);
     void loadTextureFromFile(
         const char *path, const bool flip = false);
+    bool loadTextureFromKtx(const char *path);
+    void loadTexture(const char *ktxPath, const char *pngPath);
 };
 
+// ETC2 is core in GLES3, but WebGL and desktop GL only have it when listed
+static bool compressedFormatSupported(GLenum format)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+    std::vector<GLint> formats(count > 0 ? count : 0);
+    if (count > 0)
+    {
+        glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+    }
+    for (GLint f : formats)
+    {
+        if ((GLenum)f == format)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Texture::loadTextureFromStbi(const unsigned char *stbiData, int width, int height, int nrChannels)
 {
     GLuint hudTexture;
     glGenTextures(1, &hudTexture);
-    glBindTexture(GL_TEXTURE_2D, hudTexture);
+    vtx::glState.bindTexture(0, hudTexture);
 
     // Set filtering to nearest (closest UV sampling)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -41,7 +67,6 @@ void Texture::loadTextureFromStbi(const unsigned char *stbiData, int width, int
         glTexImage2D(
             GL_TEXTURE_2D, 0, format, width, height, 0, format,
             GL_UNSIGNED_BYTE, stbiData);
-        glGenerateMipmap(GL_TEXTURE_2D);
         this->id = hudTexture;
         this->width = width;
         this->height = height;
@@ -63,7 +88,7 @@ void Texture::loadTextureFromStbi(const unsigned char *stbiData, int width, int
 //     stbi_set_flip_vertically_on_load(flip ? 1 : 0); // Reset to default after loading
 
 //     glGenTextures(1, &hudTexture);
-//     glBindTexture(GL_TEXTURE_2D, hudTexture);
+//     vtx::glState.bindTexture(0, hudTexture);
 
 //     // Set filtering to nearest (closest UV sampling)
 //     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -100,13 +125,18 @@ void Texture::loadTextureFromFile(const char *texturePath, const bool flip)
 
     std::cerr << "Start of loading image " << std::endl;
     const acl::LoadedImage *li = acl::loadImage(texturePath, flip);
+    if (!li)
+    {
+        std::cerr << "Failed to load texture at: " << texturePath << std::endl;
+        abort();
+    }
     unsigned char *data = li->data;
     int width = li->width;
     int height = li->height;
     int nrChannels = li->channels;
 
     glGenTextures(1, &hudTexture);
-    glBindTexture(GL_TEXTURE_2D, hudTexture);
+    vtx::glState.bindTexture(0, hudTexture);
 
     // Set filtering to nearest (closest UV sampling)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -123,7 +153,6 @@ void Texture::loadTextureFromFile(const char *texturePath, const bool flip)
         glTexImage2D(
             GL_TEXTURE_2D, 0, format, width, height, 0, format,
             GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
         this->id = hudTexture;
         this->width = width;
         this->height = height;
@@ -136,3 +165,97 @@ void Texture::loadTextureFromFile(const char *texturePath, const bool flip)
         abort();
     }
 }
+
+// Made by `assman texture`, blocks and mips go to the GPU untouched.
+// Returns false when the file is missing or the GPU can not take it.
+bool Texture::loadTextureFromKtx(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    std::vector<uint8_t> file(fileSize > 0 ? fileSize : 0);
+    bool read = fread(file.data(), 1, file.size(), f) == file.size();
+    fclose(f);
+
+    KtxHeader header;
+    if (!read || file.size() < sizeof(header))
+    {
+        std::cerr << "Texture file is cut short: " << path << std::endl;
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (!ktxHeaderValid(header))
+    {
+        std::cerr << "Not an ETC2 KTX texture: " << path << std::endl;
+        return false;
+    }
+    if (!compressedFormatSupported(header.glInternalFormat))
+    {
+        std::cerr << "ETC2 not supported by the GPU, skipping " << path << std::endl;
+        return false;
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    vtx::glState.bindTexture(0, texture);
+
+    size_t offset = sizeof(header) + header.bytesOfKeyValueData;
+    uint32_t w = header.pixelWidth;
+    uint32_t h = header.pixelHeight;
+    uint32_t level = 0;
+    for (; level < header.numberOfMipmapLevels; level++)
+    {
+        uint32_t imageSize;
+        if (offset + sizeof(imageSize) > file.size())
+        {
+            break;
+        }
+        memcpy(&imageSize, &file[offset], sizeof(imageSize));
+        offset += sizeof(imageSize);
+        if (imageSize != ktxLevelSize(header.glInternalFormat, w, h) || offset + imageSize > file.size())
+        {
+            break;
+        }
+        glCompressedTexImage2D(
+            GL_TEXTURE_2D, level, header.glInternalFormat, w, h, 0,
+            imageSize, &file[offset]);
+        offset += (imageSize + 3) & ~3u;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    if (level == 0)
+    {
+        std::cerr << "Texture has no usable levels: " << path << std::endl;
+        glDeleteTextures(1, &texture);
+        return false;
+    }
+
+    // The chain may stop short of 1x1, say where, or the texture is incomplete
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+
+    // Texels stay sharp up close, mips only kick in when minified
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, level > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    this->id = texture;
+    this->width = header.pixelWidth;
+    this->height = header.pixelHeight;
+    std::cerr << "Loaded " << path << ", " << level << " mip levels, " << file.size() << " bytes" << std::endl;
+    return true;
+}
+
+// Compressed when we have it, the PNG otherwise
+void Texture::loadTexture(const char *ktxPath, const char *pngPath)
+{
+    if (!this->loadTextureFromKtx(ktxPath))
+    {
+        this->loadTextureFromFile(pngPath);
+    }
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "framework/boot.h"
+#include "framework/gl_header.h"
+#include "framework/gl_state.h"
+
+#include "sidecar.h"
+#include "texture.h"
+
+/*
+ * Textures that show up while the game runs. The sidecar decodes them on
+ * its worker threads; here, on the GL thread, finished images go up
+ * through pixel unpack buffers in strips of rows, and only for
+ * `budgetMs` each frame, so a big image is spread over a few frames
+ * rather than hitching one.
+ *
+ * The GL texture exists from the request on, as a 1x1 white placeholder,
+ * so callers can hand out the id straight away. The strips go into a texture
+ * of their own, swapped into the Texture's id once the last row is up, so
+ * draws never sample a half uploaded image. Read the id every frame.
+ */
+struct TextureStreamer
+{
+    static constexpr int PBO_COUNT = 2;
+    static constexpr size_t STRIP_BYTES = 512 * 1024;
+
+    struct Job
+    {
+        acl::ImageHandle image;
+        Texture *target;
+        int rowsDone = 0;
+        GLuint texture = 0; // Being filled, not drawn with yet
+    };
+
+    GLuint pbos[PBO_COUNT];
+    size_t pboBytes[PBO_COUNT] = {};
+    int nextPbo = 0;
+    std::vector<Job> jobs;
+
+    float budgetMs = 2.0f;
+
+    // For the debug UI
+    int pendingCount = 0;
+    float lastUploadMs = 0.0f;
+
+    void initTextureStreamer()
+    {
+        glGenBuffers(PBO_COUNT, this->pbos);
+    }
+
+    static void setSamplerParams()
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+
+    void requestTexture(const char *path, Texture &target, bool flip = false)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        vtx::glState.bindTexture(0, texture);
+        const unsigned char white[4] = {255, 255, 255, 255};
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+        setSamplerParams();
+        target.id = texture;
+        target.width = 1;
+        target.height = 1;
+
+        acl::ImageHandle image = acl::requestImage(path, flip);
+        if (!image)
+        {
+            return; // Stays white, the sidecar said why
+        }
+        this->jobs.push_back({image, &target});
+    }
+
+    // Once a frame on the GL thread, before anything samples the textures
+    void pumpUploads()
+    {
+        this->pendingCount = (int)this->jobs.size();
+        if (this->jobs.empty())
+        {
+            return;
+        }
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        uint64_t budget = (uint64_t)(this->budgetMs / 1000.0f * SDL_GetPerformanceFrequency());
+        bool uploaded = false;
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0; i < this->jobs.size();)
+        {
+            Job &job = this->jobs[i];
+            acl::ImageState state = acl::imageState(job.image);
+            if (state == acl::IMAGE_PENDING)
+            {
+                i++;
+                continue;
+            }
+            if (state == acl::IMAGE_READY)
+            {
+                // At least one strip a frame, however tight the budget
+                bool overBudget = uploaded && SDL_GetPerformanceCounter() - start > budget;
+                if (overBudget || !this->uploadStrips(job, start, budget))
+                {
+                    i++;
+                    continue;
+                }
+                uploaded = true;
+            }
+
+            acl::releaseImage(job.image);
+            this->jobs.erase(this->jobs.begin() + i);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // Or later uploads read from it
+
+        this->lastUploadMs = (float)((double)(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+    }
+
+    // True when the whole image is up
+    bool uploadStrips(Job &job, uint64_t start, uint64_t budget)
+    {
+        const acl::LoadedImage *li = acl::imageData(job.image);
+        GLenum format = li->channels == 4 ? GL_RGBA : GL_RGB;
+        size_t stride = (size_t)li->width * li->channels;
+
+        bool first = !job.texture;
+        if (first)
+        {
+            glGenTextures(1, &job.texture);
+        }
+        vtx::glState.bindTexture(0, job.texture);
+        if (first)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, li->width, li->height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+            setSamplerParams();
+        }
+
+        int rowsPerStrip = (int)std::max(STRIP_BYTES / stride, (size_t)1);
+        do
+        {
+            int rows = std::min(rowsPerStrip, li->height - job.rowsDone);
+            size_t bytes = rows * stride;
+
+            const unsigned char *src = li->data + job.rowsDone * stride;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->pbos[this->nextPbo]);
+            size_t &capacity = this->pboBytes[this->nextPbo];
+            this->nextPbo = (this->nextPbo + 1) % PBO_COUNT;
+            if (bytes > capacity)
+            {
+                capacity = std::max(bytes, STRIP_BYTES);
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+            }
+
+#ifdef __EMSCRIPTEN__
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, bytes, src);
+#else
+            // Invalidated, so a buffer the GPU is still reading from is not waited on
+            void *dst = glMapBufferRange(
+                GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (dst)
+            {
+                memcpy(dst, src, bytes);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            else
+            {
+                glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, bytes, src);
+            }
+#endif
+            glTexSubImage2D(
+                GL_TEXTURE_2D, 0, 0, job.rowsDone, li->width, rows,
+                format, GL_UNSIGNED_BYTE, (const void *)0);
+            job.rowsDone += rows;
+        } while (job.rowsDone < li->height && SDL_GetPerformanceCounter() - start <= budget);
+
+        if (job.rowsDone < li->height)
+        {
+            return false;
+        }
+        vtx::glState.deleteTexture(job.target->id); // The placeholder
+        job.target->id = job.texture;
+        job.target->width = li->width;
+        job.target->height = li->height;
+        return true;
+    }
+};
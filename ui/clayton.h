@@ -6,6 +6,9 @@
 // C++ libs
 #include <stdlib.h>
 
+#include "../framework/gl_state.h"
+#include "../framework/stream_buffer.h"
+
 // C libs
 #define CLAY_IMPLEMENTATION
 #include <clay.h>
@@ -58,9 +61,8 @@ typedef struct
     // CPU-side temporary buffer of vertices
     GlyphVtx *glyph_vertices;
 
-    // GPU VBO/VAO
+    // GPU VAO, vertices come from the renderer's stream
     GLuint textVAO;
-    GLuint textVBO;
 
     // shader
     GLuint textShader;
@@ -90,7 +92,7 @@ typedef struct
     float *img_instance_data; // packed per-instance floats
     int img_instance_count;   // how many instances does it actually hold
 
-    GLuint vbo_instance; // dynamic instance buffer
+    StreamBuffer *stream; // Instances and glyphs go here, owned by the game
 
     GLuint quadShaderId;
     // GLuint textShaderId;
@@ -165,6 +167,16 @@ static inline Clay_Dimensions Gles3_MeasureText(
     };
 }
 
+// Quad VAO must be bound, no base instance in GLES3 so the pointers move instead
+static void Gles3_PointQuadInstances(Gles3_Renderer *self, size_t offset)
+{
+    GLsizei stride = INSTANCE_FLOATS_PER * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, self->stream->buffer);
+    glVertexAttribPointer(ATTR_RECT, 4, GL_FLOAT, GL_FALSE, stride, (void *)(offset));
+    glVertexAttribPointer(ATTR_UV, 4, GL_FLOAT, GL_FALSE, stride, (void *)(offset + 4 * sizeof(float)));
+    glVertexAttribPointer(ATTR_COLOR, 4, GL_FLOAT, GL_FALSE, stride, (void *)(offset + 8 * sizeof(float)));
+}
+
 void Gles3_Render(Gles3_Renderer *self, Clay_RenderCommandArray cmds)
 {
     self->text.glyph_count = 0;
@@ -508,10 +520,8 @@ void Gles3_Render(Gles3_Renderer *self, Clay_RenderCommandArray cmds)
             // Render Recatangles and Images
             if (self->instance_count > 0 || self->img_instance_count > 0)
             {
-                glUseProgram(self->quadShaderId);
-
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, self->img_atlas_tex);
+                vtx::glState.useProgram(self->quadShaderId);
+                vtx::glState.bindTexture(0, self->img_atlas_tex);
 
                 // set uniforms
                 GLint locScreen = glGetUniformLocation(self->quadShaderId, "uScreen");
@@ -519,31 +529,32 @@ void Gles3_Render(Gles3_Renderer *self, Clay_RenderCommandArray cmds)
                             (float)self->screenWidth,
                             (float)self->screenHeight);
 
-                glBindVertexArray(self->quadVAO);
+                vtx::glState.bindVertexArray(self->quadVAO);
 
-                // upload all instances at once
-                glBindBuffer(GL_ARRAY_BUFFER, self->vbo_instance);
+                // Each batch gets its own bit of the stream, earlier draws may still read theirs
+                size_t instanceBytes = INSTANCE_FLOATS_PER * sizeof(float);
 
                 // rectangles are solid colour — disable atlas use
-                glUniform1i(glGetUniformLocation(self->quadShaderId, "uUseAtlas"), 0);
-                glBufferSubData(GL_ARRAY_BUFFER,
-                                0,
-                                self->instance_count * INSTANCE_FLOATS_PER * sizeof(float),
-                                self->instance_data);
-                // draw unit quad (4 verts) instanced
-                glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, self->instance_count);
+                if (self->instance_count > 0)
+                {
+                    glUniform1i(glGetUniformLocation(self->quadShaderId, "uUseAtlas"), 0);
+                    size_t offset = self->stream->streamData(
+                        self->instance_data, self->instance_count * instanceBytes, instanceBytes);
+                    Gles3_PointQuadInstances(self, offset);
+                    // draw unit quad (4 verts) instanced
+                    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, self->instance_count);
+                }
 
                 // images are textured colour — enable atlas use
-                glUniform1i(glGetUniformLocation(self->quadShaderId, "uUseAtlas"), 1);
-                glBufferSubData(GL_ARRAY_BUFFER,
-                                0,
-                                self->img_instance_count * INSTANCE_FLOATS_PER * sizeof(float),
-                                self->img_instance_data);
-                // draw unit quad (4 verts) instanced
-                glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, self->img_instance_count);
-
-                glBindVertexArray(0);
-                glUseProgram(0);
+                if (self->img_instance_count > 0)
+                {
+                    glUniform1i(glGetUniformLocation(self->quadShaderId, "uUseAtlas"), 1);
+                    size_t offset = self->stream->streamData(
+                        self->img_instance_data, self->img_instance_count * instanceBytes, instanceBytes);
+                    Gles3_PointQuadInstances(self, offset);
+                    // draw unit quad (4 verts) instanced
+                    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, self->img_instance_count);
+                }
             }
             // Clrear instance arrays, as they were flushed to their render calls
             self->img_instance_count = 0;
@@ -552,10 +563,8 @@ void Gles3_Render(Gles3_Renderer *self, Clay_RenderCommandArray cmds)
             // Text rendering
             if (self->text.glyph_count > 0)
             {
-                glUseProgram(self->text.textShader);
-
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, self->text.atlas_tex);
+                vtx::glState.useProgram(self->text.textShader);
+                vtx::glState.bindTexture(0, self->text.atlas_tex);
 
                 GLint uScreenLoc = glGetUniformLocation(self->text.textShader, "uScreen");
                 glUniform2f(uScreenLoc, self->screenWidth, self->screenHeight);
@@ -563,17 +572,14 @@ void Gles3_Render(Gles3_Renderer *self, Clay_RenderCommandArray cmds)
                 GLint loc = glGetUniformLocation(self->text.textShader, "uAtlas");
                 glUniform1i(loc, 0);
 
-                glBindVertexArray(self->text.textVAO);
-                glBindBuffer(GL_ARRAY_BUFFER, self->text.textVBO);
-
-                glBufferSubData(GL_ARRAY_BUFFER,
-                                0,
-                                sizeof(struct GlyphVtx) * 6 * self->text.glyph_count,
-                                self->text.glyph_vertices);
-                glDrawArrays(GL_TRIANGLES, 0, self->text.glyph_count * 6);
+                vtx::glState.bindVertexArray(self->text.textVAO);
 
-                glBindVertexArray(0);
-                glBindTexture(GL_TEXTURE_2D, 0);
+                // Aligned to the vertex size, so the draw can start right there
+                size_t offset = self->stream->streamData(
+                    self->text.glyph_vertices,
+                    sizeof(struct GlyphVtx) * 6 * self->text.glyph_count,
+                    sizeof(struct GlyphVtx));
+                glDrawArrays(GL_TRIANGLES, (GLint)(offset / sizeof(struct GlyphVtx)), self->text.glyph_count * 6);
             }
             self->text.glyph_count = 0;
 
@@ -585,12 +591,12 @@ void Gles3_Render(Gles3_Renderer *self, Clay_RenderCommandArray cmds)
                 GLsizei w = (GLsizei)bb.width;
                 GLsizei h = (GLsizei)bb.height;
 
-                glEnable(GL_SCISSOR_TEST);
+                vtx::glState.setEnabled(GlStateCache::CAP_SCISSOR_TEST, true);
                 glScissor(x, y, w, h);
             }
             else
             {
-                glDisable(GL_SCISSOR_TEST);
+                vtx::glState.setEnabled(GlStateCache::CAP_SCISSOR_TEST, false);
             }
         }
     }
@@ -680,7 +686,7 @@ bool Text_LoadFont(
 
     // upload atlas to OpenGL
     glGenTextures(1, &self->atlas_tex);
-    glBindTexture(GL_TEXTURE_2D, self->atlas_tex);
+    vtx::glState.bindTexture(0, self->atlas_tex);
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
@@ -691,8 +697,6 @@ bool Text_LoadFont(
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-
     free(atlas);
 
     return true;
@@ -709,8 +713,10 @@ struct Clayton
 
     Gles3_Image pinPicture;
 
-    void initClayton(float screenWidth, float screenHeight, int max_instances)
+    void initClayton(float screenWidth, float screenHeight, int max_instances, StreamBuffer *stream)
     {
+        this->renderer.stream = stream;
+
         // Atlas will be same size
         int atlas_w = 1024;
         int atlas_h = 1024;
@@ -756,7 +762,7 @@ struct Clayton
         // create unit quad VBO (0..1)
         const float quad_verts[8] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
         glGenVertexArrays(1, &this->renderer.quadVAO);
-        glBindVertexArray(this->renderer.quadVAO);
+        vtx::glState.bindVertexArray(this->renderer.quadVAO);
 
         glGenBuffers(1, &this->renderer.quadVBO);
         glBindBuffer(GL_ARRAY_BUFFER, this->renderer.quadVBO);
@@ -776,34 +782,19 @@ struct Clayton
         this->renderer.img_instance_data = (float *)malloc(sizeof(float) * INSTANCE_FLOATS_PER * this->renderer.instance_capacity);
         this->renderer.img_instance_count = 0;
 
-        glGenBuffers(1, &this->renderer.vbo_instance);
-        glBindBuffer(GL_ARRAY_BUFFER, this->renderer.vbo_instance);
-        glBufferData(GL_ARRAY_BUFFER,
-                     sizeof(float) * INSTANCE_FLOATS_PER * this->renderer.instance_capacity,
-                     NULL,
-                     GL_DYNAMIC_DRAW);
-
-        // set up instance attributes
+        // set up instance attributes, they live in the stream
         // layout in CPU-side: [rect(4), uv(4), color(4)] = 12 floats, bytes stride = 12 * sizeof(float)
-        GLsizei stride = INSTANCE_FLOATS_PER * sizeof(float);
-
-        // aRect at location ATTR_RECT (vec4) offset 0
+        // aRect at location ATTR_RECT (vec4), aUV offset 4 floats, aColor offset 8 floats
         glEnableVertexAttribArray(ATTR_RECT);
-        glVertexAttribPointer(ATTR_RECT, 4, GL_FLOAT, GL_FALSE, stride, (void *)(0));
         glVertexAttribDivisor(ATTR_RECT, 1);
-
-        // aUV at location ATTR_UV offset 4 floats
         glEnableVertexAttribArray(ATTR_UV);
-        glVertexAttribPointer(ATTR_UV, 4, GL_FLOAT, GL_FALSE, stride, (void *)(4 * sizeof(float)));
         glVertexAttribDivisor(ATTR_UV, 1);
-
-        // aColor at location ATTR_COLOR offset 8 floats
         glEnableVertexAttribArray(ATTR_COLOR);
-        glVertexAttribPointer(ATTR_COLOR, 4, GL_FLOAT, GL_FALSE, stride, (void *)(8 * sizeof(float)));
         glVertexAttribDivisor(ATTR_COLOR, 1);
+        Gles3_PointQuadInstances(&this->renderer, 0);
 
         // unbind
-        glBindVertexArray(0);
+        vtx::glState.bindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         // Ok now we will initialize text!
@@ -823,16 +814,11 @@ struct Clayton
             t->glyph_capacity = 0;
         }
 
-        // create VAO/VBO for text rendering
+        // create VAO for text rendering, reading the stream from its start,
+        // draws pick their vertices with the first vertex
         glGenVertexArrays(1, &t->textVAO);
-        glBindVertexArray(t->textVAO);
-
-        glGenBuffers(1, &t->textVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, t->textVBO);
-        glBufferData(GL_ARRAY_BUFFER,
-                     sizeof(GlyphVtx) * 6 * t->glyph_capacity,
-                     NULL,
-                     GL_DYNAMIC_DRAW);
+        vtx::glState.bindVertexArray(t->textVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
 
         // Vertex layout for GlyphVtx:
         // struct GlyphVtx { float x,y; float u,v; float r,g,b,a; };
@@ -851,23 +837,22 @@ struct Clayton
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, gv_stride, (void *)(offsetof(GlyphVtx, r)));
 
-        glBindVertexArray(0);
+        vtx::glState.bindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
         this->renderer.text.textShader = vtx::createShaderProgram(
             CLAYTON_TEXT_VERTEX_SHADER, CLAYTON_TEXT_FRAGMENT_SHADER);
-        glUseProgram(this->renderer.text.textShader);
+        vtx::glState.useProgram(this->renderer.text.textShader);
 
         // Bind the texture to unit 0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, this->renderer.text.atlas_tex);
+        vtx::glState.bindTexture(0, this->renderer.text.atlas_tex);
 
         // Tell the shader that uAtlas = texture unit 0
         GLint loc = glGetUniformLocation(this->renderer.text.textShader, "uAtlas");
         glUniform1i(loc, 0);
 
         Texture tt;
-        tt.loadTextureFromFile("assets/files/everything_tex.png");
+        tt.loadTexture("assets/files/everything_tex.ktx", "assets/files/everything_tex.png");
         this->renderer.img_atlas_tex = tt.id;
 
         this->pinPicture = Gles3_Image{